@@ -0,0 +1,57 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// ===========================
+// HEAP ALLOCATION COUNTER
+// ===========================
+// Replaces the global operator new/delete so a thread can count its own
+// heap allocations: point `allocation_counter` at an atomic and every
+// operator new on that thread increments it. Threads without a counter pay
+// one thread-local load per allocation.
+//
+// Used to check that the acquisition hot path stays allocation-free (the
+// ec_hot_path_allocations_total metric of smart_logger and
+// bench_acquisition --check-allocations). Replacement allocation functions
+// cannot be inline: include this header in exactly one translation unit.
+inline thread_local std::atomic<uint64_t> *allocation_counter = nullptr;
+
+inline void *counted_allocate(std::size_t size, std::size_t alignment) {
+    if (allocation_counter != nullptr) {
+        allocation_counter->fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) size = 1;
+    void *p = alignment > alignof(std::max_align_t)
+              ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+              : std::malloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(std::size_t size) { return counted_allocate(size, 0); }
+void *operator new[](std::size_t size) { return counted_allocate(size, 0); }
+void *operator new(std::size_t size, std::align_val_t al) { return counted_allocate(size, (std::size_t)al); }
+void *operator new[](std::size_t size, std::align_val_t al) { return counted_allocate(size, (std::size_t)al); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    try { return counted_allocate(size, 0); } catch (...) { return nullptr; }
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    try { return counted_allocate(size, 0); } catch (...) { return nullptr; }
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,530 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sensor_registers.h"
+
+// ===========================
+// COMPRESSED ARCHIVE FORMAT (v1)
+// ===========================
+// Long-term storage of the logged samples at a few bits per value:
+//
+//   ec_archive.eca:      [ArchiveHeader][block 0][block 1]...
+//   ec_archive.eca.idx:  [ArchiveIndexEntry 0][ArchiveIndexEntry 1]...
+//
+// Samples are cut into fixed time blocks (block_seconds, aligned to the
+// Unix epoch). Each block is a self-contained bit stream, compressed the way
+// Facebook's Gorilla compresses time series:
+//
+// - Time (ms): the first value in full, then the delta of the delta to the
+//   previous sample. A steady poll rate turns that into 1 bit per sample.
+// - The register pairs as received (sensor EC, raw EC, temperature; one
+//   32-bit word each) and the derived smart EC and k (64-bit doubles): XOR
+//   with the previous value of the column. An unchanged value costs 1 bit.
+//   Otherwise only the bits between the leading and trailing zeros of the
+//   XOR are stored.
+//
+// The sparse index has one entry per block (time range, offset, size). A
+// time range query reads the index and decompresses only the blocks it
+// overlaps. Blocks are only ever appended, and the index is replaced
+// atomically (rename) once they are on disk. An interrupted append therefore
+// leaves the archive as it was, plus unindexed bytes that the next append
+// cuts off.
+const char ARCHIVE_MAGIC[8] = {'E', 'C', 'A', 'R', 'C', 'H', 'I', 'V'};
+const uint32_t ARCHIVE_VERSION = 1;
+const uint32_t ARCHIVE_BLOCK_SECONDS = 3600;
+
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_seconds;
+    uint8_t reserved[48];
+};
+
+struct ArchiveIndexEntry {
+    int64_t first_ms;           // Time of the block's first and last sample
+    int64_t last_ms;
+    uint64_t offset;            // Of the bit stream, from the start of the file
+    uint32_t bytes;
+    uint32_t count;             // Samples in the block
+};
+
+static_assert(sizeof(ArchiveHeader) == 64, "ArchiveHeader must stay 64 bytes");
+static_assert(sizeof(ArchiveIndexEntry) == 32, "ArchiveIndexEntry layout changed");
+
+inline std::string archive_index_path(const std::string &path) {
+    return path + ".idx";
+}
+
+// Reads the whole index; a missing index file is an empty archive
+inline bool read_archive_index(const std::string &path, std::vector<ArchiveIndexEntry> &index) {
+    index.clear();
+    int fd = ::open(archive_index_path(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return errno == ENOENT;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size % sizeof(ArchiveIndexEntry) == 0;
+    if (ok) {
+        index.resize(st.st_size / sizeof(ArchiveIndexEntry));
+        ok = pread(fd, index.data(), st.st_size, 0) == (ssize_t)st.st_size;
+    }
+    ::close(fd);
+    if (!ok) errno = EINVAL;
+    return ok;
+}
+
+struct ArchiveSample {
+    int64_t time_ms;                    // CLOCK_REALTIME, milliseconds
+    uint32_t words[FIELD_COUNT];        // Register pairs as received, first register high
+    double smart_ec;
+    double k_used;
+};
+
+inline uint32_t archive_word(const uint16_t *regs) {
+    return ((uint32_t)regs[0] << 16) | regs[1];
+}
+
+// Float ABCD: the word is the float's bit pattern
+inline float archive_float(uint32_t word) {
+    float value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+inline uint32_t archive_float_word(float value) {
+    uint32_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+// ===========================
+// BIT STREAMS
+// ===========================
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    int used = 8;               // Bits used in the last byte
+
+    // Appends the low `bits` bits of value, most significant first
+    void write(uint64_t value, int bits) {
+        while (bits > 0) {
+            if (used == 8) {
+                bytes.push_back(0);
+                used = 0;
+            }
+            int n = bits < 8 - used ? bits : 8 - used;
+            uint8_t chunk = (uint8_t)((value >> (bits - n)) & ((1u << n) - 1));
+            bytes.back() |= (uint8_t)(chunk << (8 - used - n));
+            used += n;
+            bits -= n;
+        }
+    }
+
+    void clear() {
+        bytes.clear();
+        used = 8;
+    }
+};
+
+// Reading past the end returns zeros and sets `overrun`
+struct BitReader {
+    const uint8_t *data;
+    size_t size;
+    size_t bit = 0;
+    bool overrun = false;
+
+    BitReader(const uint8_t *d, size_t n) : data(d), size(n) {}
+
+    uint64_t read(int bits) {
+        uint64_t value = 0;
+        while (bits > 0) {
+            if (bit / 8 >= size) {
+                overrun = true;
+                return 0;
+            }
+            int used = (int)(bit % 8);
+            int n = bits < 8 - used ? bits : 8 - used;
+            uint8_t chunk = (uint8_t)((data[bit / 8] >> (8 - used - n)) & ((1u << n) - 1));
+            value = (value << n) | chunk;
+            bit += n;
+            bits -= n;
+        }
+        return value;
+    }
+};
+
+// ===========================
+// GORILLA CODECS
+// ===========================
+// Delta of delta, in ms: 0 -> '0', then '10' + 7 bits, '110' + 9 bits,
+// '1110' + 12 bits, and '1111' + 64 bits for anything larger.
+struct TimeCodec {
+    int64_t previous = 0;
+    int64_t delta = 0;
+    bool started = false;
+
+    void encode(BitWriter &w, int64_t time_ms) {
+        if (!started) {
+            w.write((uint64_t)time_ms, 64);
+        } else {
+            int64_t d = time_ms - previous;
+            int64_t dod = d - delta;
+            delta = d;
+            if (dod == 0) {
+                w.write(0, 1);
+            } else if (dod >= -63 && dod <= 64) {
+                w.write(0x2, 2);
+                w.write((uint64_t)(dod + 63), 7);
+            } else if (dod >= -255 && dod <= 256) {
+                w.write(0x6, 3);
+                w.write((uint64_t)(dod + 255), 9);
+            } else if (dod >= -2047 && dod <= 2048) {
+                w.write(0xE, 4);
+                w.write((uint64_t)(dod + 2047), 12);
+            } else {
+                w.write(0xF, 4);
+                w.write((uint64_t)dod, 64);
+            }
+        }
+        previous = time_ms;
+        started = true;
+    }
+
+    int64_t decode(BitReader &r) {
+        if (!started) {
+            previous = (int64_t)r.read(64);
+            started = true;
+            return previous;
+        }
+        int64_t dod;
+        if (r.read(1) == 0) {
+            dod = 0;
+        } else if (r.read(1) == 0) {
+            dod = (int64_t)r.read(7) - 63;
+        } else if (r.read(1) == 0) {
+            dod = (int64_t)r.read(9) - 255;
+        } else if (r.read(1) == 0) {
+            dod = (int64_t)r.read(12) - 2047;
+        } else {
+            dod = (int64_t)r.read(64);
+        }
+        delta += dod;
+        previous += delta;
+        return previous;
+    }
+};
+
+// XOR with the previous value: '0' = same value; '10' + bits = the XOR
+// fits the previous leading/trailing zero window; '11' + leading zeros +
+// length - 1 + bits = new window. WIDTH is 32 (register pairs) or 64.
+template <int WIDTH>
+struct XorCodec {
+    static const int COUNT_BITS = WIDTH == 32 ? 5 : 6;
+
+    uint64_t previous = 0;
+    int leading = -1;           // Current window, -1 = none yet
+    int trailing = 0;
+
+    void encode(BitWriter &w, uint64_t value) {
+        uint64_t x = value ^ previous;
+        previous = value;
+        if (x == 0) {
+            w.write(0, 1);
+            return;
+        }
+
+        int lead = __builtin_clzll(x) - (64 - WIDTH);
+        int trail = __builtin_ctzll(x);
+        if (leading >= 0 && lead >= leading && trail >= trailing) {
+            w.write(0x2, 2);
+            w.write(x >> trailing, WIDTH - leading - trailing);
+            return;
+        }
+        leading = lead;
+        trailing = trail;
+        w.write(0x3, 2);
+        w.write((uint64_t)lead, COUNT_BITS);
+        w.write((uint64_t)(WIDTH - lead - trail - 1), COUNT_BITS);
+        w.write(x >> trail, WIDTH - lead - trail);
+    }
+
+    uint64_t decode(BitReader &r) {
+        if (r.read(1) == 0) return previous;
+        if (r.read(1) == 1) {
+            leading = (int)r.read(COUNT_BITS);
+            int length = (int)r.read(COUNT_BITS) + 1;
+            trailing = WIDTH - leading - length;
+        }
+        if (leading < 0 || trailing < 0) {
+            r.overrun = true;   // Corrupt stream
+            return previous;
+        }
+        previous ^= r.read(WIDTH - leading - trailing) << trailing;
+        return previous;
+    }
+};
+
+inline uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// One block's columns
+struct ArchiveCodec {
+    TimeCodec time;
+    XorCodec<32> words[FIELD_COUNT];
+    XorCodec<64> smart_ec;
+    XorCodec<64> k_used;
+
+    void encode(BitWriter &w, const ArchiveSample &s) {
+        time.encode(w, s.time_ms);
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            words[f].encode(w, s.words[f]);
+        }
+        smart_ec.encode(w, double_bits(s.smart_ec));
+        k_used.encode(w, double_bits(s.k_used));
+    }
+
+    void decode(BitReader &r, ArchiveSample &s) {
+        s.time_ms = time.decode(r);
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            s.words[f] = (uint32_t)words[f].decode(r);
+        }
+        s.smart_ec = bits_double(smart_ec.decode(r));
+        s.k_used = bits_double(k_used.decode(r));
+    }
+};
+
+// ===========================
+// WRITER
+// ===========================
+// Appends samples in time order. A block is written when the next sample
+// falls into a later time block (or the clock went back); close() writes
+// the open block and then the new index.
+struct ArchiveWriter {
+    int fd = -1;
+    std::string path;
+    ArchiveHeader header;
+    std::vector<ArchiveIndexEntry> index;
+    int64_t last_ms = INT64_MIN;        // Newest sample in the archive (when opened)
+    uint64_t data_end = sizeof(ArchiveHeader);
+    uint64_t sample_count = 0;
+
+    ArchiveCodec codec;
+    BitWriter bits;
+    ArchiveIndexEntry open_block;
+
+    ArchiveWriter() {}
+    ArchiveWriter(const ArchiveWriter &) = delete;
+    ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+
+    ~ArchiveWriter() {
+        close();
+    }
+
+    // Opens (or creates) an archive for appending. An existing archive keeps
+    // its own block length.
+    bool open(const std::string &file_path, uint32_t block_seconds = ARCHIVE_BLOCK_SECONDS) {
+        path = file_path;
+        int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (file == -1) return false;
+
+        struct stat st;
+        bool ok = fstat(file, &st) == 0;
+        memset(&header, 0, sizeof(header));
+        if (ok && st.st_size == 0) {
+            memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+            header.version = ARCHIVE_VERSION;
+            header.block_seconds = block_seconds;
+            // An empty index from the start: from now on a missing index
+            // means it was lost, not that nothing was written yet
+            ok = pwrite(file, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && write_index();
+            st.st_size = sizeof(header);
+        } else if (ok && (pread(file, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+                          || memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+                          || header.version != ARCHIVE_VERSION || header.block_seconds == 0)) {
+            errno = EINVAL;  // Not an archive, or an incompatible version
+            ok = false;
+        }
+        struct stat index_st;
+        if (ok && (uint64_t)st.st_size > sizeof(header) && stat(archive_index_path(path).c_str(), &index_st) == -1) {
+            errno = EINVAL;  // Blocks without their index: truncating would delete them
+            ok = false;
+        }
+        ok = ok && read_archive_index(path, index);
+
+        // Cut off whatever an interrupted append left behind the last indexed block
+        for (const auto &entry : index) {
+            if (entry.offset + entry.bytes > data_end) data_end = entry.offset + entry.bytes;
+            if (entry.last_ms > last_ms) last_ms = entry.last_ms;
+            sample_count += entry.count;
+        }
+        if (ok && (uint64_t)st.st_size < data_end) {
+            errno = EINVAL;  // Index points past the data
+            ok = false;
+        }
+        if (!ok || ftruncate(file, data_end) == -1) {
+            ::close(file);
+            return false;
+        }
+        fd = file;
+        return true;
+    }
+
+    int64_t block_of(int64_t time_ms) const {
+        int64_t width = (int64_t)header.block_seconds * 1000;
+        return time_ms >= 0 ? time_ms / width : (time_ms + 1) / width - 1;
+    }
+
+    bool add(const ArchiveSample &s) {
+        if (bits.bytes.size() > 0 && (block_of(s.time_ms) != block_of(open_block.first_ms)
+                                      || s.time_ms < open_block.last_ms)) {
+            if (!flush_block()) return false;
+        }
+        if (bits.bytes.empty()) {
+            codec = ArchiveCodec();
+            open_block.first_ms = s.time_ms;
+            open_block.count = 0;
+        }
+        codec.encode(bits, s);
+        open_block.last_ms = s.time_ms;
+        open_block.count++;
+        return true;
+    }
+
+    bool flush_block() {
+        if (bits.bytes.empty()) return true;
+
+        open_block.offset = data_end;
+        open_block.bytes = (uint32_t)bits.bytes.size();
+        if (pwrite(fd, bits.bytes.data(), bits.bytes.size(), data_end) != (ssize_t)bits.bytes.size()) {
+            return false;
+        }
+        data_end += bits.bytes.size();
+        index.push_back(open_block);
+        sample_count += open_block.count;
+        bits.clear();
+        return true;
+    }
+
+    // Writes the open block, then replaces the index once the data is synced
+    bool finish() {
+        if (fd == -1) return true;
+        if (!flush_block() || fsync(fd) == -1) return false;
+        return write_index();
+    }
+
+    // Replaces the index file in one rename
+    bool write_index() {
+        std::string index_path = archive_index_path(path);
+        std::string tmp_path = index_path + ".tmp";
+        int file = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (file == -1) return false;
+        size_t index_bytes = index.size() * sizeof(ArchiveIndexEntry);
+        bool ok = (index_bytes == 0 || write(file, index.data(), index_bytes) == (ssize_t)index_bytes)
+                  && fsync(file) == 0;
+        ::close(file);
+        return ok && rename(tmp_path.c_str(), index_path.c_str()) == 0;
+    }
+
+    bool close() {
+        bool ok = finish();
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+        return ok;
+    }
+};
+
+// ===========================
+// READER
+// ===========================
+struct ArchiveReader {
+    int fd = -1;
+    ArchiveHeader header;
+    std::vector<ArchiveIndexEntry> index;
+    uint64_t file_size = 0;
+    uint64_t sample_count = 0;
+    long blocks_decoded = 0;
+
+    ArchiveReader() {}
+    ArchiveReader(const ArchiveReader &) = delete;
+    ArchiveReader &operator=(const ArchiveReader &) = delete;
+
+    ~ArchiveReader() {
+        if (fd != -1) ::close(fd);
+    }
+
+    // Reads the header and the index only
+    bool open(const std::string &path) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) return false;
+        file_size = st.st_size;
+
+        if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+            || memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+            || header.version != ARCHIVE_VERSION) {
+            errno = EINVAL;
+            return false;
+        }
+        if (!read_archive_index(path, index)) return false;
+        for (const auto &entry : index) {
+            sample_count += entry.count;
+        }
+        return true;
+    }
+
+    // Calls visit(const ArchiveSample &) for every sample in [from_ms, to_ms],
+    // decompressing only the blocks whose time range overlaps it. Returns
+    // false on a read error or a corrupt block.
+    template <typename Visit>
+    bool query(int64_t from_ms, int64_t to_ms, Visit visit) {
+        std::vector<uint8_t> buffer;
+        for (const auto &entry : index) {
+            if (entry.last_ms < from_ms || entry.first_ms > to_ms) continue;
+
+            buffer.resize(entry.bytes);
+            if (entry.offset + entry.bytes > file_size
+                || pread(fd, buffer.data(), entry.bytes, entry.offset) != (ssize_t)entry.bytes) {
+                errno = EINVAL;
+                return false;
+            }
+            blocks_decoded++;
+
+            BitReader reader(buffer.data(), buffer.size());
+            ArchiveCodec codec;
+            ArchiveSample s;
+            for (uint32_t i = 0; i < entry.count; i++) {
+                codec.decode(reader, s);
+                if (reader.overrun) {
+                    errno = EINVAL;
+                    return false;
+                }
+                if (s.time_ms >= from_ms && s.time_ms <= to_ms) {
+                    visit(s);
+                }
+            }
+        }
+        return true;
+    }
+};
+
+#endif // ARCHIVE_H
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <ctime>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include "archive.h"
+
+// ===========================
+// ARCHIVE -> CSV EXPORTER
+// ===========================
+// Decompresses a time range of the long-term archive into the CSV columns
+// smart_logger writes, so plot_data.py and log_reprocess keep working:
+//
+//   ./archive_export                                      # whole archive to stdout
+//   ./archive_export ec_archive.eca day.csv --from "2026-03-01" --to "2026-03-02"
+//   ./archive_export --from 12h                           # last 12 hours
+//   ./archive_export --index                              # list the blocks
+//
+// Only the blocks whose time range overlaps --from/--to are read and
+// decompressed. Times are local, like the CSV Timestamp column:
+// YYYY-MM-DD[ HH:MM[:SS]], or relative to now (30m, 12h, 7d).
+//
+// Usage: ./archive_export [ARCHIVE] [CSV] [--from TIME] [--to TIME] [--index]
+
+bool parse_time(const std::string &text, int64_t now, int64_t &out) {
+    char unit;
+    long amount;
+    if (sscanf(text.c_str(), "%ld%c", &amount, &unit) == 2 && text.find('-') == std::string::npos) {
+        int64_t seconds = unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0;
+        if (seconds == 0) return false;
+        out = now - amount * seconds;
+        return true;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(text.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if (end == NULL) end = strptime(text.c_str(), "%Y-%m-%d %H:%M", &tm);
+    if (end == NULL) end = strptime(text.c_str(), "%Y-%m-%d", &tm);
+    if (end == NULL || *end != '\0') return false;
+    tm.tm_isdst = -1;
+    out = mktime(&tm);
+    return true;
+}
+
+std::string format_timestamp(int64_t time_ms) {
+    time_t seconds = (time_t)(time_ms / 1000);
+    struct tm tstruct;
+    char buf[80];
+    localtime_r(&seconds, &tstruct);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tstruct);
+    return buf;
+}
+
+std::string format_hex(uint32_t word) {
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%04X%04X", word >> 16, word & 0xFFFF);
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    std::string archive_path, csv_path;
+    int64_t now = time(NULL);
+    int64_t from = INT64_MIN / 1000, to = INT64_MAX / 1000 - 1;
+    bool list_index = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+            if (!parse_time(argv[++i], now, arg == "--from" ? from : to)) {
+                std::cerr << "❌ Cannot parse time: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg == "--index") {
+            list_index = true;
+        } else if (arg[0] != '-' && archive_path.empty()) {
+            archive_path = arg;
+        } else if (arg[0] != '-' && csv_path.empty()) {
+            csv_path = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [ARCHIVE] [CSV] [--from TIME] [--to TIME] [--index]\n"
+                      << "       TIME: YYYY-MM-DD[ HH:MM[:SS]] (local) or 30m, 12h, 7d ago" << std::endl;
+            return -1;
+        }
+    }
+    if (archive_path.empty()) archive_path = "ec_archive.eca";
+
+    ArchiveReader archive;
+    if (!archive.open(archive_path)) {
+        std::cerr << "❌ Cannot open archive " << archive_path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    if (list_index) {
+        std::cout << "Block,First,Last,Samples,Bytes,Bits_Per_Sample\n";
+        for (size_t b = 0; b < archive.index.size(); b++) {
+            const ArchiveIndexEntry &e = archive.index[b];
+            std::cout << b << "," << format_timestamp(e.first_ms) << "," << format_timestamp(e.last_ms) << ","
+                      << e.count << "," << e.bytes << "," << (e.count > 0 ? e.bytes * 8.0 / e.count : 0.0) << "\n";
+        }
+        std::cerr << "📦 " << archive.sample_count << " samples in " << archive.index.size() << " block(s) of "
+                  << archive.header.block_seconds << " s" << std::endl;
+        return 0;
+    }
+
+    std::ofstream csv_file;
+    if (!csv_path.empty()) {
+        csv_file.open(csv_path, std::ios::trunc);
+        if (!csv_file) {
+            std::cerr << "❌ Cannot write " << csv_path << std::endl;
+            return -1;
+        }
+    }
+    std::ostream &out = !csv_path.empty() ? csv_file : std::cout;
+
+    out << "Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation\n";
+
+    long rows = 0;
+    bool ok = archive.query(from * 1000, to * 1000 + 999, [&](const ArchiveSample &s) {
+        double sensor_ec = archive_float(s.words[FIELD_SENSOR_EC]);
+        out << format_timestamp(s.time_ms) << ","
+            << (double)archive_float(s.words[FIELD_TEMPERATURE]) << ","
+            << format_hex(s.words[FIELD_TEMPERATURE]) << ","
+            << (double)archive_float(s.words[FIELD_RAW_EC]) << ","
+            << format_hex(s.words[FIELD_RAW_EC]) << ","
+            << sensor_ec << ","
+            << s.smart_ec << ","
+            << (sensor_ec - s.smart_ec) << "\n";
+        rows++;
+    });
+    if (!ok) {
+        std::cerr << "❌ " << archive_path << " is damaged: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    std::cerr << "✅ Exported " << rows << " samples (decompressed " << archive.blocks_decoded << " of "
+              << archive.index.size() << " block(s))" << std::endl;
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "archive.h"
+#include "binary_log.h"
+#include "compensation.h"
+
+// ===========================
+// LOG -> ARCHIVE PACKER
+// ===========================
+// Compresses a smart_logger log into the long-term archive (archive.h):
+//
+//   ./archive_pack                                  # ec_data_log.csv -> ec_archive.eca
+//   ./archive_pack ec_data_log.bin ec_archive.eca   # binary log (ms timestamps, k)
+//
+// Samples at or before the newest sample already in the archive are
+// skipped, so packing a growing log again (e.g. from cron) only adds the
+// new rows. Timestamps of a CSV log have one second resolution.
+//
+// The CSV log has no k column: k is looked up in the coefficient table
+// (built-in, or --coeff-table/--interpolate as used while logging). The
+// hex columns are stored exactly; Sensor_Default_EC is stored as the float
+// its decimal text parses to.
+//
+// Usage: ./archive_pack [INPUT] [ARCHIVE] [--block-seconds S] [--coeff-table FILE] [--interpolate]
+
+struct PackStats {
+    long packed = 0;
+    long skipped = 0;           // Already archived
+    long invalid = 0;           // Unparseable CSV rows
+};
+
+std::vector<std::string> split_csv(const std::string &line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+int column_of(const std::vector<std::string> &header, const char *name) {
+    for (size_t i = 0; i < header.size(); i++) {
+        if (header[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+// Local time, as smart_logger writes it
+bool parse_timestamp(const std::string &text, int64_t &time_ms) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(text.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if (end == NULL || *end != '\0') return false;
+    tm.tm_isdst = -1;
+    time_ms = (int64_t)mktime(&tm) * 1000;
+    return true;
+}
+
+bool parse_hex_word(const std::string &text, uint32_t &word) {
+    char *end;
+    errno = 0;
+    unsigned long value = strtoul(text.c_str(), &end, 16);
+    if (text.size() != 8 || *end != '\0' || errno != 0) return false;
+    word = (uint32_t)value;
+    return true;
+}
+
+bool parse_number(const std::string &text, double &value) {
+    char *end;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+bool pack_csv(const std::string &path, const CoefficientTable &table, ArchiveWriter &archive, PackStats &stats) {
+    std::ifstream csv(path);
+    std::string line;
+    if (!csv || !std::getline(csv, line)) {
+        std::cerr << "❌ Cannot read " << path << std::endl;
+        return false;
+    }
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+
+    std::vector<std::string> header = split_csv(line);
+    int timestamp = column_of(header, "Timestamp");
+    int temperature = column_of(header, "Temperature");
+    int raw_ec = column_of(header, "Raw_EC");
+    int sensor_ec = column_of(header, "Sensor_Default_EC");
+    int smart_ec = column_of(header, "Smart_Calc_EC");
+    int hex_temp = column_of(header, "Hex_Temp");          // Missing in old logs
+    int hex_raw_ec = column_of(header, "Hex_Raw_EC");
+    if (timestamp < 0 || temperature < 0 || raw_ec < 0 || sensor_ec < 0 || smart_ec < 0) {
+        std::cerr << "❌ " << path << " is not a smart_logger CSV log (header: " << line << ")" << std::endl;
+        return false;
+    }
+
+    while (std::getline(csv, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::vector<std::string> f = split_csv(line);
+        if (f.size() < header.size()) {
+            stats.invalid++;
+            continue;
+        }
+
+        ArchiveSample s;
+        double temp = 0.0, raw = 0.0, sensor = 0.0;
+        bool ok = parse_timestamp(f[timestamp], s.time_ms)
+                  && parse_number(f[temperature], temp) && parse_number(f[raw_ec], raw)
+                  && parse_number(f[sensor_ec], sensor) && parse_number(f[smart_ec], s.smart_ec);
+        s.words[FIELD_TEMPERATURE] = archive_float_word((float)temp);
+        s.words[FIELD_RAW_EC] = archive_float_word((float)raw);
+        s.words[FIELD_SENSOR_EC] = archive_float_word((float)sensor);
+        if (ok && hex_temp >= 0) ok = parse_hex_word(f[hex_temp], s.words[FIELD_TEMPERATURE]);
+        if (ok && hex_raw_ec >= 0) ok = parse_hex_word(f[hex_raw_ec], s.words[FIELD_RAW_EC]);
+        if (!ok) {
+            stats.invalid++;
+            continue;
+        }
+        if (s.time_ms <= archive.last_ms) {
+            stats.skipped++;
+            continue;
+        }
+
+        s.k_used = lookup_k(table, archive_float(s.words[FIELD_TEMPERATURE]));
+        if (!archive.add(s)) return false;
+        stats.packed++;
+    }
+    return true;
+}
+
+bool pack_binary_log(const std::string &path, ArchiveWriter &archive, PackStats &stats) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(BinaryLogHeader)) {
+        std::cerr << "❌ Cannot read " << path << std::endl;
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "❌ mmap failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    const BinaryLogHeader *header = static_cast<const BinaryLogHeader *>(map);
+    if (header->version != BINARY_LOG_VERSION || header->record_size != sizeof(BinaryLogRecord)) {
+        std::cerr << "❌ Unsupported binary log version " << header->version << std::endl;
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    const BinaryLogRecord *records = reinterpret_cast<const BinaryLogRecord *>(
+        static_cast<const char *>(map) + sizeof(BinaryLogHeader));
+    size_t capacity = (st.st_size - sizeof(BinaryLogHeader)) / sizeof(BinaryLogRecord);
+    bool ok = true;
+    for (size_t i = 0; ok && i < capacity && records[i].commit == BINARY_LOG_COMMIT; i++) {
+        const BinaryLogRecord &r = records[i];
+        ArchiveSample s;
+        s.time_ms = r.realtime_ns / 1000000;
+        if (s.time_ms <= archive.last_ms) {
+            stats.skipped++;
+            continue;
+        }
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            s.words[f] = archive_word(r.raw[f]);
+        }
+        s.smart_ec = r.smart_ec;
+        s.k_used = r.k_used;
+        ok = archive.add(s);
+        stats.packed++;
+    }
+    munmap(map, st.st_size);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    std::string input_path, archive_path, table_path;
+    uint32_t block_seconds = ARCHIVE_BLOCK_SECONDS;
+    bool interpolate = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--block-seconds" && i + 1 < argc) {
+            block_seconds = (uint32_t)atoi(argv[++i]);
+            if (block_seconds == 0) {
+                std::cerr << "❌ Invalid --block-seconds value: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg == "--coeff-table" && i + 1 < argc) {
+            table_path = argv[++i];
+        } else if (arg == "--interpolate") {
+            interpolate = true;
+        } else if (arg[0] != '-' && input_path.empty()) {
+            input_path = arg;
+        } else if (arg[0] != '-' && archive_path.empty()) {
+            archive_path = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [INPUT] [ARCHIVE] [--block-seconds S]\n"
+                      << "       [--coeff-table FILE] [--interpolate]\n"
+                      << "       INPUT: ec_data_log.csv (default) or a binary log; ARCHIVE: ec_archive.eca" << std::endl;
+            return -1;
+        }
+    }
+    if (input_path.empty()) input_path = "ec_data_log.csv";
+    if (archive_path.empty()) archive_path = "ec_archive.eca";
+
+    CoefficientTable table = DEFAULT_COEFFICIENT_TABLE;
+    if (!table_path.empty() && !load_coefficient_table(table_path, table)) {
+        return -1;
+    }
+    if (interpolate) {
+        table.mode = COEFF_LINEAR;
+    }
+
+    // Binary logs are recognised by their magic, anything else is read as CSV
+    char magic[sizeof(BINARY_LOG_MAGIC)] = {};
+    std::ifstream probe(input_path, std::ios::binary);
+    if (!probe) {
+        std::cerr << "❌ Cannot open " << input_path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    probe.read(magic, sizeof(magic));
+    bool binary = memcmp(magic, BINARY_LOG_MAGIC, sizeof(magic)) == 0;
+    probe.close();
+
+    ArchiveWriter archive;
+    if (!archive.open(archive_path, block_seconds)) {
+        std::cerr << "❌ Cannot open archive " << archive_path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    size_t blocks_before = archive.index.size();
+    uint64_t bytes_before = archive.data_end;
+
+    PackStats stats;
+    bool ok = binary ? pack_binary_log(input_path, archive, stats)
+                     : pack_csv(input_path, table, archive, stats);
+    if (!archive.close() || !ok) {
+        std::cerr << "❌ Packing " << input_path << " into " << archive_path << " failed: "
+                  << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct stat st;
+    double input_bytes = stat(input_path.c_str(), &st) == 0 ? (double)st.st_size : 0.0;
+    if (binary) input_bytes = (double)(stats.packed + stats.skipped) * sizeof(BinaryLogRecord);  // Not the preallocation
+    uint64_t added_bytes = archive.data_end - bytes_before;
+    std::cerr << "✅ Packed " << stats.packed << " samples from " << input_path << " into " << archive_path
+              << " (" << archive.index.size() - blocks_before << " new block(s), "
+              << stats.skipped << " already archived, " << stats.invalid << " invalid rows)" << std::endl;
+    if (stats.packed > 0) {
+        long rows = stats.packed + stats.skipped + stats.invalid;
+        std::cerr << std::fixed << std::setprecision(1)
+                  << "   " << added_bytes * 8.0 / stats.packed << " bits/sample ("
+                  << added_bytes * 8.0 / stats.packed / (FIELD_COUNT + 3) << " bits/value), "
+                  << input_bytes / rows << " bytes/row in " << input_path << std::endl;
+    }
+    std::cerr << "   Archive: " << archive.sample_count << " samples in " << archive.index.size()
+              << " block(s), " << archive.data_end << " bytes" << std::endl;
+    return 0;
+}
@@ -3,82 +3,41 @@
 #include <vector>
 #include <modbus.h>
 #include <cerrno>
-
-// Function to generate port names based on OS
-std::vector<std::string> get_candidate_ports() {
-    std::vector<std::string> ports;
-    
-    #ifdef _WIN32
-    // Windows: Scan COM1 to COM20
-    // NOTE: Ports above COM9 require the "\\\\.\\" prefix
-    for (int i = 1; i <= 20; i++) {
-        ports.push_back("\\\\.\\COM" + std::to_string(i));
-    }
-    #else
-    // Linux: Scan standard USB, ACM, and serial ports
-    for (int i = 0; i < 10; i++) {
-        ports.push_back("/dev/ttyUSB" + std::to_string(i));
-        ports.push_back("/dev/ttyACM" + std::to_string(i));
-        ports.push_back("/dev/ttyS" + std::to_string(i));
-    }
-    #endif
-    
-    return ports;
-}
+#include "port_discovery.h"
 
 // THE DISCOVERY FUNCTION
-std::string find_sensor_port() {
-    std::vector<std::string> port_list = get_candidate_ports();
-    uint16_t tab_reg[1]; // Storage for the "Handshake" read
+// All candidate ports are probed at once; each port keeps one open context
+// while slave IDs 1-10 are swept (see port_discovery.h).
+SensorLocation find_sensor_port() {
+    DiscoveryOptions options;
+    options.preferred_slave_id = 4;     // Factory default, tried on every port first
+    for (int slave_id = 1; slave_id <= 10; slave_id++) {
+        options.slave_ids.push_back(slave_id);
+    }
+    // The "Handshake": Read Register 8 (Device Address)
+    // This confirms it is actually YOUR sensor, not a mouse or printer.
+    options.handshake_register = 8;
+    options.handshake_count = 1;
 
     std::cout << "Scanning ports for sensor..." << std::endl;
 
-    for (const auto &port : port_list) {
-        std::cout << "Trying " << port << "..." << std::endl;
-        
-        // Try different slave IDs (1-10)
-        for (int slave_id = 1; slave_id <= 10; slave_id++) {
-            // 1. Create a temporary context for this port
-            // Settings: 9600 Baud, N, 8, 1 (Must match sensor default)
-            modbus_t *ctx = modbus_new_rtu(port.c_str(), 9600, 'N', 8, 1);
-            
-            if (ctx == NULL) continue;
-
-            // 2. Set Slave ID
-            modbus_set_slave(ctx, slave_id);
-
-            // 3. IMPORTANT: Set a Short Timeout
-            // If a port is empty, we don't want to wait 5 seconds.
-            // Set timeout to 100ms (0 sec, 100000 usec)
-            modbus_set_response_timeout(ctx, 0, 100000);
-
-            // 4. Try to Open
-            if (modbus_connect(ctx) != -1) {
-                // 5. The "Handshake": Try to read Register 8 (Device Address)
-                // This confirms it is actually YOUR sensor, not a mouse or printer.
-                int rc = modbus_read_registers(ctx, 8, 1, tab_reg);
+    SensorLocation location = discover_sensor(options);
 
-                if (rc != -1) {
-                    // SUCCESS! We got a valid reply.
-                    std::cout << " >> FOUND SENSOR at: " << port << " with Slave ID: " << slave_id << std::endl;
-                    std::cout << " >> Device Address Register: " << tab_reg[0] << std::endl;
-                    modbus_close(ctx);
-                    modbus_free(ctx);
-                    return port; // Return the valid port string
-                }
-                modbus_close(ctx);
-            }
-            modbus_free(ctx);
-        }
+    if (!location.port.empty()) {
+        std::cout << " >> FOUND SENSOR at: " << location.port << " with Slave ID: " << location.slave_id
+                  << (location.from_cache ? " (cached)" : "") << std::endl;
+        std::cout << " >> Device Address Register: " << location.handshake[0] << std::endl;
     }
+    std::cout << " >> Scan took " << (int)location.elapsed_ms << " ms" << std::endl;
 
-    return ""; // Return empty string if not found
+    return location;
 }
 
 // --- MAIN PROGRAM ---
 int main() {
     // Step 1: Auto-Detect the Port
-    std::string valid_port = find_sensor_port();
+    SensorLocation location = find_sensor_port();
+    std::string valid_port = location.port;
 
     if (valid_port.empty()) {
         std::cerr << "ERROR: Sensor not found on any port!" << std::endl;
@@ -87,10 +46,11 @@ int main() {
     }
 
     // Step 2: Use the Found Port for the Real Connection
-    std::cout << "Connecting to live sensor on " << valid_port << "..." << std::endl;
+    // (at the rate it answered discovery: --tune-link may have raised it)
+    std::cout << "Connecting to live sensor on " << valid_port << " at " << location.baud << " baud..." << std::endl;
     
-    modbus_t *main_ctx = modbus_new_rtu(valid_port.c_str(), 9600, 'N', 8, 1);
-    modbus_set_slave(main_ctx, 1);
+    modbus_t *main_ctx = modbus_new_rtu(valid_port.c_str(), location.baud, 'N', 8, 1);
+    modbus_set_slave(main_ctx, location.slave_id);
     
     if (modbus_connect(main_ctx) == -1) {
         std::cerr << "Connection failed." << std::endl;
@@ -103,4 +63,4 @@ int main() {
     modbus_close(main_ctx);
     modbus_free(main_ctx);
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
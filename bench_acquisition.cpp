@@ -0,0 +1,369 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <modbus.h>
+#include "sensor_registers.h"
+#include "port_discovery.h"
+#include "bus_scheduler.h"
+#include "sensor_simulator.h"
+#include "link_tuner.h"
+#include "output_stages.h"
+#include "dashboard.h"
+#include "alloc_counter.h"
+
+// ===========================
+// END-TO-END THROUGHPUT BENCHMARK
+// ===========================
+// Measures the real discovery and acquisition code against the pty
+// simulator, so polling performance can be compared run to run without the
+// IOT-485-EC4A attached:
+//
+//   1. Discovery, exactly as smart_logger (temperature handshake) and
+//      auto_detect_sensor (register 8, IDs 1-10) run it, with the simulator
+//      added through DiscoveryOptions::extra_ports. The port cache is not
+//      read or written.
+//   2. With --tune, smart_logger's link tuning (turnaround measurement,
+//      timeouts and, with --baud-register, baud negotiation).
+//   3. The acquisition loop: BusScheduler::poll_once with the merged read
+//      plan, the same response timeout as smart_logger (or the tuned one)
+//      and the same fallback handling as run_acquisition().
+//   4. With --check-allocations, every sample also goes through
+//      smart_logger's own output stages (output_stages.h, dashboard.h) with
+//      every per-sample feature on: ring, oversampling filter, compensation,
+//      gateway cache, rollups, calibration fit, CSV log for the first slave
+//      and binary log for the others, and a dashboard frame per sample
+//      (written to /dev/null). The logs go to a temporary directory. The
+//      heap allocations of the whole loop after a short warm-up are counted
+//      (alloc_counter.h); any allocation fails the run (exit status -1).
+//      ctest runs this against the simulator (CMakeLists.txt).
+//
+// Usage: ./bench_acquisition [--samples N] [--slave ID]... [--period MS]
+//        [--timeout-ms MS] [--baud N] [--latency MS] [--jitter MS]
+//        [--crc-errors RATE] [--dropouts RATE] [--strict-map]
+//        [--tune [--baud-register ADDR] [--max-baud N] [--reliable-baud N]]
+//        [--check-allocations]
+
+struct BenchOptions {
+    long samples = 500;
+    double period_ms = 0.0;             // 0 = back to back
+    int timeout_ms = 1000;              // smart_logger uses 1 s in the main loop
+    bool tune = false;
+    bool check_allocations = false;
+    LinkTuneOptions link;
+};
+
+const long ALLOCATION_WARMUP_POLLS = 10;   // First connection, lazy libc state
+const double ALLOCATION_FILTER_PERIOD_MS = 50.0;    // Short, so the check sees many filter periods
+
+// --check-allocations: the per-sample features of smart_logger, logging
+// into `dir`. Returns false if a log cannot be opened.
+bool open_output_stages(BusScheduler &bus, const std::string &dir, ModbusGateway &gateway) {
+    for (size_t i = 0; i < bus.slaves.size(); i++) {
+        SlaveChannel &slave = bus.slaves[i];
+        std::string base = dir + "/slave" + std::to_string(slave.slave_id);
+        slave.filter.reset(new SampleFilter());
+        slave.filter->period_ms = ALLOCATION_FILTER_PERIOD_MS;
+        slave.calibration.reset(new CoefficientFitter());
+        slave.calibration->reset(slave.table);
+        slave.rollups.reset(new RollupStore());
+        int retention_days[TIER_COUNT] = {1, 1, 1};
+        if (!slave.rollups->open(base + "_rollup", retention_days)) {
+            std::cerr << "❌ Cannot open rollups in " << dir << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (i == 0) {
+            slave.log_path = base + ".csv";
+            if (!open_csv_log(slave.log, slave.log_path, true)) return false;
+        } else {
+            slave.log_path = base + ".bin";
+            slave.binary_log.reset(new BinaryLog());
+            if (!slave.binary_log->open(slave.log_path)) {
+                std::cerr << "❌ Cannot open " << slave.log_path << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+        }
+        gateway.add_unit(slave.slave_id);
+    }
+    return true;
+}
+
+// Closes and deletes what open_output_stages() created
+void remove_output_stages(BusScheduler &bus, const std::string &dir) {
+    for (auto &slave : bus.slaves) {
+        std::string base = dir + "/slave" + std::to_string(slave.slave_id);
+        if (slave.log.is_open()) slave.log.close();
+        if (slave.binary_log) slave.binary_log->close();
+        if (slave.rollups) slave.rollups->close();
+        unlink(slave.log_path.c_str());
+        for (int t = 0; t < TIER_COUNT; t++) {
+            unlink(rollup_tier_path(base + "_rollup", t).c_str());
+        }
+    }
+    rmdir(dir.c_str());
+}
+
+double percentile(std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --samples N         Samples to acquire (default 500)\n"
+              << "  --slave ID          Simulated slave ID (repeatable, default 4)\n"
+              << "  --period MS         Poll period per slave (default 0 = as fast as possible)\n"
+              << "  --timeout-ms MS     Response timeout (default 1000)\n"
+              << "  --baud N            Simulated line speed (default 9600)\n"
+              << "  --latency MS        Simulated turnaround (default 20)\n"
+              << "  --jitter MS         Uniform +/- jitter on the turnaround\n"
+              << "  --crc-errors RATE   Fraction of corrupted replies (0-1)\n"
+              << "  --dropouts RATE     Fraction of unanswered requests (0-1)\n"
+              << "  --strict-map        Simulator refuses reads over unmapped registers\n"
+              << "  --tune              Tune the link first (replaces --timeout-ms)\n"
+              << "  --baud-register A   Simulated baud register; --tune then negotiates the rate\n"
+              << "  --max-baud N        Fastest rate the simulated sensor accepts (default 115200)\n"
+              << "  --reliable-baud N   Simulated cable corrupts every reply above N baud\n"
+              << "  --check-allocations Fail if polling or smart_logger's output stages allocate" << std::endl;
+}
+
+// Times one discovery pass; returns the elapsed milliseconds or -1
+double bench_discovery(const char *label, DiscoveryOptions options, const std::string &port) {
+    options.extra_ports.push_back(port);
+    options.use_cache = false;
+
+    SensorLocation location = discover_sensor(options);
+    bool ok = (location.port == port);
+    std::cout << "   " << std::left << std::setw(34) << label << std::right
+              << (ok ? "✅ " : "❌ ") << std::fixed << std::setprecision(1)
+              << location.elapsed_ms << " ms";
+    if (ok) std::cout << " (slave " << location.slave_id << ")";
+    std::cout << std::endl;
+    return ok ? location.elapsed_ms : -1.0;
+}
+
+int main(int argc, char **argv) {
+    SimulatorConfig sim;
+    BenchOptions bench;
+    std::vector<int> slave_ids;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--samples" && has_value) {
+            bench.samples = atol(argv[++i]);
+        } else if (arg == "--slave" && has_value) {
+            slave_ids.push_back(atoi(argv[++i]));
+        } else if (arg == "--period" && has_value) {
+            bench.period_ms = atof(argv[++i]);
+        } else if (arg == "--timeout-ms" && has_value) {
+            bench.timeout_ms = atoi(argv[++i]);
+        } else if (arg == "--baud" && has_value) {
+            sim.baud = atoi(argv[++i]);
+        } else if (arg == "--latency" && has_value) {
+            sim.latency_ms = atof(argv[++i]);
+        } else if (arg == "--jitter" && has_value) {
+            sim.jitter_ms = atof(argv[++i]);
+        } else if (arg == "--crc-errors" && has_value) {
+            sim.crc_error_rate = atof(argv[++i]);
+        } else if (arg == "--dropouts" && has_value) {
+            sim.dropout_rate = atof(argv[++i]);
+        } else if (arg == "--strict-map") {
+            sim.strict_map = true;
+        } else if (arg == "--tune") {
+            bench.tune = true;
+        } else if (arg == "--check-allocations") {
+            bench.check_allocations = true;
+        } else if (arg == "--baud-register" && has_value) {
+            sim.baud_register = atoi(argv[++i]);
+            bench.link.baud_register = sim.baud_register;
+        } else if (arg == "--max-baud" && has_value) {
+            sim.max_baud = atoi(argv[++i]);
+        } else if (arg == "--reliable-baud" && has_value) {
+            sim.reliable_baud = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (!slave_ids.empty()) {
+        sim.slave_ids = slave_ids;
+    }
+
+    SensorSimulator simulator;
+    if (!simulator.start(sim)) {
+        return -1;
+    }
+    std::cout << "🧪 Simulator on " << simulator.path() << " | " << sim.baud << " baud | latency "
+              << sim.latency_ms << " ± " << sim.jitter_ms << " ms | CRC errors "
+              << sim.crc_error_rate * 100 << "% | dropouts " << sim.dropout_rate * 100 << "%" << std::endl;
+
+    // Step 1: Discovery
+    std::cout << "\n🔍 Discovery" << std::endl;
+    int baud = sim.baud > 0 ? sim.baud : 9600;
+    DiscoveryOptions logger_discovery;
+    logger_discovery.baud = baud;
+    logger_discovery.preferred_slave_id = sim.slave_ids[0];
+    double discovery_ms = bench_discovery("smart_logger (reg 60-61)", logger_discovery, simulator.path());
+
+    DiscoveryOptions detect_discovery;
+    detect_discovery.baud = baud;
+    for (int id = 1; id <= 10; id++) {
+        detect_discovery.slave_ids.push_back(id);
+    }
+    detect_discovery.handshake_register = 8;
+    detect_discovery.handshake_count = 1;
+    bench_discovery("auto_detect_sensor (reg 8, 1-10)", detect_discovery, simulator.path());
+
+    if (discovery_ms < 0) {
+        std::cerr << "❌ Simulator was not discovered" << std::endl;
+        return -1;
+    }
+
+    // Step 2: Link tuning
+    double turnaround_ms = sim.latency_ms;
+    uint32_t response_timeout_usec = (uint32_t)bench.timeout_ms * 1000;
+    uint32_t byte_timeout_usec = 0;
+    if (bench.tune) {
+        ReadPlan probe_plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud);
+        std::cout << "\n🔧 Link tuning" << std::endl;
+        LinkTuneResult link;
+        bool tuned = tune_link(simulator.path(), sim.slave_ids, baud, probe_plan.blocks[0], bench.link, link);
+        for (const auto &note : link.notes) {
+            std::cout << "   " << note << std::endl;
+        }
+        if (!tuned) {
+            std::cerr << "❌ Link tuning failed" << std::endl;
+            return -1;
+        }
+        baud = link.baud;
+        turnaround_ms = link.measurement.turnaround_ms;
+        response_timeout_usec = link.response_timeout_usec;
+        byte_timeout_usec = link.byte_timeout_usec;
+        std::cout << std::fixed << std::setprecision(1)
+                  << "   Timeouts:        response " << response_timeout_usec / 1000.0 << " ms, byte "
+                  << byte_timeout_usec / 1000.0 << " ms" << std::endl;
+        std::cout << "   Max rate:        " << link.max_transactions_per_s << " transactions/s at "
+                  << baud << " baud (simulator now at " << simulator.baud() << ")" << std::endl;
+    }
+
+    // Step 3: Acquisition loop
+    ReadPlan plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud, turnaround_ms);
+    ReadPlan fallback_plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, plan.baud,
+                                                 turnaround_ms, false);
+    // Laid out like one of smart_logger's buses, so the same dashboard draws it
+    static std::deque<BusPipeline> buses;
+    buses.emplace_back(simulator.path(), plan.baud, plan, fallback_plan);
+    BusScheduler &bus = buses.front().bus;
+    for (int id : sim.slave_ids) {
+        bus.add_slave(id, bench.period_ms, DEFAULT_COEFFICIENT_TABLE, "");
+    }
+    if (!bus.connect(response_timeout_usec / 1000000, response_timeout_usec % 1000000, byte_timeout_usec)) {
+        std::cerr << "❌ Connection to " << simulator.path() << " failed" << std::endl;
+        return -1;
+    }
+
+    std::cout << "\n📡 Acquisition (" << bench.samples << " polls, " << plan.describe() << ")" << std::endl;
+
+    std::vector<double> latency_ms;
+    latency_ms.reserve(bench.samples);
+    long failures = 0, timeouts = 0, bad_crc = 0;
+    std::atomic<uint64_t> allocations{0};
+    SampleRing &ring = buses.front().ring;
+    OutputStages &stages = buses.front().stages;
+    static ModbusGateway gateway;
+    static TermRenderer screen;
+    char output_dir[] = "/tmp/bench_acquisition_XXXXXX";
+    if (bench.check_allocations) {
+        if (mkdtemp(output_dir) == NULL || !open_output_stages(bus, output_dir, gateway)) {
+            std::cerr << "❌ Cannot set up the output stages in " << output_dir << std::endl;
+            return -1;
+        }
+        stages.oversample = true;
+        stages.gateway = &gateway;
+        screen.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        screen.max_fps = 0;                 // A frame per sample
+    }
+
+    bus.start();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < bench.samples; i++) {
+        if (bench.check_allocations && i == ALLOCATION_WARMUP_POLLS) {
+            allocation_counter = &allocations;
+        }
+        bus.poll_once([&](const AcquiredSample &acquired) {
+            if (!acquired.ok) {
+                failures++;
+                if (acquired.error == ETIMEDOUT) timeouts++;
+                if (acquired.error == EMBBADCRC) bad_crc++;
+                bus.fall_back_if_refused(acquired.error);
+                return;
+            }
+            latency_ms.push_back((acquired.monotonic_ns - acquired.request_ns) / 1e6);
+            if (bench.check_allocations) {
+                ring.push(acquired);
+            }
+        });
+        if (bench.check_allocations) {
+            stages.process(bus, ring);
+            if (stages.frame_pending && screen.frame_due()) {
+                stages.frame_pending = false;
+                render_dashboard(screen, buses);
+            }
+        }
+    }
+    allocation_counter = nullptr;
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(latency_ms.begin(), latency_ms.end());
+    long ok = (long)latency_ms.size();
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "   Samples/s:       " << ok / elapsed_s << " (bus model limit "
+              << bus.bus_limit_sps() << ", " << std::setprecision(0)
+              << 100.0 * ok / elapsed_s / bus.bus_limit_sps() << "%)" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "   Latency p50:     " << percentile(latency_ms, 50) << " ms" << std::endl;
+    std::cout << "   Latency p99:     " << percentile(latency_ms, 99) << " ms" << std::endl;
+    std::cout << "   Latency max:     " << (latency_ms.empty() ? 0.0 : latency_ms.back()) << " ms" << std::endl;
+    std::cout << "   Model read time: " << bus.active_plan().bus_time_ms() << " ms"
+              << (bus.use_fallback ? " (fell back to one read per value)" : "") << std::endl;
+    std::cout << "   Failures:        " << failures << " (" << timeouts << " timeouts, "
+              << bad_crc << " bad CRC)" << std::endl;
+    if (bench.period_ms > 0) {
+        long missed = 0;
+        for (const auto &s : bus.slaves) {
+            missed += s.missed_deadlines;
+        }
+        std::cout << "   Missed periods:  " << missed << std::endl;
+    }
+    std::cout << "   Discovery:       " << discovery_ms << " ms" << std::endl;
+
+    bool allocation_free = allocations == 0;
+    if (bench.check_allocations) {
+        long checked = std::max(bench.samples - ALLOCATION_WARMUP_POLLS, 0L);
+        long filtered = 0;
+        for (const auto &s : bus.slaves) {
+            filtered += s.filter->emitted_total;
+        }
+        std::cout << "   Allocations:     " << allocations << " in " << checked << " polls after warm-up ("
+                  << filtered << " filtered samples logged, " << screen.frames << " frames) "
+                  << (allocation_free ? "✅" : "❌") << std::endl;
+        remove_output_stages(bus, output_dir);
+        close(screen.fd);
+    }
+
+    bus.disconnect();
+    simulator.stop();
+    if (!allocation_free) {
+        std::cerr << "❌ The acquisition hot path allocated on the heap" << std::endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,444 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <modbus.h>
+#include "compensation.h"
+#include "sensor_registers.h"
+#include "fast_format.h"
+
+// ===========================
+// CORE KERNEL MICROBENCHMARKS
+// ===========================
+// Times the per-sample kernels of the logger in isolation, so a change to
+// one of them can be judged without the serial link in the way:
+//
+//   decode/*      decode_float_abcd on the three register pairs
+//   coeff/*       get_dynamic_k, lookup_k (step and linear tables)
+//   compensate/*  calculate_smart_ec, compensate_ec and every batch engine
+//   format/*      hex words, timestamps and whole CSV rows
+//   reference/*   the iostream/strftime code the logger used before
+//                 fast_format.h, to keep the gap visible
+//
+// Inputs model a real run: the temperature sweeps 0-40 °C and back (with
+// probe noise), raw EC follows the 12.88 mS/cm standard with a k of about
+// 0.019, the register words are the Float ABCD encoding of those values
+// and timestamps advance one second per sample.
+//
+// Each kernel runs over all inputs once to warm up and then --repetitions
+// times; the median pass is reported in ns per call. --json writes the
+// results for later runs to --compare against: a kernel whose median got
+// slower by more than --threshold percent is a regression (exit status -1).
+//
+// Usage: ./bench_kernels [--samples N] [--repetitions R] [--filter TEXT]
+//        [--json FILE] [--compare BASELINE.json] [--threshold PCT]
+
+struct KernelInputs {
+    std::vector<double> temp;
+    std::vector<double> raw_ec;
+    std::vector<double> sensor_ec;
+    std::vector<SensorSample> samples;
+    std::vector<time_t> time;
+};
+
+struct KernelResult {
+    std::string name;
+    double ns_per_op = 0.0;         // Median pass
+    double min_ns_per_op = 0.0;
+    double max_ns_per_op = 0.0;
+    long ops = 0;                   // Calls timed, all passes
+};
+
+struct KernelOptions {
+    size_t samples = 4096;
+    int repetitions = 25;
+    std::string filter;
+    std::string json_path;
+    std::string baseline_path;
+    double threshold_pct = 10.0;
+};
+
+// Keeps results alive so the optimizer cannot drop the kernel
+volatile double bench_sink;
+
+void encode_float_abcd(float value, uint16_t *dest) {
+    uint32_t word;
+    memcpy(&word, &value, sizeof(word));
+    dest[0] = (uint16_t)(word >> 16);
+    dest[1] = (uint16_t)(word & 0xFFFF);
+}
+
+KernelInputs make_inputs(size_t n) {
+    KernelInputs in;
+    std::mt19937 rng(12880);
+    std::normal_distribution<double> probe_noise(0.0, 0.02);
+    std::normal_distribution<double> ec_noise(0.0, 0.005);
+    time_t start = 1767225600;  // 2026-01-01 00:00:00 UTC
+
+    for (size_t i = 0; i < n; i++) {
+        double phase = (double)i / (double)n;                   // 0 -> 40 -> 0 °C
+        double temp = 40.0 * (1.0 - std::fabs(2.0 * phase - 1.0)) + probe_noise(rng);
+        double raw_ec = 12.88 * (1.0 + 0.019 * (temp - 25.0)) + ec_noise(rng);
+        double sensor_ec = raw_ec / (1.0 + 0.02 * (temp - 25.0));
+
+        SensorSample s;
+        float values[FIELD_COUNT];
+        values[FIELD_SENSOR_EC] = (float)sensor_ec;
+        values[FIELD_RAW_EC] = (float)raw_ec;
+        values[FIELD_TEMPERATURE] = (float)temp;
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            encode_float_abcd(values[f], s.raw[f]);
+            s.value[f] = values[f];
+        }
+
+        in.temp.push_back(s.value[FIELD_TEMPERATURE]);
+        in.raw_ec.push_back(s.value[FIELD_RAW_EC]);
+        in.sensor_ec.push_back(s.value[FIELD_SENSOR_EC]);
+        in.samples.push_back(s);
+        in.time.push_back(start + (time_t)i);
+    }
+    return in;
+}
+
+// Runs `pass` (one call per input, returns a checksum) and records the result
+template <typename Pass>
+void run_kernel(const KernelOptions &options, std::vector<KernelResult> &results, const char *name,
+                size_t ops_per_pass, Pass pass) {
+    if (!options.filter.empty() && strstr(name, options.filter.c_str()) == NULL) return;
+
+    bench_sink = pass();  // Warm-up: caches, branch predictors, lazy libc state
+    std::vector<double> ns_per_op;
+    for (int r = 0; r < options.repetitions; r++) {
+        auto start = std::chrono::steady_clock::now();
+        double checksum = pass();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        bench_sink = checksum;
+        ns_per_op.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / (double)ops_per_pass);
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+
+    KernelResult result;
+    result.name = name;
+    result.ns_per_op = ns_per_op[ns_per_op.size() / 2];
+    result.min_ns_per_op = ns_per_op.front();
+    result.max_ns_per_op = ns_per_op.back();
+    result.ops = (long)(ops_per_pass * options.repetitions);
+    results.push_back(result);
+
+    std::cout << "   " << std::left << std::setw(38) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << result.ns_per_op << " ns"
+              << "  (min " << result.min_ns_per_op << ")" << std::endl;
+}
+
+// ===========================
+// PRE-FAST_FORMAT REFERENCES
+// ===========================
+// The formatting code smart_logger used before the hot path stopped
+// allocating (stringstream hex, strftime per row, iostream CSV rows).
+std::string reference_hex_string(uint16_t reg_high, uint16_t reg_low) {
+    std::stringstream ss;
+    ss << std::uppercase << std::hex << std::setfill('0')
+       << std::setw(4) << reg_high
+       << std::setw(4) << reg_low;
+    return ss.str();
+}
+
+std::string reference_timestamp(time_t now) {
+    struct tm tstruct;
+    char buf[80];
+    tstruct = *localtime(&now);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tstruct);
+    return buf;
+}
+
+void run_kernels(const KernelOptions &options, const KernelInputs &in, std::vector<KernelResult> &results) {
+    const size_t n = in.temp.size();
+    CoefficientTable step = DEFAULT_COEFFICIENT_TABLE;
+    CoefficientTable linear = DEFAULT_COEFFICIENT_TABLE;
+    linear.mode = COEFF_LINEAR;
+    std::vector<double> out(n), k(n);
+
+    std::cout << "\n🔢 Decode" << std::endl;
+    run_kernel(options, results, "decode/decode_float_abcd", n * FIELD_COUNT, [&] {
+        double sum = 0.0;
+        for (const auto &s : in.samples) {
+            for (int f = 0; f < FIELD_COUNT; f++) {
+                sum += decode_float_abcd(s.raw[f]);
+            }
+        }
+        return sum;
+    });
+
+    std::cout << "\n📐 Coefficient lookup" << std::endl;
+    run_kernel(options, results, "coeff/get_dynamic_k", n, [&] {
+        double sum = 0.0;
+        for (double t : in.temp) sum += get_dynamic_k(t);
+        return sum;
+    });
+    run_kernel(options, results, "coeff/lookup_k_step", n, [&] {
+        double sum = 0.0;
+        for (double t : in.temp) sum += lookup_k(step, t);
+        return sum;
+    });
+    run_kernel(options, results, "coeff/lookup_k_linear", n, [&] {
+        double sum = 0.0;
+        for (double t : in.temp) sum += lookup_k(linear, t);
+        return sum;
+    });
+
+    std::cout << "\n🧮 Compensation" << std::endl;
+    run_kernel(options, results, "compensate/calculate_smart_ec", n, [&] {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++) sum += calculate_smart_ec(in.raw_ec[i], in.temp[i]);
+        return sum;
+    });
+    run_kernel(options, results, "compensate/compensate_ec_step", n, [&] {
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++) sum += compensate_ec(step, in.raw_ec[i], in.temp[i]);
+        return sum;
+    });
+    run_kernel(options, results, "compensate/batch_scalar_step", n, [&] {
+        compensate_batch_scalar(step, in.raw_ec.data(), in.temp.data(), out.data(), k.data(), n);
+        return out[n / 2];
+    });
+#ifdef EC_COMPENSATION_X86
+    run_kernel(options, results, "compensate/batch_sse2_step", n, [&] {
+        compensate_batch_sse2(step, in.raw_ec.data(), in.temp.data(), out.data(), k.data(), n);
+        return out[n / 2];
+    });
+    if (__builtin_cpu_supports("avx2")) {
+        run_kernel(options, results, "compensate/batch_avx2_step", n, [&] {
+            compensate_batch_avx2(step, in.raw_ec.data(), in.temp.data(), out.data(), k.data(), n);
+            return out[n / 2];
+        });
+        run_kernel(options, results, "compensate/batch_avx2_linear", n, [&] {
+            compensate_batch_avx2(linear, in.raw_ec.data(), in.temp.data(), out.data(), k.data(), n);
+            return out[n / 2];
+        });
+    }
+#endif
+    run_kernel(options, results, "compensate/batch_dispatch_step", n, [&] {
+        compensate_batch(step, in.raw_ec.data(), in.temp.data(), out.data(), n, k.data());
+        return out[n / 2];
+    });
+
+    std::cout << "\n📝 Formatting" << std::endl;
+    char hex[HEX_WORD_CHARS];
+    char row[CSV_ROW_MAX];
+    run_kernel(options, results, "format/format_hex_word", n * 2, [&] {
+        double sum = 0.0;
+        for (const auto &s : in.samples) {
+            sum += format_hex_word(hex, s.raw[FIELD_TEMPERATURE][0], s.raw[FIELD_TEMPERATURE][1])[7];
+            sum += format_hex_word(hex, s.raw[FIELD_RAW_EC][0], s.raw[FIELD_RAW_EC][1])[7];
+        }
+        return sum;
+    });
+    run_kernel(options, results, "format/timestamp_cache", n, [&] {
+        TimestampCache clock;  // Fresh each pass: includes the once-a-minute localtime_r
+        double sum = 0.0;
+        for (time_t t : in.time) sum += clock.format(t)[18];
+        return sum;
+    });
+    run_kernel(options, results, "format/csv_row", n, [&] {
+        TimestampCache clock;
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            sum += (double)format_csv_row(row, clock, in.time[i], in.samples[i], in.sensor_ec[i] * 0.99);
+        }
+        return sum;
+    });
+
+    run_kernel(options, results, "reference/hex_stringstream", n * 2, [&] {
+        double sum = 0.0;
+        for (const auto &s : in.samples) {
+            sum += reference_hex_string(s.raw[FIELD_TEMPERATURE][0], s.raw[FIELD_TEMPERATURE][1])[7];
+            sum += reference_hex_string(s.raw[FIELD_RAW_EC][0], s.raw[FIELD_RAW_EC][1])[7];
+        }
+        return sum;
+    });
+    run_kernel(options, results, "reference/timestamp_strftime", n, [&] {
+        double sum = 0.0;
+        for (time_t t : in.time) sum += reference_timestamp(t)[18];
+        return sum;
+    });
+    run_kernel(options, results, "reference/csv_row_iostream", n, [&] {
+        std::ostringstream log;
+        for (size_t i = 0; i < n; i++) {
+            const SensorSample &s = in.samples[i];
+            double smart_ec = in.sensor_ec[i] * 0.99;
+            log << reference_timestamp(in.time[i]) << ","
+                << s.value[FIELD_TEMPERATURE] << ","
+                << reference_hex_string(s.raw[FIELD_TEMPERATURE][0], s.raw[FIELD_TEMPERATURE][1]) << ","
+                << s.value[FIELD_RAW_EC] << ","
+                << reference_hex_string(s.raw[FIELD_RAW_EC][0], s.raw[FIELD_RAW_EC][1]) << ","
+                << s.value[FIELD_SENSOR_EC] << ","
+                << smart_ec << ","
+                << s.value[FIELD_SENSOR_EC] - smart_ec << "\n";
+        }
+        return (double)log.tellp();
+    });
+}
+
+// ===========================
+// RESULT FILES
+// ===========================
+// One result object per line, so runs diff cleanly and load_results() can
+// read them back without a JSON library.
+bool write_results(const std::string &path, const KernelOptions &options,
+                   const std::vector<KernelResult> &results) {
+    std::ofstream json(path, std::ios::trunc);
+    if (!json) {
+        std::cerr << "❌ Cannot write " << path << std::endl;
+        return false;
+    }
+
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    json << "{\n"
+         << "  \"suite\": \"bench_kernels\",\n"
+         << "  \"date\": \"" << stamp << "\",\n"
+         << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+         << "  \"compensation_engine\": \"" << compensation_engine_name() << "\",\n"
+         << "  \"samples\": " << options.samples << ",\n"
+         << "  \"repetitions\": " << options.repetitions << ",\n"
+         << "  \"unit\": \"ns_per_op\",\n"
+         << "  \"results\": [\n";
+    json << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < results.size(); i++) {
+        const KernelResult &r = results[i];
+        json << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.ns_per_op
+             << ", \"min_ns_per_op\": " << r.min_ns_per_op << ", \"max_ns_per_op\": " << r.max_ns_per_op
+             << ", \"ops\": " << r.ops << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+    return (bool)json;
+}
+
+bool load_results(const std::string &path, std::vector<KernelResult> &results) {
+    std::ifstream json(path);
+    if (!json) {
+        std::cerr << "❌ Cannot read baseline " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(json, line)) {
+        size_t name = line.find("{\"name\": \"");
+        size_t median = line.find("\"ns_per_op\": ");
+        if (name == std::string::npos || median == std::string::npos) continue;
+
+        KernelResult r;
+        name += 10;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.ns_per_op = atof(line.c_str() + median + 13);
+        results.push_back(r);
+    }
+    if (results.empty()) {
+        std::cerr << "❌ " << path << " holds no bench_kernels results" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Prints old vs new per kernel; returns the number of regressions
+int compare_results(const std::vector<KernelResult> &baseline, const std::vector<KernelResult> &results,
+                    double threshold_pct) {
+    int regressions = 0;
+    std::cout << "\n📊 Against baseline (threshold ±" << std::setprecision(0) << threshold_pct << "%)" << std::endl;
+    for (const auto &r : results) {
+        auto old = std::find_if(baseline.begin(), baseline.end(),
+                                [&](const KernelResult &b) { return b.name == r.name; });
+        std::cout << "   " << std::left << std::setw(38) << r.name << std::right;
+        if (old == baseline.end() || old->ns_per_op <= 0.0) {
+            std::cout << "      (new)" << std::endl;
+            continue;
+        }
+        double change_pct = (r.ns_per_op / old->ns_per_op - 1.0) * 100.0;
+        const char *verdict = "";
+        if (change_pct > threshold_pct) {
+            verdict = "  ❌ REGRESSION";
+            regressions++;
+        } else if (change_pct < -threshold_pct) {
+            verdict = "  ✅ faster";
+        }
+        std::cout << std::setprecision(2) << std::setw(10) << old->ns_per_op << " -> " << std::setw(8)
+                  << r.ns_per_op << " ns  " << std::showpos << std::setprecision(1) << std::setw(7)
+                  << change_pct << std::noshowpos << "%" << verdict << std::endl;
+    }
+    return regressions;
+}
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --samples N          Inputs per pass (default 4096)\n"
+              << "  --repetitions R      Timed passes per kernel (default 25)\n"
+              << "  --filter TEXT        Only kernels whose name contains TEXT\n"
+              << "  --json FILE          Write the results as JSON\n"
+              << "  --compare FILE       Compare against an earlier --json file\n"
+              << "  --threshold PCT      Slowdown that counts as a regression (default 10)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    KernelOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--samples" && has_value) {
+            options.samples = (size_t)atol(argv[++i]);
+        } else if (arg == "--repetitions" && has_value) {
+            options.repetitions = atoi(argv[++i]);
+        } else if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "--compare" && has_value) {
+            options.baseline_path = argv[++i];
+        } else if (arg == "--threshold" && has_value) {
+            options.threshold_pct = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (options.samples == 0 || options.repetitions <= 0) {
+        std::cerr << "❌ --samples and --repetitions must be positive" << std::endl;
+        return -1;
+    }
+
+    std::vector<KernelResult> baseline;
+    if (!options.baseline_path.empty() && !load_results(options.baseline_path, baseline)) {
+        return -1;
+    }
+
+    std::cout << "⏱️  Kernel benchmarks: " << options.samples << " samples (0-40 °C sweep), "
+              << options.repetitions << " passes, median ns per call | compensation engine "
+              << compensation_engine_name() << std::endl;
+    KernelInputs inputs = make_inputs(options.samples);
+    std::vector<KernelResult> results;
+    run_kernels(options, inputs, results);
+
+    if (!options.json_path.empty()) {
+        if (!write_results(options.json_path, options, results)) return -1;
+        std::cout << "\n💾 Results written to " << options.json_path << std::endl;
+    }
+
+    if (!baseline.empty()) {
+        int regressions = compare_results(baseline, results, options.threshold_pct);
+        if (regressions > 0) {
+            std::cerr << "❌ " << regressions << " kernel(s) slower than " << options.baseline_path << std::endl;
+            return -1;
+        }
+        std::cout << "✅ No regressions against " << options.baseline_path << std::endl;
+    }
+    return 0;
+}
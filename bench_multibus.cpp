@@ -0,0 +1,266 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <modbus.h>
+#include "sensor_registers.h"
+#include "bus_scheduler.h"
+#include "rtu_event_loop.h"
+#include "sensor_simulator.h"
+
+// ===========================
+// MULTI-ADAPTER ACQUISITION BENCHMARK
+// ===========================
+// Starts one pty simulator per "USB-RS485 adapter" and polls the sensors
+// back to back for a fixed time, with 1, 2, 4, ... up to --adapters
+// adapters:
+//
+//   event    One thread: RtuEventLoop keeps a transaction in flight on
+//            every adapter.
+//   threads  One thread per adapter blocking in BusScheduler::poll_once
+//            (libmodbus), which is what one smart_logger per adapter does.
+//
+// For every adapter count it prints the samples/s, the scaling against N
+// times the single-adapter rate, and the CPU time of the acquisition
+// thread(s), measured with CLOCK_THREAD_CPUTIME_ID so the simulator threads
+// are not counted.
+//
+// Usage: ./bench_multibus [--adapters N] [--seconds S] [--mode event|threads|both]
+//        [--baud N] [--latency MS] [--jitter MS] [--crc-errors RATE] [--dropouts RATE]
+//        [--strict-map] [--timeout-ms MS]
+
+struct MultibusOptions {
+    int adapters = 8;
+    double seconds = 3.0;               // Per adapter count and mode
+    bool event = true;
+    bool threads = true;
+    int timeout_ms = 1000;
+};
+
+struct MultibusResult {
+    long samples = 0;
+    long failures = 0;
+    double elapsed_s = 0.0;
+    double cpu_s = 0.0;                 // Acquisition thread(s) only
+};
+
+const int SETTLE_MS = 200;              // Lets replies still in flight drain between runs
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --adapters N        Largest number of simulated adapters (default 8)\n"
+              << "  --seconds S         Polling time per adapter count and mode (default 3)\n"
+              << "  --mode MODE         event, threads or both (default both)\n"
+              << "  --baud N            Simulated line speed (default 9600)\n"
+              << "  --latency MS        Simulated turnaround (default 20)\n"
+              << "  --jitter MS         Uniform +/- jitter on the turnaround\n"
+              << "  --crc-errors RATE   Fraction of corrupted replies (0-1)\n"
+              << "  --dropouts RATE     Fraction of unanswered requests (0-1)\n"
+              << "  --strict-map        Simulators refuse reads over unmapped registers\n"
+              << "  --timeout-ms MS     Response timeout (default 1000)" << std::endl;
+}
+
+// One adapter count, one thread: RtuEventLoop over every adapter
+bool run_event_loop(const std::deque<SensorSimulator> &simulators, int adapters, const ReadPlan &plan,
+                    const ReadPlan &fallback_plan, int slave_id, const MultibusOptions &options,
+                    MultibusResult &result) {
+    std::deque<BusScheduler> buses;
+    RtuEventLoop loop;
+    for (int a = 0; a < adapters; a++) {
+        buses.emplace_back(simulators[a].path(), plan.baud, plan, fallback_plan);
+        buses.back().add_slave(slave_id, 0.0, DEFAULT_COEFFICIENT_TABLE, "");
+        if (!loop.add_port(buses.back(), (uint32_t)options.timeout_ms * 1000)) {
+            std::cerr << "❌ Cannot open " << simulators[a].path() << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    for (auto &bus : buses) {
+        bus.start();
+    }
+    loop.start();
+    int64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int64_t start = clock_ns(CLOCK_MONOTONIC);
+    int64_t end = start + (int64_t)(options.seconds * 1e9);
+    while (clock_ns(CLOCK_MONOTONIC) < end) {
+        loop.run_once(100, [&](BusScheduler &bus, const AcquiredSample &acquired) {
+            if (acquired.ok) {
+                result.samples++;
+            } else {
+                result.failures++;
+                bus.fall_back_if_refused(acquired.error);
+            }
+        });
+    }
+    result.elapsed_s = (clock_ns(CLOCK_MONOTONIC) - start) / 1e9;
+    result.cpu_s = (clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start) / 1e9;
+    return true;
+}
+
+// One adapter count, one blocking libmodbus thread per adapter
+bool run_threads(const std::deque<SensorSimulator> &simulators, int adapters, const ReadPlan &plan,
+                 const ReadPlan &fallback_plan, int slave_id, const MultibusOptions &options,
+                 MultibusResult &result) {
+    std::vector<MultibusResult> per_thread(adapters);
+    std::vector<bool> connected(adapters, false);
+    std::vector<std::thread> threads;
+    int64_t start = clock_ns(CLOCK_MONOTONIC);
+    int64_t end = start + (int64_t)(options.seconds * 1e9);
+
+    for (int a = 0; a < adapters; a++) {
+        threads.emplace_back([&, a]() {
+            BusScheduler bus(simulators[a].path(), plan.baud, plan, fallback_plan);
+            bus.add_slave(slave_id, 0.0, DEFAULT_COEFFICIENT_TABLE, "");
+            uint32_t timeout_usec = (uint32_t)options.timeout_ms * 1000;
+            if (!bus.connect(timeout_usec / 1000000, timeout_usec % 1000000)) {
+                return;
+            }
+            connected[a] = true;
+            MultibusResult &r = per_thread[a];
+            bus.start();
+            int64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+            while (clock_ns(CLOCK_MONOTONIC) < end) {
+                bus.poll_once([&](const AcquiredSample &acquired) {
+                    if (acquired.ok) {
+                        r.samples++;
+                    } else {
+                        r.failures++;
+                        bus.fall_back_if_refused(acquired.error);
+                    }
+                });
+            }
+            r.cpu_s = (clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start) / 1e9;
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    result.elapsed_s = (clock_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+    for (int a = 0; a < adapters; a++) {
+        if (!connected[a]) {
+            std::cerr << "❌ Connection to " << simulators[a].path() << " failed" << std::endl;
+            return false;
+        }
+        result.samples += per_thread[a].samples;
+        result.failures += per_thread[a].failures;
+        result.cpu_s += per_thread[a].cpu_s;
+    }
+    return true;
+}
+
+void print_row(int adapters, const MultibusResult &r, double single_sps) {
+    double sps = r.samples / r.elapsed_s;
+    double scaling = single_sps > 0 ? sps / (adapters * single_sps) : 0.0;
+    std::cout << "   " << std::left << std::setw(10) << adapters << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << sps << std::setw(13) << sps / adapters
+              << std::setw(9) << std::setprecision(0) << scaling * 100 << "%"
+              << std::setw(8) << std::setprecision(2) << 100.0 * r.cpu_s / r.elapsed_s << "%"
+              << std::setw(10) << std::setprecision(1)
+              << (r.samples > 0 ? r.cpu_s * 1e6 / r.samples : 0.0) << " µs"
+              << std::setw(10) << r.failures << std::endl;
+}
+
+int main(int argc, char **argv) {
+    SimulatorConfig sim;
+    MultibusOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--adapters" && has_value) {
+            options.adapters = atoi(argv[++i]);
+        } else if (arg == "--seconds" && has_value) {
+            options.seconds = atof(argv[++i]);
+        } else if (arg == "--mode" && has_value) {
+            std::string mode = argv[++i];
+            options.event = (mode == "event" || mode == "both");
+            options.threads = (mode == "threads" || mode == "both");
+            if (!options.event && !options.threads) {
+                print_usage(argv[0]);
+                return -1;
+            }
+        } else if (arg == "--baud" && has_value) {
+            sim.baud = atoi(argv[++i]);
+        } else if (arg == "--latency" && has_value) {
+            sim.latency_ms = atof(argv[++i]);
+        } else if (arg == "--jitter" && has_value) {
+            sim.jitter_ms = atof(argv[++i]);
+        } else if (arg == "--crc-errors" && has_value) {
+            sim.crc_error_rate = atof(argv[++i]);
+        } else if (arg == "--dropouts" && has_value) {
+            sim.dropout_rate = atof(argv[++i]);
+        } else if (arg == "--strict-map") {
+            sim.strict_map = true;
+        } else if (arg == "--timeout-ms" && has_value) {
+            options.timeout_ms = atoi(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (options.adapters < 1 || options.seconds <= 0) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    // One simulator per adapter, each with its own seed
+    std::deque<SensorSimulator> simulators;
+    for (int a = 0; a < options.adapters; a++) {
+        SimulatorConfig config = sim;
+        config.seed = sim.seed + a;
+        simulators.emplace_back();
+        if (!simulators.back().start(config)) {
+            return -1;
+        }
+    }
+    int slave_id = sim.slave_ids[0];
+    int baud = sim.baud > 0 ? sim.baud : 9600;
+    ReadPlan plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud, sim.latency_ms);
+    ReadPlan fallback_plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud, sim.latency_ms, false);
+
+    std::cout << "🧪 " << options.adapters << " simulated adapter(s) | " << sim.baud << " baud | latency "
+              << sim.latency_ms << " ± " << sim.jitter_ms << " ms | CRC errors " << sim.crc_error_rate * 100
+              << "% | dropouts " << sim.dropout_rate * 100 << "% | " << options.seconds << " s per run" << std::endl;
+    std::cout << "   Bus model limit: " << std::fixed << std::setprecision(1) << 1000.0 / plan.bus_time_ms()
+              << " samples/s per adapter (" << plan.describe() << ")" << std::endl;
+
+    std::vector<int> counts;
+    for (int n = 1; n < options.adapters; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(options.adapters);
+
+    for (int pass = 0; pass < 2; pass++) {
+        bool event = (pass == 0);
+        if ((event && !options.event) || (!event && !options.threads)) continue;
+
+        std::cout << "\n📡 " << (event ? "Event loop (1 thread, epoll + timerfd)"
+                                       : "Blocking libmodbus (1 thread per adapter)") << std::endl;
+        std::cout << "   Adapters   Samples/s  Per adapter  Scaling     CPU  CPU/sample  Failures" << std::endl;
+        double single_sps = 0.0;
+        for (int n : counts) {
+            MultibusResult result;
+            bool ok = event
+                ? run_event_loop(simulators, n, plan, fallback_plan, slave_id, options, result)
+                : run_threads(simulators, n, plan, fallback_plan, slave_id, options, result);
+            if (!ok) {
+                return -1;
+            }
+            if (n == 1) {
+                single_sps = result.samples / result.elapsed_s;
+            }
+            print_row(n, result, single_sps);
+            std::this_thread::sleep_for(std::chrono::milliseconds(SETTLE_MS));
+        }
+    }
+
+    for (auto &s : simulators) {
+        s.stop();
+    }
+    return 0;
+}
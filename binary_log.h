@@ -0,0 +1,223 @@
+#ifndef BINARY_LOG_H
+#define BINARY_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sensor_registers.h"
+
+// ===========================
+// BINARY LOG FORMAT (v1)
+// ===========================
+// A file of fixed-size records behind a 64-byte header:
+//
+//   [BinaryLogHeader][record 0][record 1]...[preallocated, zeroed space]
+//
+// The file is memory-mapped MAP_SHARED, so a record is in the kernel page
+// cache as soon as it is copied in: a crash of the logger loses nothing,
+// without a flush() per row. A power cut loses whatever the kernel has not
+// written back yet, so the output loop calls sync_if_due() between batches:
+// fdatasync() once BINARY_LOG_SYNC_RECORDS records or
+// BINARY_LOG_SYNC_INTERVAL_NS have piled up. (msync(MS_ASYNC) would not
+// do: on Linux it returns without writing anything.)
+//
+// A record becomes visible only when its commit word is stored last, so a
+// reader stops cleanly at a half-written record.
+const char BINARY_LOG_MAGIC[8] = {'E', 'C', 'Q', 'A', 'L', 'O', 'G', '\0'};
+const uint32_t BINARY_LOG_VERSION = 1;
+const uint32_t BINARY_LOG_COMMIT = 0x43524543;  // "CERC"
+const size_t BINARY_LOG_GROW_RECORDS = 16384;   // 1 MiB per growth step
+const size_t BINARY_LOG_SYNC_RECORDS = 64;
+const int64_t BINARY_LOG_SYNC_INTERVAL_NS = 1000000000;
+
+struct BinaryLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t record_count;      // Hint only; readers trust commit words
+    uint8_t reserved[40];
+};
+
+struct BinaryLogRecord {
+    uint32_t commit;                    // BINARY_LOG_COMMIT once complete
+    uint8_t version;                    // BINARY_LOG_VERSION
+    uint8_t slave_id;
+    uint16_t reserved0;
+    int64_t monotonic_ns;               // CLOCK_MONOTONIC (sample spacing/jitter)
+    int64_t realtime_ns;                // CLOCK_REALTIME (CSV Timestamp column)
+    uint16_t raw[FIELD_COUNT][2];       // Register words as received
+    float value[FIELD_COUNT];           // Decoded Float ABCD values
+    double smart_ec;                    // Compensated value
+    float k_used;                       // Coefficient used for smart_ec
+    uint32_t reserved1;
+};
+
+static_assert(sizeof(BinaryLogHeader) == 64, "BinaryLogHeader must stay 64 bytes");
+static_assert(sizeof(BinaryLogRecord) == 64, "BinaryLogRecord must stay 64 bytes");
+
+inline int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// ===========================
+// WRITER
+// ===========================
+struct BinaryLog {
+    int fd = -1;
+    char *map = NULL;
+    size_t capacity = 0;        // Records that fit in the current mapping
+    size_t count = 0;           // Committed records
+    size_t synced = 0;          // Records known to be on disk
+    int64_t last_sync_ns = 0;   // CLOCK_MONOTONIC
+    std::string path;
+
+    BinaryLog() {}
+    BinaryLog(const BinaryLog &) = delete;
+    BinaryLog &operator=(const BinaryLog &) = delete;
+
+    ~BinaryLog() {
+        close();
+    }
+
+    BinaryLogHeader *header() {
+        return reinterpret_cast<BinaryLogHeader *>(map);
+    }
+
+    BinaryLogRecord *records() {
+        return reinterpret_cast<BinaryLogRecord *>(map + sizeof(BinaryLogHeader));
+    }
+
+    static size_t file_size_for(size_t records) {
+        return sizeof(BinaryLogHeader) + records * sizeof(BinaryLogRecord);
+    }
+
+    bool map_records(size_t records) {
+        if (ftruncate(fd, file_size_for(records)) == -1) return false;
+
+        void *m = mmap(NULL, file_size_for(records), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED) return false;
+
+        if (map != NULL) munmap(map, file_size_for(capacity));
+        map = static_cast<char *>(m);
+        capacity = records;
+        return true;
+    }
+
+    // Opens (or creates) a log and positions after the last committed record.
+    bool open(const std::string &file_path) {
+        path = file_path;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) return false;
+
+        // Check an existing header before the file is resized or mapped, so
+        // a foreign file is left exactly as it was
+        bool fresh = st.st_size < (off_t)sizeof(BinaryLogHeader);
+        BinaryLogHeader h;
+        if (!fresh && (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)
+                       || memcmp(h.magic, BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC)) != 0
+                       || h.version != BINARY_LOG_VERSION || h.record_size != sizeof(BinaryLogRecord))) {
+            errno = EINVAL;  // Not a binary log, or an incompatible layout
+            return false;
+        }
+        size_t existing = fresh ? 0 : (st.st_size - sizeof(BinaryLogHeader)) / sizeof(BinaryLogRecord);
+        if (!map_records(existing < BINARY_LOG_GROW_RECORDS ? BINARY_LOG_GROW_RECORDS : existing)) {
+            return false;
+        }
+
+        if (fresh) {
+            BinaryLogHeader *h = header();
+            memcpy(h->magic, BINARY_LOG_MAGIC, sizeof(h->magic));
+            h->version = BINARY_LOG_VERSION;
+            h->record_size = sizeof(BinaryLogRecord);
+            h->record_count = 0;
+        }
+
+        // Resume after the last record that was fully written
+        count = header()->record_count < capacity ? header()->record_count : 0;
+        while (count < capacity && records()[count].commit == BINARY_LOG_COMMIT) {
+            count++;
+        }
+        synced = count;
+        last_sync_ns = clock_ns(CLOCK_MONOTONIC);
+        return true;
+    }
+
+    bool append(const BinaryLogRecord &record) {
+        if (count == capacity && !map_records(capacity + BINARY_LOG_GROW_RECORDS)) {
+            return false;
+        }
+
+        BinaryLogRecord *slot = &records()[count];
+        memcpy(slot, &record, sizeof(BinaryLogRecord));
+        slot->commit = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->commit = BINARY_LOG_COMMIT;
+
+        count++;
+        header()->record_count = count;
+        return true;
+    }
+
+    // Writes the new records to disk when enough of them (or enough time)
+    // piled up. Blocks for the disk write: call it between batches, never
+    // per record.
+    bool sync_if_due(int64_t now_ns) {
+        size_t pending = count - synced;
+        if (pending == 0) return true;
+        if (pending < BINARY_LOG_SYNC_RECORDS && now_ns - last_sync_ns < BINARY_LOG_SYNC_INTERVAL_NS) {
+            return true;
+        }
+        synced = count;
+        last_sync_ns = now_ns;
+        return fdatasync(fd) == 0;
+    }
+
+    void close() {
+        if (map != NULL) {
+            msync(map, file_size_for(capacity), MS_SYNC);
+            munmap(map, file_size_for(capacity));
+            map = NULL;
+            // Give back the unused preallocation. Only a log that open()
+            // mapped is resized: a rejected file is never touched.
+            if (ftruncate(fd, file_size_for(count)) == -1) {
+                // Harmless: readers stop at the first uncommitted record
+            }
+        }
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+// Fills a record from one decoded sample and the time it was acquired.
+inline BinaryLogRecord make_log_record(int slave_id, const SensorSample &sample,
+                                       int64_t monotonic_ns, int64_t realtime_ns,
+                                       double smart_ec, double k_used) {
+    BinaryLogRecord r;
+    memset(&r, 0, sizeof(r));
+    r.version = BINARY_LOG_VERSION;
+    r.slave_id = (uint8_t)slave_id;
+    r.monotonic_ns = monotonic_ns;
+    r.realtime_ns = realtime_ns;
+    memcpy(r.raw, sample.raw, sizeof(r.raw));
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        r.value[f] = (float)sample.value[f];
+    }
+    r.smart_ec = smart_ec;
+    r.k_used = (float)k_used;
+    return r;
+}
+
+#endif // BINARY_LOG_H
@@ -0,0 +1,385 @@
+#ifndef BUS_SCHEDULER_H
+#define BUS_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <modbus.h>
+#include "sensor_registers.h"
+#include "binary_log.h"
+#include "compensation.h"
+#include "metrics.h"
+#include "rollup.h"
+#include "calibration.h"
+#include "sample_filter.h"
+
+// ===========================
+// SCHEDULE TUNING
+// ===========================
+// A failed poll is retried inside its own period, resuming at the block that
+// failed (the values already read are kept), as long as the retry can still
+// start before the next deadline.
+const int POLL_RETRIES_PER_PERIOD = 2;
+const int64_t POLL_RETRY_DELAY_NS = 20000000;   // Let the line settle after garbage
+
+// Adaptive mode (--adaptive MIN_MS:MAX_MS): the period is scaled after every
+// sample so each poll sees about ADAPTIVE_TARGET_STEPS "significant" changes.
+// Fast changes shrink the period at once; stable readings stretch it slowly.
+const double ADAPTIVE_TEMP_STEP = 0.05;         // °C
+const double ADAPTIVE_EC_STEP = 0.005;          // Fraction of the raw EC reading
+const double ADAPTIVE_TARGET_STEPS = 0.5;
+const double ADAPTIVE_MIN_FACTOR = 0.25;        // Fastest speed-up per sample
+const double ADAPTIVE_MAX_FACTOR = 1.25;        // Slowest slow-down per sample
+
+// A sleeping poll checks this often whether the logger is stopping
+const int64_t SLEEP_SLICE_NS = 100000000;
+
+// Sleeps until an absolute CLOCK_MONOTONIC time, so the time spent reading,
+// logging and drawing never adds up into drift. Returns false early once
+// *running is cleared.
+inline bool sleep_until_ns(int64_t deadline_ns, const std::atomic<bool> *running = NULL) {
+    while (running == NULL || running->load(std::memory_order_relaxed)) {
+        int64_t wake_ns = deadline_ns;
+        if (running != NULL) {
+            wake_ns = std::min(deadline_ns, clock_ns(CLOCK_MONOTONIC) + SLEEP_SLICE_NS);
+        }
+        struct timespec ts;
+        ts.tv_sec = wake_ns / 1000000000LL;
+        ts.tv_nsec = wake_ns % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+        if (wake_ns == deadline_ns) return true;
+    }
+    return false;
+}
+
+// ===========================
+// PER-SLAVE CHANNEL
+// ===========================
+// One EC probe on the shared RS485 segment. Each channel keeps its own poll
+// period, coefficient table and log stream (CSV or binary).
+//
+// Ownership: the acquisition thread owns the schedule state and bumps the
+// counters; the output stages own the log streams, the rollups, the
+// calibration fitter, the oversampling filter, `table` and `last`.
+struct SlaveChannel {
+    int slave_id;
+    std::atomic<double> period_ms{0.0};     // Current period, 0 = as fast as the bus allows
+    double min_period_ms = 0.0;             // Adaptive bounds, max_period_ms = 0: fixed rate
+    double max_period_ms = 0.0;
+    CoefficientTable table;
+    std::string log_path;
+    std::ofstream log;
+    std::unique_ptr<BinaryLog> binary_log;
+    std::unique_ptr<RollupStore> rollups;   // NULL unless --rollups
+    std::unique_ptr<CoefficientFitter> calibration;    // NULL unless --calibrate
+    std::unique_ptr<SampleFilter> filter;   // NULL unless --oversample
+
+    // Schedule state (CLOCK_MONOTONIC ns)
+    int64_t deadline_ns = 0;            // Start of the current period on the fixed-rate grid
+    int64_t next_due_ns = 0;            // Next poll: the deadline, or a retry inside the period
+    int retries = 0;
+    size_t resume_block = 0;            // First read plan block a retry still has to read
+    SensorSample partial;               // Blocks read so far in this period
+    bool has_previous = false;          // Adaptive mode: values of the previous sample
+    double previous_temp = 0.0;
+    double previous_ec = 0.0;
+
+    std::atomic<long> samples{0};
+    std::atomic<long> failures{0};
+    std::atomic<long> missed_deadlines{0};  // Periods that could not start before the next one
+    SensorSample last;                  // Latest sample seen by the output stages
+};
+
+// ===========================
+// ACQUIRED SAMPLE
+// ===========================
+// What the acquisition thread hands to the output stages: raw data only,
+// stamped when the read finished.
+struct AcquiredSample {
+    uint32_t slave_index;
+    bool ok;
+    int error;                          // errno of the failed read when !ok
+    int64_t request_ns;                 // CLOCK_MONOTONIC when the first request went out
+    int64_t monotonic_ns;
+    int64_t realtime_ns;
+    SensorSample sample;
+};
+
+// ===========================
+// BUS SCHEDULER
+// ===========================
+// Owns the single modbus_t of one serial port and shares it between every
+// configured slave. Slaves are served earliest-deadline-first; slaves that
+// are due at the same time are served round-robin, back to back, so the bus
+// never idles while a poll is pending.
+struct BusScheduler {
+    std::string port;
+    int baud;
+    ReadPlan plan;
+    ReadPlan fallback_plan;             // Used once the sensor refuses `plan`
+    std::atomic<bool> use_fallback{false};
+    modbus_t *ctx = NULL;
+    std::deque<SlaveChannel> slaves;    // deque: channels never move once added
+    std::chrono::steady_clock::time_point started;
+    int64_t started_ns = 0;             // Same instant on CLOCK_MONOTONIC
+    size_t last_polled = 0;
+    LoggerMetrics *metrics = NULL;      // Optional instrumentation (set before start())
+    std::atomic<bool> running{true};    // Cleared to stop the acquisition loop
+
+    BusScheduler(const std::string &port_name, int baud_rate, const ReadPlan &read_plan,
+                 const ReadPlan &fallback_read_plan)
+        : port(port_name), baud(baud_rate), plan(read_plan), fallback_plan(fallback_read_plan) {}
+
+    ~BusScheduler() {
+        disconnect();
+    }
+
+    // byte_timeout_usec = 0 keeps the libmodbus default (500 ms)
+    bool connect(uint32_t timeout_sec, uint32_t timeout_usec, uint32_t byte_timeout_usec = 0) {
+        ctx = modbus_new_rtu(port.c_str(), baud, 'N', 8, 1);
+        if (ctx == NULL) return false;
+
+        modbus_set_response_timeout(ctx, timeout_sec, timeout_usec);
+        if (byte_timeout_usec > 0) {
+            modbus_set_byte_timeout(ctx, byte_timeout_usec / 1000000, byte_timeout_usec % 1000000);
+        }
+        if (modbus_connect(ctx) == -1) {
+            modbus_free(ctx);
+            ctx = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (ctx != NULL) {
+            modbus_close(ctx);
+            modbus_free(ctx);
+            ctx = NULL;
+        }
+    }
+
+    // Both plans are immutable after setup, so any thread may read the
+    // active one while the acquisition thread switches over.
+    const ReadPlan &active_plan() const {
+        return use_fallback.load(std::memory_order_relaxed) ? fallback_plan : plan;
+    }
+
+    // Some firmware rejects reads that span unmapped registers. Returns true
+    // if this error made us switch to one read per value.
+    bool fall_back_if_refused(int error) {
+        if (error == EMBXILADD && !use_fallback
+            && fallback_plan.transactions() > plan.transactions()) {
+            use_fallback = true;
+            for (auto &s : slaves) {
+                s.resume_block = 0;     // Block indexes refer to the old plan
+            }
+            return true;
+        }
+        return false;
+    }
+
+    SlaveChannel &add_slave(int slave_id, double period_ms, const CoefficientTable &table,
+                            const std::string &log_path) {
+        slaves.emplace_back();
+        SlaveChannel &s = slaves.back();
+        s.slave_id = slave_id;
+        s.period_ms = period_ms;
+        s.table = table;
+        s.log_path = log_path;
+        return s;
+    }
+
+    // Lets the period of every slave float between min_ms and max_ms with the
+    // rate of change of its readings. The configured period is the start value.
+    void set_adaptive(double min_ms, double max_ms) {
+        for (auto &s : slaves) {
+            s.min_period_ms = min_ms;
+            s.max_period_ms = max_ms;
+            s.period_ms = std::min(std::max(s.period_ms.load(), min_ms), max_ms);
+        }
+    }
+
+    // Starts the schedule clock: every slave is due immediately and the
+    // throughput counters are measured from here.
+    void start() {
+        started = std::chrono::steady_clock::now();
+        started_ns = clock_ns(CLOCK_MONOTONIC);
+        for (auto &s : slaves) {
+            s.deadline_ns = started_ns;
+            s.next_due_ns = started_ns;
+        }
+    }
+
+    // Picks the slave whose deadline is earliest. Scanning starts after the
+    // slave polled last, so equal deadlines rotate instead of starving.
+    size_t next_slave() const {
+        size_t best = (last_polled + 1) % slaves.size();
+        for (size_t i = 1; i <= slaves.size(); i++) {
+            size_t idx = (last_polled + i) % slaves.size();
+            if (slaves[idx].next_due_ns < slaves[best].next_due_ns) {
+                best = idx;
+            }
+        }
+        return best;
+    }
+
+    // Waits for the next due slave, polls it and calls on_sample(acquired).
+    // Runs on the acquisition thread: it talks Modbus and nothing else.
+    // Returns without polling once `running` is cleared.
+    template <typename Callback>
+    void poll_once(Callback on_sample) {
+        size_t idx = next_slave();
+        SlaveChannel &s = slaves[idx];
+        if (!sleep_until_ns(s.next_due_ns, &running)) return;
+
+        AcquiredSample acquired;
+        const ReadPlan &read_plan = active_plan();
+        int64_t block_ns[FIELD_COUNT];
+        size_t first_block = s.resume_block;
+        modbus_set_slave(ctx, s.slave_id);
+        acquired.request_ns = begin_poll(idx);
+        int failed_block = read_sensor_sample(ctx, read_plan, s.partial, block_ns, first_block);
+        acquired.error = errno;
+        finish_poll(idx, read_plan, block_ns, first_block, failed_block, acquired);
+        on_sample(acquired);
+    }
+
+    // The two halves of a poll, shared with the event-driven transport
+    // (rtu_event_loop.h). begin_poll returns the request time.
+    int64_t begin_poll(size_t idx) {
+        const SlaveChannel &s = slaves[idx];
+        int64_t request_ns = clock_ns(CLOCK_MONOTONIC);
+        if (metrics != NULL && s.period_ms > 0 && s.retries == 0) {
+            metrics->poll_lateness.observe_ns(std::max<int64_t>(request_ns - s.deadline_ns, 0));
+        }
+        return request_ns;
+    }
+
+    // Once the blocks are in s.partial or one failed (failed_block, with
+    // acquired.request_ns and acquired.error set): counters, metrics and the
+    // next deadline. Fills in the rest of `acquired`.
+    void finish_poll(size_t idx, const ReadPlan &read_plan, const int64_t *block_ns, size_t first_block,
+                     int failed_block, AcquiredSample &acquired) {
+        SlaveChannel &s = slaves[idx];
+        acquired.monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+        if (metrics != NULL) {
+            metrics->record_poll(read_plan, block_ns, first_block, failed_block, acquired.error,
+                                 acquired.monotonic_ns - acquired.request_ns);
+        }
+        acquired.realtime_ns = clock_ns(CLOCK_REALTIME);
+        acquired.slave_index = (uint32_t)idx;
+        acquired.ok = (failed_block == -1);
+        acquired.sample = s.partial;
+        last_polled = idx;
+
+        if (acquired.ok) {
+            s.samples++;
+            adapt_period(s);
+        } else {
+            s.failures++;
+        }
+        schedule_next(s, failed_block, acquired.monotonic_ns);
+    }
+
+    // ===========================
+    // DEADLINES
+    // ===========================
+    // Deadlines sit on a fixed grid (start + n * period), so a late poll
+    // never shifts the ones after it. A failed poll is retried inside its
+    // period when there is time left; otherwise the slave moves on to the
+    // next grid slot. Slots that are already over when we get there (the bus
+    // is saturated or a timeout ate them) are counted as missed and skipped
+    // instead of being polled in a burst.
+    void schedule_next(SlaveChannel &s, int failed_block, int64_t now_ns) {
+        int64_t period_ns = (int64_t)(s.period_ms * 1e6);
+
+        if (failed_block != -1 && s.retries < POLL_RETRIES_PER_PERIOD
+            && (period_ns == 0 || now_ns + POLL_RETRY_DELAY_NS < s.deadline_ns + period_ns)) {
+            s.retries++;
+            s.resume_block = (size_t)failed_block;
+            s.next_due_ns = now_ns + POLL_RETRY_DELAY_NS;
+            return;
+        }
+        s.retries = 0;
+        s.resume_block = 0;
+
+        if (period_ns == 0) {
+            s.deadline_ns = now_ns;
+            s.next_due_ns = now_ns;
+            return;
+        }
+        s.deadline_ns += period_ns;
+        if (now_ns >= s.deadline_ns + period_ns) {
+            int64_t missed = (now_ns - s.deadline_ns) / period_ns;
+            s.missed_deadlines += (long)missed;
+            s.deadline_ns += missed * period_ns;
+        }
+        s.next_due_ns = s.deadline_ns;
+    }
+
+    // Adaptive mode: compares the new sample with the previous one and
+    // scales the period so the next poll sees about ADAPTIVE_TARGET_STEPS
+    // steps of temperature or EC change. The period never drops below the
+    // bus time of the read plan: a faster schedule would only miss deadlines.
+    void adapt_period(SlaveChannel &s) {
+        double temp = s.partial.value[FIELD_TEMPERATURE];
+        double ec = s.partial.value[FIELD_RAW_EC];
+        if (!std::isfinite(temp) || !std::isfinite(ec)) return;
+
+        if (s.max_period_ms > 0 && s.has_previous) {
+            double ec_step = std::max(std::fabs(s.previous_ec) * ADAPTIVE_EC_STEP, 1e-6);
+            double steps = std::max(std::fabs(temp - s.previous_temp) / ADAPTIVE_TEMP_STEP,
+                                    std::fabs(ec - s.previous_ec) / ec_step);
+            double factor = steps > 0 ? ADAPTIVE_TARGET_STEPS / steps : ADAPTIVE_MAX_FACTOR;
+            factor = std::min(std::max(factor, ADAPTIVE_MIN_FACTOR), ADAPTIVE_MAX_FACTOR);
+            double floor_ms = std::max(s.min_period_ms, active_plan().bus_time_ms() * slaves.size());
+            s.period_ms = std::min(std::max(s.period_ms * factor, floor_ms), s.max_period_ms);
+        }
+        s.previous_temp = temp;
+        s.previous_ec = ec;
+        s.has_previous = true;
+    }
+
+    // ===========================
+    // THROUGHPUT REPORTING
+    // ===========================
+    // Theoretical limit of the whole bus: back-to-back read plans.
+    double bus_limit_sps() const {
+        return 1000.0 / active_plan().bus_time_ms();
+    }
+
+    // What one slave could get if every slave wanted the bus at full speed.
+    double fair_share_sps() const {
+        return bus_limit_sps() / slaves.size();
+    }
+
+    double requested_sps(const SlaveChannel &s) const {
+        return s.period_ms > 0 ? 1000.0 / s.period_ms : bus_limit_sps();
+    }
+
+    double achieved_sps(const SlaveChannel &s) const {
+        double elapsed_s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - started).count();
+        return elapsed_s > 0 ? s.samples / elapsed_s : 0.0;
+    }
+
+    double bus_utilization() const {
+        double total = 0.0;
+        for (const auto &s : slaves) {
+            total += achieved_sps(s);
+        }
+        return total / bus_limit_sps();
+    }
+};
+
+#endif // BUS_SCHEDULER_H
@@ -0,0 +1,346 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include "compensation.h"
+#include "seqlock.h"
+
+// ===========================
+// ONLINE COEFFICIENT FITTER
+// ===========================
+// Refits the temperature coefficient of every band of the coefficient table
+// while logging, instead of exporting the CSV and fitting offline.
+//
+// With the probe in the 12.88 mS/cm standard, the sensor sees
+//
+//   raw_ec = 12.88 * (1 + k * (temp - 25))
+//
+// so each sample is one point of y = k * x with x = 12.88 * (temp - 25) and
+// y = raw_ec - 12.88. Per band we keep n, Σx², Σxy and Σy² (O(1) per sample)
+// and solve the least-squares line through the origin: k = Σxy / Σx². The
+// standard error of k says how far the fit can be trusted.
+//
+// Bands are the rows of the table in use: row i covers the temperatures
+// lookup_k() maps to it in step mode. In linear mode row i is breakpoint i,
+// and a sample between two breakpoints depends on both of them, so all
+// breakpoints are fitted jointly instead (see HatBasisFit).
+const double CALIBRATION_STANDARD_EC = 12.88;   // mS/cm @ 25 °C, as on the dashboard
+const double CALIBRATION_MIN_LEVER_C = 0.5;     // Samples this close to 25 °C say nothing about k
+const double CALIBRATION_K_MIN = 0.0;           // Implied k outside this range: probe is not
+const double CALIBRATION_K_MAX = 0.05;          // in the standard (rinsing, air, other solution)
+const uint64_t CALIBRATION_MIN_SAMPLES = 50;    // Per band, before a fit counts as confident
+const double CALIBRATION_MAX_STD_ERROR = 0.0002;    // k units (0.02 %/°C)
+const double CALIBRATION_MIN_CHANGE = 0.00005;      // Smaller moves are not worth a table swap
+const int CALIBRATION_PUBLISH_INTERVAL_S = 10;
+
+struct BandFit {
+    uint64_t n = 0;
+    double sxx = 0.0;
+    double sxy = 0.0;
+    double syy = 0.0;
+
+    void add(double x, double y) {
+        n++;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+    }
+
+    double k() const {
+        return sxx > 0.0 ? sxy / sxx : NAN;
+    }
+
+    // sqrt(residual variance / Σx²)
+    double std_error() const {
+        if (n < 2 || sxx <= 0.0) return INFINITY;
+        double rss = std::fmax(syy - sxy * sxy / sxx, 0.0);
+        return std::sqrt(rss / (double)(n - 1) / sxx);
+    }
+};
+
+// Linear mode: between breakpoints i and i+1, k = k_i * (1 - w) + k_i+1 * w
+// with w the position of temp between them, so a sample is one point of
+//
+//   y = k_i * z_i + k_i+1 * z_i+1,   z_i = x * (1 - w), z_i+1 = x * w
+//
+// (below the first and above the last breakpoint only that one counts).
+// The normal equations A k = b of this regression are tridiagonal, so the
+// sums are still O(1) per sample; solve() works on them at publish time.
+struct HatBasisFit {
+    uint64_t n = 0;
+    uint64_t samples[COEFF_TABLE_MAX] = {};     // Samples that depend on breakpoint i
+    double diag[COEFF_TABLE_MAX] = {};          // Σ z_i²
+    double upper[COEFF_TABLE_MAX] = {};         // Σ z_i * z_i+1
+    double rhs[COEFF_TABLE_MAX] = {};           // Σ z_i * y
+    double syy = 0.0;
+
+    void add(const CoefficientTable &table, double temp, double x, double y) {
+        int last = table.size - 1;
+        int i = 0;
+        double w = 0.0;
+        if (temp >= table.temp[last]) {
+            i = last;
+        } else if (temp > table.temp[0]) {
+            while (temp > table.temp[i + 1]) i++;
+            w = (temp - table.temp[i]) / (table.temp[i + 1] - table.temp[i]);
+        }
+
+        double zi = x * (1.0 - w);
+        n++;
+        samples[i]++;
+        diag[i] += zi * zi;
+        rhs[i] += zi * y;
+        syy += y * y;
+        if (w > 0.0) {
+            double zj = x * w;
+            samples[i + 1]++;
+            diag[i + 1] += zj * zj;
+            upper[i] += zi * zj;
+            rhs[i + 1] += zj * y;
+        }
+    }
+
+    // Least-squares k of every breakpoint with data, and its standard error
+    // sqrt(residual variance * (A^-1)_ii). Breakpoints without data, or that
+    // the data cannot tell apart from a neighbour (all samples at one
+    // temperature), keep `current`'s k and get NaN / infinity.
+    void solve(const CoefficientTable &current, double *k, double *std_error) const {
+        int size = current.size;
+        bool free[COEFF_TABLE_MAX];
+        for (int i = 0; i < size; i++) {
+            free[i] = samples[i] > 0 && diag[i] > 0.0;
+        }
+
+        double inverse[COEFF_TABLE_MAX][COEFF_TABLE_MAX];
+        int m = 0;
+        while (!invert_free(current, free, k, inverse, m)) {}
+
+        // Residuals of the whole model, fixed breakpoints included
+        double rss = syy;
+        for (int i = 0; i < size; i++) {
+            rss += k[i] * (k[i] * diag[i] - 2.0 * rhs[i]);
+            if (i + 1 < size) rss += 2.0 * k[i] * upper[i] * k[i + 1];
+        }
+        double variance = n > (uint64_t)m ? std::fmax(rss, 0.0) / (double)(n - m) : INFINITY;
+
+        for (int i = 0, f = 0; i < size; i++) {
+            if (free[i]) {
+                std_error[i] = std::sqrt(variance * inverse[f][f]);
+                f++;
+            } else {
+                k[i] = NAN;
+                std_error[i] = INFINITY;
+            }
+        }
+    }
+
+private:
+    // Gauss-Jordan on the free breakpoints (at most COEFF_TABLE_MAX, every
+    // few seconds). Fixed neighbours move to the right-hand side with the
+    // current table's k. Returns false after fixing a breakpoint whose
+    // pivot vanished, so the caller retries without it.
+    bool invert_free(const CoefficientTable &current, bool *free, double *k,
+                     double (&inverse)[COEFF_TABLE_MAX][COEFF_TABLE_MAX], int &m) const {
+        int size = current.size;
+        int index[COEFF_TABLE_MAX];
+        m = 0;
+        for (int i = 0; i < size; i++) {
+            k[i] = current.k[i];
+            if (free[i]) index[m++] = i;
+        }
+
+        double a[COEFF_TABLE_MAX][COEFF_TABLE_MAX];
+        double b[COEFF_TABLE_MAX];
+        for (int r = 0; r < m; r++) {
+            int i = index[r];
+            b[r] = rhs[i];
+            if (i > 0 && !free[i - 1]) b[r] -= upper[i - 1] * current.k[i - 1];
+            if (i + 1 < size && !free[i + 1]) b[r] -= upper[i] * current.k[i + 1];
+            for (int c = 0; c < m; c++) {
+                int j = index[c];
+                a[r][c] = j == i ? diag[i] : j == i + 1 ? upper[i] : j == i - 1 ? upper[j] : 0.0;
+                inverse[r][c] = r == c ? 1.0 : 0.0;
+            }
+        }
+
+        // A is symmetric positive semi-definite: no pivoting needed, and a
+        // vanishing pivot means that breakpoint is not determined
+        for (int p = 0; p < m; p++) {
+            if (!(a[p][p] > 1e-12 * diag[index[p]])) {
+                free[index[p]] = false;
+                return false;
+            }
+            double scale = 1.0 / a[p][p];
+            for (int c = 0; c < m; c++) {
+                a[p][c] *= scale;
+                inverse[p][c] *= scale;
+            }
+            b[p] *= scale;
+            for (int r = 0; r < m; r++) {
+                if (r == p || a[r][p] == 0.0) continue;
+                double factor = a[r][p];
+                for (int c = 0; c < m; c++) {
+                    a[r][c] -= factor * a[p][c];
+                    inverse[r][c] -= factor * inverse[p][c];
+                }
+                b[r] -= factor * b[p];
+            }
+        }
+        for (int r = 0; r < m; r++) {
+            k[index[r]] = b[r];
+        }
+        return true;
+    }
+};
+
+// Snapshot handed to the compensation path, the dashboard and the stats
+// endpoint. Trivially copyable, so it can travel through a Seqlock.
+struct CalibrationCandidate {
+    CoefficientTable table;                 // Table in use, confident bands refitted
+    double fitted_k[COEFF_TABLE_MAX];       // NaN for bands without data
+    double std_error[COEFF_TABLE_MAX];
+    uint64_t samples[COEFF_TABLE_MAX];
+    bool confident[COEFF_TABLE_MAX];
+    int confident_bands;
+    uint64_t rejected;                      // Samples that did not look like the standard
+};
+
+// Row of `table` that lookup_k() uses in step mode
+inline int coefficient_band(const CoefficientTable &table, double temp) {
+    int last = table.size - 1;
+    for (int i = 0; i < last; i++) {
+        if (temp <= table.temp[i]) return i;
+    }
+    return last;
+}
+
+// "<=5", "10-15", ">30" (°C). The buffer version does not allocate (dashboard).
+const size_t COEFF_BAND_LABEL_CHARS = 32;
+
+inline const char *coefficient_band_label(const CoefficientTable &table, int band,
+                                          char (&label)[COEFF_BAND_LABEL_CHARS]) {
+    if (band == 0) {
+        snprintf(label, sizeof(label), "<=%g", table.temp[0]);
+    } else if (band == table.size - 1 && table.mode == COEFF_STEP) {
+        snprintf(label, sizeof(label), ">%g", table.temp[band - 1]);
+    } else {
+        snprintf(label, sizeof(label), "%g-%g", table.temp[band - 1], table.temp[band]);
+    }
+    return label;
+}
+
+inline std::string coefficient_band_label(const CoefficientTable &table, int band) {
+    char label[COEFF_BAND_LABEL_CHARS];
+    return coefficient_band_label(table, band, label);
+}
+
+class CoefficientFitter {
+public:
+    std::string path;                       // Where publish() writes the candidate table
+    Seqlock<CalibrationCandidate> published;
+
+    // Starts over with the bands of `table`
+    void reset(const CoefficientTable &table) {
+        bands_ = table;
+        for (auto &fit : fits_) {
+            fit = BandFit();
+        }
+        hat_ = HatBasisFit();
+        rejected_ = 0;
+    }
+
+    void add(double temp, double raw_ec) {
+        double dt = temp - 25.0;
+        if (!std::isfinite(dt) || !std::isfinite(raw_ec) || std::fabs(dt) < CALIBRATION_MIN_LEVER_C) return;
+
+        double x = CALIBRATION_STANDARD_EC * dt;
+        double y = raw_ec - CALIBRATION_STANDARD_EC;
+        double implied_k = y / x;
+        if (implied_k < CALIBRATION_K_MIN || implied_k > CALIBRATION_K_MAX) {
+            rejected_++;
+            return;
+        }
+        if (bands_.mode == COEFF_LINEAR) {
+            hat_.add(bands_, temp, x, y);
+        } else {
+            fits_[coefficient_band(bands_, temp)].add(x, y);
+        }
+    }
+
+    // `current` with every confident band replaced by its fit
+    CalibrationCandidate candidate(const CoefficientTable &current) const {
+        CalibrationCandidate c;
+        c.table = current;
+        c.confident_bands = 0;
+        c.rejected = rejected_;
+        bool linear = bands_.mode == COEFF_LINEAR;
+        if (linear) {
+            hat_.solve(current, c.fitted_k, c.std_error);
+        }
+        for (int i = 0; i < COEFF_TABLE_MAX; i++) {
+            if (!linear) {
+                c.fitted_k[i] = fits_[i].k();
+                c.std_error[i] = fits_[i].std_error();
+            } else if (i >= current.size) {
+                c.fitted_k[i] = NAN;
+                c.std_error[i] = INFINITY;
+            }
+            c.samples[i] = linear ? hat_.samples[i] : fits_[i].n;
+            c.confident[i] = i < bands_.size && c.samples[i] >= CALIBRATION_MIN_SAMPLES
+                             && c.std_error[i] <= CALIBRATION_MAX_STD_ERROR;
+            if (c.confident[i] && i < current.size) {
+                c.table.k[i] = c.fitted_k[i];
+                c.confident_bands++;
+            }
+        }
+        return c;
+    }
+
+    // Stores the candidate for the other threads and rewrites `path` (if
+    // set) in the --coeff-table format, so it can be reviewed and reused.
+    CalibrationCandidate publish(const CoefficientTable &current, int slave_id) {
+        CalibrationCandidate c = candidate(current);
+        published.store(c);
+        if (!path.empty()) {
+            write_candidate(c, slave_id);
+        }
+        return c;
+    }
+
+private:
+    CoefficientTable bands_ = DEFAULT_COEFFICIENT_TABLE;
+    BandFit fits_[COEFF_TABLE_MAX];
+    HatBasisFit hat_;
+    uint64_t rejected_ = 0;
+
+    void write_candidate(const CalibrationCandidate &c, int slave_id) const {
+        char tmp_path[PATH_MAX];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path.c_str());
+        FILE *file = fopen(tmp_path, "w");
+        if (file == NULL) return;
+
+        time_t now = time(NULL);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(file, "# Candidate coefficient table, fitted online against %.2f mS/cm\n", CALIBRATION_STANDARD_EC);
+        fprintf(file, "# Slave %d, %s, %d of %d bands confident, %llu samples rejected\n", slave_id, stamp,
+                c.confident_bands, c.table.size, (unsigned long long)c.rejected);
+        fprintf(file, "# Bands that are not confident keep the current k. Load with --coeff-table.\n");
+        fprintf(file, "mode %s\n", c.table.mode == COEFF_LINEAR ? "linear" : "step");
+        char label[COEFF_BAND_LABEL_CHARS];
+        for (int i = 0; i < c.table.size; i++) {
+            fprintf(file, "%-6g %.6f   # %-6s fit %.6f ± %.6f, n=%llu%s\n", c.table.temp[i], c.table.k[i],
+                    coefficient_band_label(c.table, i, label), c.fitted_k[i], c.std_error[i],
+                    (unsigned long long)c.samples[i], c.confident[i] ? ", confident" : "");
+        }
+        fclose(file);
+        rename(tmp_path, path.c_str());
+    }
+};
+
+#endif // CALIBRATION_H
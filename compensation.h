@@ -0,0 +1,286 @@
+#ifndef COMPENSATION_H
+#define COMPENSATION_H
+
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EC_COMPENSATION_X86 1
+#endif
+
+// ===========================
+// DYNAMIC COEFFICIENT LOOKUP
+// ===========================
+// Reference implementation. The batch engine below must reproduce it bit
+// for bit in step mode with DEFAULT_COEFFICIENT_TABLE.
+inline double get_dynamic_k(double temp) {
+    if (temp <= 5.0) {
+        return 0.0180;  // 1.80%
+    } else if (temp <= 10.0) {
+        return 0.0184;  // 1.84%
+    } else if (temp <= 15.0) {
+        return 0.0190;  // 1.90%
+    } else if (temp <= 25.0) {
+        return 0.0190;  // 1.90% (flat range)
+    } else if (temp <= 30.0) {
+        return 0.0192;  // 1.92%
+    } else {
+        return 0.0194;  // 1.94%
+    }
+}
+
+// ===========================
+// SMART ALGORITHM
+// ===========================
+inline double calculate_smart_ec(double raw_ec, double temp) {
+    double k = get_dynamic_k(temp);
+    // C25 = raw_ec / (1 + k * (temp - 25))
+    return raw_ec / (1.0 + k * (temp - 25.0));
+}
+
+// ===========================
+// COEFFICIENT TABLE
+// ===========================
+// Row i holds a breakpoint temperature and a coefficient.
+//
+// STEP mode:   k = k[i] for the first row with temp <= temp[i]. The last row
+//              catches everything above the previous breakpoint (and NaN),
+//              exactly like the else branch of get_dynamic_k().
+// LINEAR mode: k is interpolated between (temp[i], k[i]) and
+//              (temp[i+1], k[i+1]) and clamped outside the first/last row,
+//              so k no longer jumps at the band edges.
+const int COEFF_TABLE_MAX = 16;
+
+enum CoefficientMode {
+    COEFF_STEP = 0,
+    COEFF_LINEAR
+};
+
+struct CoefficientTable {
+    int size;
+    CoefficientMode mode;
+    double temp[COEFF_TABLE_MAX];
+    double k[COEFF_TABLE_MAX];
+};
+
+// Same bands as get_dynamic_k(). The last breakpoint (35 °C) only matters in
+// LINEAR mode, where it anchors the 1.94% end of the ramp.
+constexpr CoefficientTable DEFAULT_COEFFICIENT_TABLE = {
+    6, COEFF_STEP,
+    {5.0, 10.0, 15.0, 25.0, 30.0, 35.0},
+    {0.0180, 0.0184, 0.0190, 0.0190, 0.0192, 0.0194},
+};
+
+// Loads a table from a text file:
+//
+//   # comment
+//   mode linear          (optional, default step)
+//   5.0   0.0180         (breakpoint temperature, coefficient; ascending)
+//   10.0  0.0184
+//   ...
+inline bool load_coefficient_table(const std::string &path, CoefficientTable &table) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "❌ Cannot open coefficient table " << path << std::endl;
+        return false;
+    }
+
+    CoefficientTable loaded = {0, COEFF_STEP, {}, {}};
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(file, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first)) continue;  // Blank or comment-only line
+
+        if (first == "mode") {
+            std::string mode;
+            fields >> mode;
+            if (mode != "step" && mode != "linear") {
+                std::cerr << "❌ " << path << ":" << line_number << ": unknown mode " << mode << std::endl;
+                return false;
+            }
+            loaded.mode = (mode == "linear") ? COEFF_LINEAR : COEFF_STEP;
+            continue;
+        }
+
+        double temp, k;
+        std::istringstream row(line);
+        if (!(row >> temp >> k) || loaded.size == COEFF_TABLE_MAX
+            || (loaded.size > 0 && temp <= loaded.temp[loaded.size - 1])) {
+            std::cerr << "❌ " << path << ":" << line_number
+                      << ": expected '<temp> <k>' with ascending temperatures (max "
+                      << COEFF_TABLE_MAX << " rows)" << std::endl;
+            return false;
+        }
+        loaded.temp[loaded.size] = temp;
+        loaded.k[loaded.size] = k;
+        loaded.size++;
+    }
+
+    if (loaded.size == 0) {
+        std::cerr << "❌ " << path << ": no coefficient rows" << std::endl;
+        return false;
+    }
+    table = loaded;
+    return true;
+}
+
+// ===========================
+// SCALAR TABLE LOOKUP
+// ===========================
+inline double lookup_k(const CoefficientTable &table, double temp) {
+    int last = table.size - 1;
+
+    if (table.mode == COEFF_STEP) {
+        for (int i = 0; i < last; i++) {
+            if (temp <= table.temp[i]) return table.k[i];
+        }
+        return table.k[last];
+    }
+
+    if (!(temp > table.temp[0])) return table.k[0];
+    if (temp >= table.temp[last]) return table.k[last];
+
+    int i = 0;
+    while (temp > table.temp[i + 1]) i++;
+    double slope = (table.k[i + 1] - table.k[i]) / (table.temp[i + 1] - table.temp[i]);
+    return table.k[i] + (temp - table.temp[i]) * slope;
+}
+
+inline double compensate_ec(const CoefficientTable &table, double raw_ec, double temp) {
+    double k = lookup_k(table, temp);
+    return raw_ec / (1.0 + k * (temp - 25.0));
+}
+
+// ===========================
+// BATCH COMPENSATION ENGINE
+// ===========================
+// Compensates n (raw_ec, temp) pairs in one call. k_out is optional.
+//
+// Dispatch at runtime: AVX2 (4 lanes) or SSE2 (2 lanes) on x86, plain scalar
+// elsewhere (ARM gateways) and for the tail. Every path evaluates
+//   raw / (1 + k * (temp - 25))
+// with the same operations in the same order, so STEP mode matches
+// calculate_smart_ec() bit for bit. Keep FMA contraction off when building
+// with -march=native (-ffp-contract=off), otherwise the compiler may fuse
+// the scalar reference but not the intrinsics.
+inline void compensate_batch_scalar(const CoefficientTable &table, const double *raw_ec,
+                                    const double *temp, double *out, double *k_out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        double k = lookup_k(table, temp[i]);
+        out[i] = raw_ec[i] / (1.0 + k * (temp[i] - 25.0));
+        if (k_out != NULL) k_out[i] = k;
+    }
+}
+
+#ifdef EC_COMPENSATION_X86
+__attribute__((target("avx2")))
+inline void compensate_batch_avx2(const CoefficientTable &table, const double *raw_ec,
+                                  const double *temp, double *out, double *k_out, size_t n) {
+    const int last = table.size - 1;
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d twenty_five = _mm256_set1_pd(25.0);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d t = _mm256_loadu_pd(temp + i);
+        __m256d k;
+
+        if (table.mode == COEFF_STEP) {
+            // Walk the bands from the top down so the first matching row wins
+            k = _mm256_set1_pd(table.k[last]);
+            for (int r = last - 1; r >= 0; r--) {
+                __m256d hit = _mm256_cmp_pd(t, _mm256_set1_pd(table.temp[r]), _CMP_LE_OQ);
+                k = _mm256_blendv_pd(k, _mm256_set1_pd(table.k[r]), hit);
+            }
+        } else {
+            // Pick the segment per lane, then k = k0 + (t - t0) * slope
+            __m256d t0 = _mm256_set1_pd(table.temp[0]);
+            __m256d k0 = _mm256_set1_pd(table.k[0]);
+            __m256d slope = _mm256_setzero_pd();
+            for (int r = 0; r < last; r++) {
+                __m256d above = _mm256_cmp_pd(t, _mm256_set1_pd(table.temp[r]), _CMP_GT_OQ);
+                double s = (table.k[r + 1] - table.k[r]) / (table.temp[r + 1] - table.temp[r]);
+                t0 = _mm256_blendv_pd(t0, _mm256_set1_pd(table.temp[r]), above);
+                k0 = _mm256_blendv_pd(k0, _mm256_set1_pd(table.k[r]), above);
+                slope = _mm256_blendv_pd(slope, _mm256_set1_pd(s), above);
+            }
+            k = _mm256_add_pd(k0, _mm256_mul_pd(_mm256_sub_pd(t, t0), slope));
+            __m256d bottom = _mm256_cmp_pd(t, _mm256_set1_pd(table.temp[0]), _CMP_NGT_UQ);  // incl. NaN
+            k = _mm256_blendv_pd(k, _mm256_set1_pd(table.k[0]), bottom);
+            __m256d top = _mm256_cmp_pd(t, _mm256_set1_pd(table.temp[last]), _CMP_GE_OQ);
+            k = _mm256_blendv_pd(k, _mm256_set1_pd(table.k[last]), top);
+        }
+
+        __m256d denom = _mm256_add_pd(one, _mm256_mul_pd(k, _mm256_sub_pd(t, twenty_five)));
+        _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_loadu_pd(raw_ec + i), denom));
+        if (k_out != NULL) _mm256_storeu_pd(k_out + i, k);
+    }
+
+    compensate_batch_scalar(table, raw_ec + i, temp + i, out + i,
+                            k_out != NULL ? k_out + i : NULL, n - i);
+}
+
+inline void compensate_batch_sse2(const CoefficientTable &table, const double *raw_ec,
+                                  const double *temp, double *out, double *k_out, size_t n) {
+    if (table.mode != COEFF_STEP) {
+        compensate_batch_scalar(table, raw_ec, temp, out, k_out, n);
+        return;
+    }
+
+    const int last = table.size - 1;
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d twenty_five = _mm_set1_pd(25.0);
+    size_t i = 0;
+
+    for (; i + 2 <= n; i += 2) {
+        __m128d t = _mm_loadu_pd(temp + i);
+        __m128d k = _mm_set1_pd(table.k[last]);
+        for (int r = last - 1; r >= 0; r--) {
+            // SSE2 has no blendv: k = (hit & k_r) | (~hit & k)
+            __m128d hit = _mm_cmple_pd(t, _mm_set1_pd(table.temp[r]));
+            k = _mm_or_pd(_mm_and_pd(hit, _mm_set1_pd(table.k[r])), _mm_andnot_pd(hit, k));
+        }
+        __m128d denom = _mm_add_pd(one, _mm_mul_pd(k, _mm_sub_pd(t, twenty_five)));
+        _mm_storeu_pd(out + i, _mm_div_pd(_mm_loadu_pd(raw_ec + i), denom));
+        if (k_out != NULL) _mm_storeu_pd(k_out + i, k);
+    }
+
+    compensate_batch_scalar(table, raw_ec + i, temp + i, out + i,
+                            k_out != NULL ? k_out + i : NULL, n - i);
+}
+#endif
+
+inline const char *compensation_engine_name() {
+#ifdef EC_COMPENSATION_X86
+    if (__builtin_cpu_supports("avx2")) return "AVX2";
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+inline void compensate_batch(const CoefficientTable &table, const double *raw_ec,
+                             const double *temp, double *out, size_t n, double *k_out = NULL) {
+#ifdef EC_COMPENSATION_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        compensate_batch_avx2(table, raw_ec, temp, out, k_out, n);
+    } else {
+        compensate_batch_sse2(table, raw_ec, temp, out, k_out, n);
+    }
+#else
+    compensate_batch_scalar(table, raw_ec, temp, out, k_out, n);
+#endif
+}
+
+#endif // COMPENSATION_H
@@ -0,0 +1,296 @@
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <cmath>
+#include <ctime>
+#include <deque>
+#include <string>
+#include "compensation.h"
+#include "sensor_registers.h"
+#include "bus_scheduler.h"
+#include "calibration.h"
+#include "sample_filter.h"
+#include "term_renderer.h"
+#include "fast_format.h"
+#include "output_stages.h"
+
+// ===========================
+// DASHBOARD CLOCK
+// ===========================
+// Hex strings, CSV rows and timestamps are formatted into fixed buffers
+// (fast_format.h), so the output thread does not allocate per sample.
+inline TimestampCache display_clock;    // Output thread only
+
+// ===========================
+// TEACHER MODE: GET TEMPERATURE CONDITION
+// ===========================
+inline const char *get_temp_condition(double temp) {
+    if (temp <= 5.0) {
+        return "Very Cold Range (≤5°C)";
+    } else if (temp <= 10.0) {
+        return "Cold Range (5-10°C)";
+    } else if (temp <= 15.0) {
+        return "Cool Range (10-15°C)";
+    } else if (temp <= 25.0) {
+        return "Normal Range (15-25°C)";
+    } else {
+        return "Warm Range (>25°C)";
+    }
+}
+
+// ===========================
+// TEACHER MODE: DISPLAY EDUCATIONAL DASHBOARD
+// ===========================
+// Builds the frame into the renderer; only changed lines reach the terminal.
+inline void display_teacher_dashboard(TermRenderer &screen, double temp, double raw_ec, double sensor_ec,
+                                      double smart_ec, double k_used, long sample_count,
+                                      const std::string &port, const char *hex_temp,
+                                      const char *hex_raw_ec, const std::string &log_path) {
+    // Calculate validation metrics
+    const double STANDARD_VALUE = 12.88;
+    double sensor_error = fabs(sensor_ec - STANDARD_VALUE);
+    double smart_error = fabs(smart_ec - STANDARD_VALUE);
+    double improvement = sensor_error - smart_error;
+    
+    // Determine pass/fail
+    const double TOLERANCE = 0.10;  // ±0.10 mS/cm tolerance
+    bool sensor_pass = sensor_error <= TOLERANCE;
+    bool smart_pass = smart_error <= TOLERANCE;
+    
+    screen.line("╔═══════════════════════════════════════════════════════════════════════╗");
+    screen.line("║           🎓 TEACHER MODE: LIVE ALGORITHM VALIDATION 🎓              ║");
+    screen.line("╚═══════════════════════════════════════════════════════════════════════╝");
+    screen.blank();
+    
+    screen.line("  📡 Port: %s | Samples: %ld | Time: %s", port.c_str(), sample_count,
+                display_clock.format(time(NULL)));
+    screen.blank();
+    
+    // ========== SECTION A: THE "WHY" (LOGIC DISPLAY) ==========
+    screen.line("┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓");
+    screen.line("┃ 📚 SECTION A: THE \"WHY\" - Understanding the Logic                   ┃");
+    screen.line("┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛");
+    screen.blank();
+    
+    screen.line("  Current Condition:");
+    screen.line("    🌡️  Measured Temperature = %.2f°C  (0x%s)  →  %s", temp, hex_temp,
+                get_temp_condition(temp));
+    screen.blank();
+    
+    screen.line("  Decision Logic:");
+    screen.line("    🧠 Therefore, using Dynamic Coefficient k = %.4f (%.4f%%)", k_used, k_used * 100);
+    screen.line("    🔴 Sensor uses FIXED Coefficient k = 0.0200 (2.00%%) ← WRONG!");
+    screen.blank();
+    
+    screen.line("  Why This Matters:");
+    screen.line("    • At low temps, sensor OVER-compensates (k too high)");
+    screen.line("    • Our algorithm adjusts k based on actual calibration data");
+    screen.line("    • Result: More accurate readings across temperature range");
+    screen.blank();
+    
+    // ========== SECTION B: THE MATH (FORMULA VISUALIZATION) ==========
+    screen.line("┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓");
+    screen.line("┃ 🧮 SECTION B: THE MATH - Live Formula Calculation                   ┃");
+    screen.line("┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛");
+    screen.blank();
+    
+    screen.line("  Temperature Compensation Formula:");
+    screen.blank();
+    screen.line("    C₂₅ = Raw_EC / (1 + k × (Temp - 25))");
+    screen.blank();
+    
+    screen.line("  Sensor's Calculation (FIXED k=0.02):");
+    screen.line("    %.2f = %.2f / (1 + 0.0200 × (%.2f - 25.0))", sensor_ec, raw_ec, temp);
+    screen.line("    %.2f = %.2f / %.4f", sensor_ec, raw_ec, 1.0 + 0.02 * (temp - 25.0));
+    screen.blank();
+    
+    screen.line("  Smart Algorithm (DYNAMIC k=%.4f):", k_used);
+    screen.line("    %.2f = %.2f / (1 + %.4f × (%.2f - 25.0))", smart_ec, raw_ec, k_used, temp);
+    screen.line("    %.2f = %.2f / %.4f", smart_ec, raw_ec, 1.0 + k_used * (temp - 25.0));
+    screen.blank();
+    
+    // ========== SECTION C: THE VERDICT (VALIDATION) ==========
+    screen.line("┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓");
+    screen.line("┃ ⚖️  SECTION C: THE VERDICT - Validation Against Standard            ┃");
+    screen.line("┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛");
+    screen.blank();
+    
+    screen.line("  Standard Reference: 12.88 mS/cm @ 25°C");
+    screen.line("  Tolerance: ±%.4f mS/cm", TOLERANCE);
+    screen.blank();
+    
+    screen.line("  Distance from Standard:");
+    screen.line("    🔴 Sensor Error:  %8.4f mS/cm  %s", sensor_error,
+                sensor_pass ? "✅ PASS" : "❌ FAIL (exceeds tolerance)");
+    screen.line("    🟢 Smart Error:   %8.4f mS/cm  %s", smart_error,
+                smart_pass ? "✅ PASS" : "❌ FAIL (exceeds tolerance)");
+    screen.blank();
+    
+    const char *verdict = "  ➡️  No difference";
+    if (improvement > 0) {
+        verdict = "  ✅ Smart Algorithm is BETTER!";
+    } else if (improvement < 0) {
+        verdict = "  ⚠️  Sensor Default is better (rare)";
+    }
+    screen.line("  Improvement Score:");
+    screen.line("    📈 Error Reduction: %.4f mS/cm%s", improvement, verdict);
+    screen.line("    📊 Improvement: %.1f%%",
+                sensor_error > 0 ? (improvement / sensor_error * 100.0) : 0.0);
+    screen.blank();
+    
+    // ========== SUMMARY BOX ==========
+    screen.line("┌───────────────────────────────────────────────────────────────────────┐");
+    screen.line("│                         📊 QUICK SUMMARY                              │");
+    screen.line("├───────────────────────────────────────────────────────────────────────┤");
+    screen.line("│  🌡️  Temperature:     %10.2f °C  [Hex: %s]             │", temp, hex_temp);
+    screen.line("│  📊 Raw EC:           %10.2f mS/cm  [Hex: %s]             │", raw_ec, hex_raw_ec);
+    screen.line("│  🔴 Sensor Output:    %10.2f mS/cm  %s                    │", sensor_ec,
+                sensor_pass ? "✅ PASS" : "❌ FAIL");
+    screen.line("│  🟢 Smart Output:     %10.2f mS/cm  %s                    │", smart_ec,
+                smart_pass ? "✅ PASS" : "❌ FAIL");
+    screen.line("└───────────────────────────────────────────────────────────────────────┘");
+    screen.blank();
+    
+    screen.line("  💾 Logging to: %s", log_path.c_str());
+    screen.line("  ⏹️  Press Ctrl+C to stop and analyze data");
+    screen.blank();
+}
+
+// ===========================
+// MULTI-SLAVE BUS SUMMARY
+// ===========================
+// The teacher dashboard explains one sensor. With several probes on the
+// segment we show one row per slave plus the bus throughput instead, for
+// every bus (display_bus_summary() below).
+inline void display_bus_rows(TermRenderer &screen, const BusScheduler &bus) {
+    screen.line("  📡 Port: %s | Slaves: %zu | Time: %s", bus.port.c_str(), bus.slaves.size(),
+                display_clock.format(time(NULL)));
+    screen.line("  📦 Read plan: %d transaction(s), ~%.1f ms per sample",
+                bus.active_plan().transactions(), bus.active_plan().bus_time_ms());
+    screen.line("  🚌 Bus limit: %.2f samples/s | Utilization: %.1f%%",
+                bus.bus_limit_sps(), bus.bus_utilization() * 100.0);
+    screen.blank();
+    
+    screen.line("  Slave  Temp(°C)  Raw EC  Sensor EC  Smart EC   Target/s  Actual/s  Fails  Missed");
+    screen.line("  ─────  ────────  ──────  ─────────  ────────   ────────  ────────  ─────  ──────");
+    for (const auto &s : bus.slaves) {
+        double temp = s.last.value[FIELD_TEMPERATURE];
+        double raw_ec = s.last.value[FIELD_RAW_EC];
+        if (s.samples > 0) {
+            screen.line("  %5d  %8.2f  %6.2f  %9.2f  %8.2f   %8.2f  %8.2f  %5ld  %6ld",
+                        s.slave_id, temp, raw_ec, s.last.value[FIELD_SENSOR_EC],
+                        compensate_ec(s.table, raw_ec, temp), bus.requested_sps(s), bus.achieved_sps(s),
+                        s.failures.load(), s.missed_deadlines.load());
+        } else {
+            screen.line("  %5d         -       -          -         -   %8.2f  %8.2f  %5ld  %6ld",
+                        s.slave_id, bus.requested_sps(s), bus.achieved_sps(s), s.failures.load(),
+                        s.missed_deadlines.load());
+        }
+    }
+    screen.blank();
+}
+
+// ===========================
+// STATUS LINES
+// ===========================
+inline void display_schedule_status(TermRenderer &screen, const SlaveChannel &slave) {
+    if (slave.max_period_ms > 0) {
+        screen.line("  ⏱️  Schedule: every %.0f ms (adaptive %.0f-%.0f ms) | missed deadlines %ld | failed polls %ld",
+                    slave.period_ms.load(), slave.min_period_ms, slave.max_period_ms,
+                    slave.missed_deadlines.load(), slave.failures.load());
+    } else if (slave.filter) {
+        screen.line("  ⏱️  Schedule: back to back, one sample every %.0f ms | failed polls %ld",
+                    slave.filter->period_ms, slave.failures.load());
+    } else {
+        screen.line("  ⏱️  Schedule: every %.0f ms | missed deadlines %ld | failed polls %ld",
+                    slave.period_ms.load(), slave.missed_deadlines.load(), slave.failures.load());
+    }
+}
+
+inline void display_calibration_status(TermRenderer &screen, const SlaveChannel &slave, double temp) {
+    CalibrationCandidate c;
+    if (!slave.calibration->published.load(c)) return;
+    
+    int band = coefficient_band(slave.table, temp);
+    char label[COEFF_BAND_LABEL_CHARS];
+    screen.line("  🎯 Calibration: %d/%d bands confident, %llu rejected | %s°C: fit k = %.5f ± %.5f (n=%llu), in use %.5f",
+                c.confident_bands, slave.table.size, (unsigned long long)c.rejected,
+                coefficient_band_label(slave.table, band, label), c.fitted_k[band], c.std_error[band],
+                (unsigned long long)c.samples[band], slave.table.k[band]);
+}
+
+inline void display_filter_status(TermRenderer &screen, const SlaveChannel &slave) {
+    const SampleFilter &filter = *slave.filter;
+    screen.line("  🔬 Filter: %s, window %d | last sample: %d readings, %d rejected, σ %.3f °C, σ %.4f mS/cm | rejected %ld of %ld",
+                filter.mode == FILTER_MEDIAN ? "median" : "Hampel + trimmed mean", filter.window,
+                filter.last.readings, filter.last.rejected, sqrt(filter.last.variance[FIELD_TEMPERATURE]),
+                sqrt(filter.last.variance[FIELD_RAW_EC]), filter.rejected_total.load(), filter.readings_total.load());
+}
+
+inline void display_pipeline_status(TermRenderer &screen, const SampleRing &ring) {
+    screen.line("  🧵 Pipeline: queue %zu/%zu (max %zu) | samples %llu | overruns %llu | frames %ld",
+                ring.depth(), ring.capacity(), ring.high_water(),
+                (unsigned long long)ring.pushed(), (unsigned long long)ring.overruns(), screen.frames);
+}
+
+// ===========================
+// MULTI-SLAVE / MULTI-BUS SUMMARY
+// ===========================
+// One block of rows per bus; with several buses each block also shows its
+// own pipeline queue.
+inline void display_bus_summary(TermRenderer &screen, const std::deque<BusPipeline> &buses) {
+    screen.line("╔═══════════════════════════════════════════════════════════════════════╗");
+    screen.line("║              📡 MULTI-SLAVE RS485 BUS - LIVE SUMMARY 📡               ║");
+    screen.line("╚═══════════════════════════════════════════════════════════════════════╝");
+    screen.blank();
+    
+    for (const auto &p : buses) {
+        display_bus_rows(screen, p.bus);
+        if (buses.size() > 1) {
+            display_pipeline_status(screen, p.ring);
+            screen.blank();
+        }
+    }
+    
+    screen.line("  💾 Logging one file per slave (%s, ...)", buses.front().bus.slaves[0].log_path.c_str());
+    screen.line("  ⏹️  Press Ctrl+C to stop and analyze data");
+    screen.blank();
+}
+
+// Builds and writes one frame: the teacher dashboard when a single slave
+// is polled, the bus summary otherwise.
+inline void render_dashboard(TermRenderer &screen, const std::deque<BusPipeline> &buses) {
+    char hex_temp[HEX_WORD_CHARS], hex_raw_ec[HEX_WORD_CHARS];  // Raw hex strings for data validation
+    const BusScheduler &bus = buses.front().bus;
+    screen.begin_frame();
+    if (buses.size() > 1 || bus.slaves.size() > 1) {
+        display_bus_summary(screen, buses);
+    } else {
+        const AcquiredSample &newest = buses.front().stages.newest;
+        const SlaveChannel &slave = bus.slaves[newest.slave_index];
+        const SensorSample &sample = newest.sample;
+        double temp = sample.value[FIELD_TEMPERATURE];
+        double raw_ec = sample.value[FIELD_RAW_EC];
+        
+        // Capture raw hex BEFORE float conversion for validation
+        format_hex_word(hex_temp, sample.raw[FIELD_TEMPERATURE][0], sample.raw[FIELD_TEMPERATURE][1]);
+        format_hex_word(hex_raw_ec, sample.raw[FIELD_RAW_EC][0], sample.raw[FIELD_RAW_EC][1]);
+        
+        display_teacher_dashboard(screen, temp, raw_ec, sample.value[FIELD_SENSOR_EC],
+                                  compensate_ec(slave.table, raw_ec, temp), lookup_k(slave.table, temp),
+                                  slave.samples, bus.port, hex_temp, hex_raw_ec, slave.log_path);
+        display_schedule_status(screen, slave);
+        if (slave.filter) {
+            display_filter_status(screen, slave);
+        }
+        if (slave.calibration) {
+            display_calibration_status(screen, slave, temp);
+        }
+    }
+    if (buses.size() == 1) {
+        display_pipeline_status(screen, buses.front().ring);
+    }
+    screen.end_frame();
+}
+
+#endif // DASHBOARD_H
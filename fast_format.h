@@ -0,0 +1,118 @@
+#ifndef FAST_FORMAT_H
+#define FAST_FORMAT_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include "sensor_registers.h"
+
+// ===========================
+// ALLOCATION-FREE FORMATTING
+// ===========================
+// Text output of the acquisition hot path (CSV rows, dashboard fields)
+// without heap allocations: everything is written into caller-provided
+// fixed buffers, numbers go through std::to_chars and the local-time
+// timestamp is only recomputed when the minute changes.
+//
+// The output is byte for byte what the previous iostream code produced:
+// std::to_chars(..., std::chars_format::general, 6) is the "%g" format an
+// ostream uses by default.
+
+const size_t HEX_WORD_CHARS = 9;        // "41351A86" + NUL
+const size_t TIMESTAMP_CHARS = 20;      // "2026-03-01 12:34:56" + NUL
+const size_t CSV_ROW_MAX = 192;         // Longest row with six "%g" numbers is well below this
+
+// ===========================
+// HEX STRING CONVERTER (For Data Validation)
+// ===========================
+// Writes two 16-bit Modbus registers as an 8-character hex string (+ NUL).
+// This allows validation of IEEE 754 float conversion by logging the raw bytes.
+// Example: reg_high=0x4135 (16693), reg_low=0x1A86 (6790) → "41351A86"
+// You can verify this at: https://www.h-schmidt.net/FloatConverter/IEEE754.html
+inline char *format_hex_word(char *out, uint16_t reg_high, uint16_t reg_low) {
+    static const char DIGITS[] = "0123456789ABCDEF";
+    uint32_t word = ((uint32_t)reg_high << 16) | reg_low;
+    for (int i = 7; i >= 0; i--) {
+        out[i] = DIGITS[word & 0xF];
+        word >>= 4;
+    }
+    out[8] = '\0';
+    return out;
+}
+
+// "%g" with precision 6, as `std::ostream << double`. Returns the end.
+inline char *format_number(char *out, char *end, double value) {
+    std::to_chars_result result = std::to_chars(out, end, value, std::chars_format::general, 6);
+    return result.ec == std::errc() ? result.ptr : out;
+}
+
+// ===========================
+// CACHED TIMESTAMP
+// ===========================
+// "YYYY-MM-DD HH:MM:SS" in local time. localtime_r() (time zone rules, a
+// lock inside glibc) only runs when the minute changes; within the minute
+// the cached prefix is reused and only the seconds are patched in. Not
+// thread-safe: one cache per thread.
+class TimestampCache {
+public:
+    const char *format(time_t now) {
+        if (now != second_) {
+            if (now < minute_ || now >= minute_ + 60) {
+                struct tm tstruct;
+                localtime_r(&now, &tstruct);
+                strftime(text_, sizeof(text_), "%Y-%m-%d %H:%M:%S", &tstruct);
+                minute_ = now - tstruct.tm_sec;
+            } else {
+                int sec = (int)(now - minute_);
+                text_[17] = (char)('0' + sec / 10);
+                text_[18] = (char)('0' + sec % 10);
+            }
+            second_ = now;
+        }
+        return text_;
+    }
+
+private:
+    time_t second_ = -1;
+    time_t minute_ = 0;     // Start of the cached minute
+    char text_[TIMESTAMP_CHARS] = {};
+};
+
+// ===========================
+// CSV ROW
+// ===========================
+// One smart_logger CSV row (newline included) into `out`, which must hold
+// CSV_ROW_MAX bytes. Returns the number of bytes written.
+//   Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation
+inline size_t format_csv_row(char *out, TimestampCache &clock, time_t when, const SensorSample &sample,
+                             double smart_ec) {
+    char *p = out;
+    char *end = out + CSV_ROW_MAX;
+    double sensor_ec = sample.value[FIELD_SENSOR_EC];
+
+    const char *timestamp = clock.format(when);
+    size_t length = strlen(timestamp);
+    memcpy(p, timestamp, length);
+    p += length;
+    *p++ = ',';
+    p = format_number(p, end, sample.value[FIELD_TEMPERATURE]);
+    *p++ = ',';
+    format_hex_word(p, sample.raw[FIELD_TEMPERATURE][0], sample.raw[FIELD_TEMPERATURE][1]);
+    p += HEX_WORD_CHARS - 1;
+    *p++ = ',';
+    p = format_number(p, end, sample.value[FIELD_RAW_EC]);
+    *p++ = ',';
+    format_hex_word(p, sample.raw[FIELD_RAW_EC][0], sample.raw[FIELD_RAW_EC][1]);
+    p += HEX_WORD_CHARS - 1;
+    *p++ = ',';
+    p = format_number(p, end, sensor_ec);
+    *p++ = ',';
+    p = format_number(p, end, smart_ec);
+    *p++ = ',';
+    p = format_number(p, end, sensor_ec - smart_ec);
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+#endif // FAST_FORMAT_H
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <modbus.h>
+#include "sensor_registers.h"
+
+// ===========================
+// GATEWAY LOAD TEST
+// ===========================
+// Hammers a running `smart_logger --gateway-port N` with many Modbus TCP
+// clients (one libmodbus connection per thread, back-to-back reads) and
+// reports how many reads per second the gateway sustains and at what
+// latency. Watch ec_samples_total on the metrics endpoint at the same time:
+// the RS485 poll rate must not move.
+//
+// Usage: ./gateway_loadtest [HOST] [PORT] [--clients N] [--seconds S]
+//        [--unit ID] [--address A] [--count N]
+
+struct LoadTestOptions {
+    std::string host = "127.0.0.1";
+    int port = 502;
+    int clients = 8;
+    double seconds = 5.0;
+    int unit_id = 255;                  // Gateway default unit (first slave)
+    int address = 41;                   // Sensor EC .. temperature, like smart_logger
+    int count = 21;
+};
+
+struct ClientResult {
+    long reads = 0;
+    long errors = 0;
+    std::vector<double> latency_us;
+};
+
+double percentile(std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void run_client(const LoadTestOptions &options, std::atomic<bool> &stop, ClientResult &result) {
+    modbus_t *ctx = modbus_new_tcp(options.host.c_str(), options.port);
+    if (ctx == NULL || modbus_connect(ctx) == -1) {
+        std::cerr << "❌ Client cannot connect to " << options.host << ":" << options.port << ": "
+                  << modbus_strerror(errno) << std::endl;
+        if (ctx != NULL) modbus_free(ctx);
+        result.errors++;
+        return;
+    }
+    modbus_set_slave(ctx, options.unit_id);
+    modbus_set_response_timeout(ctx, 1, 0);
+
+    uint16_t regs[125];
+    result.latency_us.reserve(1 << 20);
+    while (!stop) {
+        auto start = std::chrono::steady_clock::now();
+        if (modbus_read_registers(ctx, options.address, options.count, regs) == -1) {
+            result.errors++;
+            continue;
+        }
+        result.reads++;
+        result.latency_us.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    LoadTestOptions options;
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--clients" && has_value) {
+            options.clients = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--seconds" && has_value) {
+            options.seconds = atof(argv[++i]);
+        } else if (arg == "--unit" && has_value) {
+            options.unit_id = atoi(argv[++i]);
+        } else if (arg == "--address" && has_value) {
+            options.address = atoi(argv[++i]);
+        } else if (arg == "--count" && has_value) {
+            options.count = atoi(argv[++i]);
+        } else if (arg[0] != '-' && positional == 0) {
+            options.host = arg;
+            positional++;
+        } else if (arg[0] != '-' && positional == 1) {
+            options.port = atoi(arg.c_str());
+            positional++;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [HOST] [PORT] [--clients N] [--seconds S]\n"
+                      << "       [--unit ID] [--address A] [--count N]" << std::endl;
+            return -1;
+        }
+    }
+
+    // Sanity read: show what the gateway is serving
+    modbus_t *probe = modbus_new_tcp(options.host.c_str(), options.port);
+    uint16_t regs[12];
+    if (probe == NULL || modbus_connect(probe) == -1) {
+        std::cerr << "❌ Gateway not reachable at " << options.host << ":" << options.port << std::endl;
+        return -1;
+    }
+    modbus_set_slave(probe, options.unit_id);
+    if (modbus_read_registers(probe, 100, 12, regs) == -1) {
+        std::cerr << "❌ Gateway refused the read: " << modbus_strerror(errno) << std::endl;
+        return -1;
+    }
+    std::cout << "🌐 Gateway " << options.host << ":" << options.port << " unit " << options.unit_id
+              << ": Smart EC " << std::fixed << std::setprecision(3) << decode_float_abcd(&regs[0])
+              << " mS/cm, sample #" << (((uint32_t)regs[6] << 16) | regs[7])
+              << ", " << (((uint32_t)regs[10] << 16) | regs[11]) << " ms old" << std::endl;
+    modbus_close(probe);
+    modbus_free(probe);
+
+    // Load
+    std::cout << "🔥 " << options.clients << " client(s) reading " << options.count << " registers from "
+              << options.address << " for " << std::setprecision(1) << options.seconds << " s..." << std::endl;
+
+    std::atomic<bool> stop(false);
+    std::vector<ClientResult> results(options.clients);
+    std::vector<std::thread> clients;
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < options.clients; c++) {
+        clients.emplace_back(run_client, std::cref(options), std::ref(stop), std::ref(results[c]));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    stop = true;
+    for (auto &t : clients) {
+        t.join();
+    }
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long reads = 0, errors = 0;
+    std::vector<double> latency_us;
+    for (auto &r : results) {
+        reads += r.reads;
+        errors += r.errors;
+        latency_us.insert(latency_us.end(), r.latency_us.begin(), r.latency_us.end());
+    }
+    std::sort(latency_us.begin(), latency_us.end());
+
+    std::cout << std::setprecision(0);
+    std::cout << "   Reads/s:      " << reads / elapsed_s << " (" << reads / elapsed_s / options.clients
+              << " per client)" << std::endl;
+    std::cout << std::setprecision(1);
+    std::cout << "   Latency p50:  " << percentile(latency_us, 50) << " µs" << std::endl;
+    std::cout << "   Latency p99:  " << percentile(latency_us, 99) << " µs" << std::endl;
+    std::cout << "   Latency max:  " << (latency_us.empty() ? 0.0 : latency_us.back()) << " µs" << std::endl;
+    std::cout << "   Errors:       " << errors << std::endl;
+    return errors > 0 && reads == 0 ? -1 : 0;
+}
@@ -0,0 +1,221 @@
+#ifndef LINK_TUNER_H
+#define LINK_TUNER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <modbus.h>
+#include "sensor_registers.h"
+#include "metrics.h"
+
+// ===========================
+// SERIAL LINK TUNER
+// ===========================
+// Replaces the fixed 1 s response timeout with one derived from the
+// sensor's measured round trips, and optionally moves the link to a faster
+// baud rate:
+//
+// 1. Measure: back-to-back reads of the read plan's block at the current
+//    rate, on every slave. The turnaround is the median round trip minus
+//    the modelled wire time of request and response.
+// 2. Negotiate (only with a baud register, one slave): try each faster
+//    rate, highest first. Write its code, reopen the port at that rate and
+//    require a clean measurement. A rate the sensor refuses is skipped. A
+//    rate that does not verify is undone: the old code is written at the
+//    new rate and the port is reopened at the old one.
+// 3. Timeouts: response = p99 round trip * LINK_TIMEOUT_SAFETY plus a
+//    margin, never below the slowest round trip seen. libmodbus does not
+//    expose inter-byte gaps, so the byte timeout comes from the character
+//    time, floored for USB adapters that deliver bytes in bursts.
+const int LINK_TUNE_READS = 20;
+const uint32_t LINK_MEASURE_TIMEOUT_USEC = 1000000;    // Generous while measuring
+const double LINK_TIMEOUT_SAFETY = 1.5;
+const double LINK_TIMEOUT_MARGIN_MS = 5.0;
+const double LINK_BYTE_TIMEOUT_CHARS = 20.0;
+const double LINK_MIN_BYTE_TIMEOUT_MS = 20.0;           // USB latency timers run up to 16 ms
+
+struct LinkTuneOptions {
+    int baud_register = -1;             // Holding register with the baud code, -1 = keep the rate
+    int max_baud = 115200;              // Fastest rate to try
+    int reads = LINK_TUNE_READS;        // Reads per measurement (per slave)
+};
+
+struct LinkMeasurement {
+    int baud = 0;
+    int reads = 0;
+    int failures = 0;
+    double rtt_p50_ms = 0.0;
+    double rtt_p99_ms = 0.0;
+    double rtt_max_ms = 0.0;
+    double turnaround_ms = 0.0;         // Median round trip minus the wire time
+    int last_error = 0;                 // errno of the last failed read
+};
+
+struct LinkTuneResult {
+    int baud = 0;                       // Rate the link ended up on
+    LinkMeasurement measurement;        // At that rate
+    uint32_t response_timeout_usec = 0;
+    uint32_t byte_timeout_usec = 0;
+    double max_transactions_per_s = 0.0;
+    std::vector<std::string> notes;     // One line per step, for the startup log
+};
+
+inline modbus_t *open_rtu_link(const std::string &port, int baud) {
+    modbus_t *ctx = modbus_new_rtu(port.c_str(), baud, 'N', 8, 1);
+    if (ctx == NULL) return NULL;
+
+    if (modbus_set_response_timeout(ctx, LINK_MEASURE_TIMEOUT_USEC / 1000000,
+                                    LINK_MEASURE_TIMEOUT_USEC % 1000000) == -1
+        || modbus_connect(ctx) == -1) {
+        modbus_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+inline void close_rtu_link(modbus_t *&ctx) {
+    if (ctx != NULL) {
+        modbus_close(ctx);
+        modbus_free(ctx);
+        ctx = NULL;
+    }
+}
+
+// Round trips of `reads` back-to-back reads of `block` on every slave.
+// A trial of a new rate stops at its first failure: it has failed already.
+inline void measure_link(modbus_t *ctx, int baud, const std::vector<int> &slave_ids, const ReadBlock &block,
+                         int reads, LinkMeasurement &out, bool stop_on_failure = false) {
+    uint16_t regs[MODBUS_MAX_READ_REGISTERS];
+    std::vector<double> rtt_ms;
+
+    out = LinkMeasurement();
+    out.baud = baud;
+    for (int slave_id : slave_ids) {
+        modbus_set_slave(ctx, slave_id);
+        for (int i = 0; i < reads; i++) {
+            auto start = std::chrono::steady_clock::now();
+            int rc = modbus_read_registers(ctx, block.address, block.count, regs);
+            double elapsed_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            out.reads++;
+            if (rc == -1) {
+                out.failures++;
+                out.last_error = errno;
+                if (stop_on_failure) return;
+                modbus_flush(ctx);
+                continue;
+            }
+            rtt_ms.push_back(elapsed_ms);
+        }
+    }
+    if (rtt_ms.empty()) return;
+
+    std::sort(rtt_ms.begin(), rtt_ms.end());
+    out.rtt_p50_ms = rtt_ms[(rtt_ms.size() - 1) / 2];
+    out.rtt_p99_ms = rtt_ms[(size_t)(0.99 * (rtt_ms.size() - 1) + 0.5)];
+    out.rtt_max_ms = rtt_ms.back();
+    out.turnaround_ms = std::max(0.0, out.rtt_p50_ms - rtu_read_time_ms(block.count, baud, 0.0));
+}
+
+inline std::string describe_measurement(const LinkMeasurement &m) {
+    char line[160];
+    if (m.failures == m.reads) {
+        snprintf(line, sizeof(line), "%d baud: no valid reply (%s)", m.baud, modbus_strerror(m.last_error));
+        return line;
+    }
+    snprintf(line, sizeof(line), "%d baud: round trip p50 %.1f ms, p99 %.1f ms, max %.1f ms "
+             "(turnaround %.1f ms), %d/%d failed", m.baud, m.rtt_p50_ms, m.rtt_p99_ms, m.rtt_max_ms,
+             m.turnaround_ms, m.failures, m.reads);
+    return line;
+}
+
+// Measures the link, switches to the fastest rate that verifies (when a baud
+// register is given) and derives the timeouts. Returns false if the sensor
+// does not answer at `baud`, or stops answering after a failed switch.
+inline bool tune_link(const std::string &port, const std::vector<int> &slave_ids, int baud,
+                      const ReadBlock &block, const LinkTuneOptions &options, LinkTuneResult &out) {
+    out = LinkTuneResult();
+    modbus_t *ctx = open_rtu_link(port, baud);
+    if (ctx == NULL) {
+        out.notes.push_back("Cannot open " + port + ": " + modbus_strerror(errno));
+        return false;
+    }
+
+    LinkMeasurement current;
+    measure_link(ctx, baud, slave_ids, block, options.reads, current);
+    out.notes.push_back(describe_measurement(current));
+    if (current.failures == current.reads) {
+        close_rtu_link(ctx);
+        return false;
+    }
+
+    int current_code = baud_rate_code(baud);
+    if (options.baud_register >= 0 && slave_ids.size() > 1) {
+        out.notes.push_back("Baud rate kept: switching needs a single slave on the bus");
+    } else if (options.baud_register >= 0 && current_code == -1) {
+        out.notes.push_back("Baud rate kept: " + std::to_string(baud) + " has no baud code");
+    } else if (options.baud_register >= 0) {
+        modbus_set_slave(ctx, slave_ids[0]);
+        for (int code = BAUD_RATE_CODE_COUNT - 1; code > current_code; code--) {
+            int candidate = BAUD_RATE_CODES[code];
+            if (candidate > options.max_baud) continue;
+
+            // The sensor answers at the old rate and switches afterwards. No
+            // answer at all is not proof it ignored us, so verify anyway.
+            if (modbus_write_register(ctx, options.baud_register, (uint16_t)code) == -1
+                && classify_modbus_error(errno) == ERROR_EXCEPTION) {
+                out.notes.push_back(std::to_string(candidate) + " baud: refused by the sensor");
+                continue;
+            }
+
+            close_rtu_link(ctx);
+            ctx = open_rtu_link(port, candidate);
+            LinkMeasurement trial;
+            if (ctx != NULL) {
+                measure_link(ctx, candidate, slave_ids, block, options.reads, trial, true);
+                if (trial.failures == 0) {
+                    out.notes.push_back(describe_measurement(trial) + " ✅");
+                    baud = candidate;
+                    current = trial;
+                    break;
+                }
+                out.notes.push_back(describe_measurement(trial) + ", back to " + std::to_string(baud));
+                modbus_set_slave(ctx, slave_ids[0]);
+                modbus_write_register(ctx, options.baud_register, (uint16_t)current_code);
+                close_rtu_link(ctx);
+            } else {
+                out.notes.push_back(std::to_string(candidate) + " baud: adapter refused the rate");
+            }
+
+            ctx = open_rtu_link(port, baud);
+            if (ctx == NULL) {
+                out.notes.push_back("Cannot reopen " + port + ": " + modbus_strerror(errno));
+                return false;
+            }
+            measure_link(ctx, baud, slave_ids, block, options.reads, trial);
+            if (trial.failures == trial.reads) {
+                out.notes.push_back("Sensor lost after trying " + std::to_string(candidate) + " baud");
+                close_rtu_link(ctx);
+                return false;
+            }
+            modbus_set_slave(ctx, slave_ids[0]);
+        }
+    }
+    close_rtu_link(ctx);
+
+    double response_ms = std::max(current.rtt_p99_ms * LINK_TIMEOUT_SAFETY, current.rtt_max_ms)
+                         + LINK_TIMEOUT_MARGIN_MS;
+    double byte_ms = std::max(LINK_BYTE_TIMEOUT_CHARS * rtu_char_time_ms(baud), LINK_MIN_BYTE_TIMEOUT_MS);
+    out.baud = baud;
+    out.measurement = current;
+    out.response_timeout_usec = (uint32_t)(response_ms * 1000.0);
+    out.byte_timeout_usec = (uint32_t)(byte_ms * 1000.0);
+    out.max_transactions_per_s = current.rtt_p50_ms > 0 ? 1000.0 / current.rtt_p50_ms : 0.0;
+    return true;
+}
+
+#endif // LINK_TUNER_H
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <ctime>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_log.h"
+#include "compensation.h"
+
+// ===========================
+// BINARY LOG -> CSV EXPORTER
+// ===========================
+// Converts a smart_logger binary log (ec_data_log.bin) into the exact CSV
+// columns smart_logger writes in CSV mode, so plot_data.py keeps working:
+//
+//   Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation
+//
+// Usage: ./log_export ec_data_log.bin [ec_data_log.csv] [--coeff-table FILE] [--interpolate]
+//        (writes to stdout when no CSV path is given)
+//
+// With --coeff-table and/or --interpolate, Smart_Calc_EC is recomputed from
+// the logged raw values with the batch compensation engine instead of being
+// copied from the log, so months of data can be reprocessed whenever the
+// coefficient table changes.
+
+std::string format_timestamp(int64_t realtime_ns) {
+    time_t seconds = (time_t)(realtime_ns / 1000000000LL);
+    struct tm tstruct;
+    char buf[80];
+    localtime_r(&seconds, &tstruct);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tstruct);
+    return buf;
+}
+
+std::string format_hex(const uint16_t *regs) {
+    char buf[9];
+    snprintf(buf, sizeof(buf), "%04X%04X", regs[0], regs[1]);
+    return buf;
+}
+
+const size_t EXPORT_BATCH = 4096;
+
+int main(int argc, char **argv) {
+    std::string bin_path, csv_path, table_path;
+    bool interpolate = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--coeff-table" && i + 1 < argc) {
+            table_path = argv[++i];
+        } else if (arg == "--interpolate") {
+            interpolate = true;
+        } else if (bin_path.empty()) {
+            bin_path = arg;
+        } else if (csv_path.empty()) {
+            csv_path = arg;
+        } else {
+            bin_path.clear();
+            break;
+        }
+    }
+
+    if (bin_path.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " ec_data_log.bin [ec_data_log.csv] [--coeff-table FILE] [--interpolate]" << std::endl;
+        return -1;
+    }
+
+    bool recompute = !table_path.empty() || interpolate;
+    CoefficientTable table = DEFAULT_COEFFICIENT_TABLE;
+    if (!table_path.empty() && !load_coefficient_table(table_path, table)) {
+        return -1;
+    }
+    if (interpolate) {
+        table.mode = COEFF_LINEAR;
+    }
+
+    int fd = open(bin_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        std::cerr << "❌ Cannot open " << bin_path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(BinaryLogHeader)) {
+        std::cerr << "❌ " << bin_path << " is too small to be a binary log" << std::endl;
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "❌ mmap failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    const BinaryLogHeader *header = static_cast<const BinaryLogHeader *>(map);
+    if (memcmp(header->magic, BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC)) != 0) {
+        std::cerr << "❌ " << bin_path << " is not a smart_logger binary log" << std::endl;
+        return -1;
+    }
+    if (header->version != BINARY_LOG_VERSION || header->record_size != sizeof(BinaryLogRecord)) {
+        std::cerr << "❌ Unsupported binary log version " << header->version
+                  << " (record size " << header->record_size << ")" << std::endl;
+        return -1;
+    }
+
+    std::ofstream csv_file;
+    if (!csv_path.empty()) {
+        csv_file.open(csv_path, std::ios::trunc);
+        if (!csv_file) {
+            std::cerr << "❌ Cannot write " << csv_path << std::endl;
+            return -1;
+        }
+    }
+    std::ostream &out = !csv_path.empty() ? csv_file : std::cout;
+
+    out << "Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation\n";
+
+    const BinaryLogRecord *records = reinterpret_cast<const BinaryLogRecord *>(
+        static_cast<const char *>(map) + sizeof(BinaryLogHeader));
+    size_t capacity = (st.st_size - sizeof(BinaryLogHeader)) / sizeof(BinaryLogRecord);
+
+    // Stop at the first record that was never committed (preallocated space
+    // or a write interrupted by a crash)
+    size_t committed = 0;
+    while (committed < capacity && records[committed].commit == BINARY_LOG_COMMIT) {
+        committed++;
+    }
+
+    static double raw[EXPORT_BATCH], temp[EXPORT_BATCH], smart[EXPORT_BATCH];
+
+    for (size_t start = 0; start < committed; start += EXPORT_BATCH) {
+        size_t n = std::min(EXPORT_BATCH, committed - start);
+
+        if (recompute) {
+            for (size_t i = 0; i < n; i++) {
+                raw[i] = records[start + i].value[FIELD_RAW_EC];
+                temp[i] = records[start + i].value[FIELD_TEMPERATURE];
+            }
+            compensate_batch(table, raw, temp, smart, n);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            const BinaryLogRecord &r = records[start + i];
+            double sensor_ec = r.value[FIELD_SENSOR_EC];
+            double smart_ec = recompute ? smart[i] : r.smart_ec;
+
+            out << format_timestamp(r.realtime_ns) << ","
+                << (double)r.value[FIELD_TEMPERATURE] << ","
+                << format_hex(r.raw[FIELD_TEMPERATURE]) << ","
+                << (double)r.value[FIELD_RAW_EC] << ","
+                << format_hex(r.raw[FIELD_RAW_EC]) << ","
+                << sensor_ec << ","
+                << smart_ec << ","
+                << (sensor_ec - smart_ec) << "\n";
+        }
+    }
+
+    std::cerr << "✅ Exported " << committed << " records from " << bin_path << std::endl;
+
+    munmap(map, st.st_size);
+    close(fd);
+    return 0;
+}
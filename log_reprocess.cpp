@@ -0,0 +1,496 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <modbus.h>
+#include "compensation.h"
+#include "sensor_registers.h"
+
+// ===========================
+// MULTI-CORE LOG REPROCESSOR
+// ===========================
+// Native replacement for the pandas pipeline in plot_data.py/fix_csv.py on
+// large logs:
+//
+//   1. Memory-maps ec_data_log.csv (nothing is read into the heap).
+//   2. Splits it into one line-aligned chunk per core and parses the chunks
+//      in parallel.
+//   3. Re-decodes Hex_Temp/Hex_Raw_EC with decode_float_abcd (falls back
+//      to the decimal columns for old logs without hex columns).
+//   4. Recomputes the smart EC with the batch compensation engine.
+//   5. Produces the calculate_statistics() report in the same single pass.
+//
+// Memory stays bounded regardless of file size: each worker owns fixed-size
+// row windows, and mapped pages it has finished with are released.
+//
+// Usage: ./log_reprocess [ec_data_log.csv] [--threads N] [--coeff-table FILE]
+//                        [--interpolate] [--output reprocessed.csv]
+
+const double STANDARD_VALUE = 12.88;
+const double TOLERANCE = 0.10;              // Same ±0.10 mS/cm as the dashboard
+const size_t ROW_WINDOW = 4096;             // Rows compensated per batch call
+const size_t RELEASE_BYTES = 64 << 20;      // Drop mapped pages every 64 MiB
+
+// ===========================
+// STREAMING STATISTICS
+// ===========================
+// Welford running mean/variance, mergeable across threads (Chan et al.)
+struct RunningStats {
+    uint64_t n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double min = INFINITY;
+    double max = -INFINITY;
+
+    void add(double x) {
+        n++;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+        if (x < min) min = x;
+        if (x > max) max = x;
+    }
+
+    void merge(const RunningStats &o) {
+        if (o.n == 0) return;
+        if (n == 0) {
+            *this = o;
+            return;
+        }
+        uint64_t total = n + o.n;
+        double delta = o.mean - mean;
+        mean += delta * o.n / total;
+        m2 += o.m2 + delta * delta * ((double)n * o.n / total);
+        n = total;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+    }
+
+    // Sample standard deviation, like pandas Series.std()
+    double stddev() const {
+        return n > 1 ? std::sqrt(m2 / (n - 1)) : 0.0;
+    }
+};
+
+// Error of one algorithm against the 12.88 mS/cm standard
+struct ErrorStats {
+    RunningStats value;
+    double squared_error = 0.0;
+    double absolute_error = 0.0;
+    uint64_t passed = 0;
+
+    void add(double x) {
+        double error = x - STANDARD_VALUE;
+        value.add(x);
+        squared_error += error * error;
+        absolute_error += std::fabs(error);
+        if (std::fabs(error) <= TOLERANCE) passed++;
+    }
+
+    void merge(const ErrorStats &o) {
+        value.merge(o.value);
+        squared_error += o.squared_error;
+        absolute_error += o.absolute_error;
+        passed += o.passed;
+    }
+
+    double rmse() const { return value.n ? std::sqrt(squared_error / value.n) : 0.0; }
+    double mae() const { return value.n ? absolute_error / value.n : 0.0; }
+    double pass_rate() const { return value.n ? 100.0 * passed / value.n : 0.0; }
+};
+
+struct ChunkResult {
+    ErrorStats sensor;
+    ErrorStats smart;
+    RunningStats deviation;
+    uint64_t rows = 0;
+    uint64_t skipped = 0;
+    uint64_t hex_decoded = 0;
+    std::string part_path;
+};
+
+// ===========================
+// CSV LAYOUT
+// ===========================
+struct ColumnMap {
+    int timestamp = -1;
+    int temperature = -1;
+    int hex_temp = -1;
+    int raw_ec = -1;
+    int hex_raw_ec = -1;
+    int sensor_ec = -1;
+    int count = 0;
+};
+
+ColumnMap parse_header(const char *begin, const char *end) {
+    ColumnMap map;
+    const char *field = begin;
+    for (const char *p = begin; p <= end; p++) {
+        if (p == end || *p == ',') {
+            std::string name(field, p);
+            if (!name.empty() && name.back() == '\r') name.pop_back();
+            if (name == "Timestamp") map.timestamp = map.count;
+            if (name == "Temperature") map.temperature = map.count;
+            if (name == "Hex_Temp") map.hex_temp = map.count;
+            if (name == "Raw_EC") map.raw_ec = map.count;
+            if (name == "Hex_Raw_EC") map.hex_raw_ec = map.count;
+            if (name == "Sensor_Default_EC") map.sensor_ec = map.count;
+            map.count++;
+            field = p + 1;
+        }
+    }
+    return map;
+}
+
+// "41351A86" -> {0x4135, 0x1A86} -> decode_float_abcd
+bool decode_hex_float(const char *begin, const char *end, double &value) {
+    uint32_t word;
+    if (end - begin != 8) return false;
+    auto result = std::from_chars(begin, end, word, 16);
+    if (result.ec != std::errc() || result.ptr != end) return false;
+
+    uint16_t regs[2] = {(uint16_t)(word >> 16), (uint16_t)(word & 0xFFFF)};
+    value = decode_float_abcd(regs);
+    return true;
+}
+
+bool parse_double(const char *begin, const char *end, double &value) {
+    auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+// ===========================
+// CHUNK WORKER
+// ===========================
+struct RowWindow {
+    const char *timestamp[ROW_WINDOW];
+    size_t timestamp_len[ROW_WINDOW];
+    const char *hex_temp[ROW_WINDOW];
+    const char *hex_raw_ec[ROW_WINDOW];
+    double temp[ROW_WINDOW];
+    double raw_ec[ROW_WINDOW];
+    double sensor_ec[ROW_WINDOW];
+    double smart_ec[ROW_WINDOW];
+    size_t count = 0;
+};
+
+void flush_window(RowWindow &w, const CoefficientTable &table, ChunkResult &result, FILE *out) {
+    compensate_batch(table, w.raw_ec, w.temp, w.smart_ec, w.count);
+
+    for (size_t i = 0; i < w.count; i++) {
+        double deviation = w.sensor_ec[i] - w.smart_ec[i];
+        result.sensor.add(w.sensor_ec[i]);
+        result.smart.add(w.smart_ec[i]);
+        result.deviation.add(deviation);
+
+        if (out != NULL) {
+            // %g matches the default std::ostream formatting smart_logger uses
+            fprintf(out, "%.*s,%g,%.8s,%g,%.8s,%g,%g,%g\n",
+                    (int)w.timestamp_len[i], w.timestamp[i], w.temp[i],
+                    w.hex_temp[i] ? w.hex_temp[i] : "", w.raw_ec[i],
+                    w.hex_raw_ec[i] ? w.hex_raw_ec[i] : "",
+                    w.sensor_ec[i], w.smart_ec[i], deviation);
+        }
+    }
+    w.count = 0;
+}
+
+void process_chunk(const char *base, size_t begin, size_t end, const ColumnMap &columns,
+                   const CoefficientTable &table, ChunkResult &result) {
+    static thread_local RowWindow window;
+    window.count = 0;
+
+    FILE *out = NULL;
+    if (!result.part_path.empty()) {
+        out = fopen(result.part_path.c_str(), "w");
+        if (out == NULL) {
+            std::cerr << "❌ Cannot write " << result.part_path << ": " << strerror(errno) << std::endl;
+        }
+    }
+
+    const char *fields[32];
+    const char *field_ends[32];
+    size_t released = begin;
+    const char *p = base + begin;
+    const char *chunk_end = base + end;
+
+    while (p < chunk_end) {
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', chunk_end - p));
+        if (line_end == NULL) line_end = chunk_end;
+        const char *content_end = (line_end > p && line_end[-1] == '\r') ? line_end - 1 : line_end;
+
+        // Split into fields
+        int n = 0;
+        const char *field = p;
+        for (const char *c = p; c <= content_end && n < 32; c++) {
+            if (c == content_end || *c == ',') {
+                fields[n] = field;
+                field_ends[n] = c;
+                n++;
+                field = c + 1;
+            }
+        }
+
+        if (content_end > p) {
+            double temp, raw_ec, sensor_ec;
+            bool ok = (n == columns.count);
+            bool hex_ok = ok && columns.hex_temp >= 0 && columns.hex_raw_ec >= 0
+                          && decode_hex_float(fields[columns.hex_temp], field_ends[columns.hex_temp], temp)
+                          && decode_hex_float(fields[columns.hex_raw_ec], field_ends[columns.hex_raw_ec], raw_ec);
+            if (ok && !hex_ok) {
+                ok = parse_double(fields[columns.temperature], field_ends[columns.temperature], temp)
+                     && parse_double(fields[columns.raw_ec], field_ends[columns.raw_ec], raw_ec);
+            }
+            ok = ok && parse_double(fields[columns.sensor_ec], field_ends[columns.sensor_ec], sensor_ec);
+
+            if (ok) {
+                RowWindow &w = window;
+                w.timestamp[w.count] = columns.timestamp >= 0 ? fields[columns.timestamp] : "";
+                w.timestamp_len[w.count] = columns.timestamp >= 0
+                    ? field_ends[columns.timestamp] - fields[columns.timestamp] : 0;
+                w.hex_temp[w.count] = hex_ok ? fields[columns.hex_temp] : NULL;
+                w.hex_raw_ec[w.count] = hex_ok ? fields[columns.hex_raw_ec] : NULL;
+                w.temp[w.count] = temp;
+                w.raw_ec[w.count] = raw_ec;
+                w.sensor_ec[w.count] = sensor_ec;
+                w.count++;
+                result.rows++;
+                if (hex_ok) result.hex_decoded++;
+                if (w.count == ROW_WINDOW) flush_window(w, table, result, out);
+            } else {
+                result.skipped++;
+            }
+        }
+
+        p = line_end + 1;
+
+        // Give back pages we are done with (window rows still point into
+        // the mapping, so only release after the window is flushed)
+        size_t offset = p - base;
+        if (window.count == 0 && offset - released >= RELEASE_BYTES) {
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t from = (released + page - 1) / page * page;
+            size_t to = offset / page * page;
+            if (to > from) madvise(const_cast<char *>(base) + from, to - from, MADV_DONTNEED);
+            released = offset;
+        }
+    }
+
+    if (window.count > 0) flush_window(window, table, result, out);
+    if (out != NULL) fclose(out);
+}
+
+// ===========================
+// REPORT (mirrors plot_data.py calculate_statistics)
+// ===========================
+void print_report(const ChunkResult &total, const CoefficientTable &table, double elapsed_s,
+                  size_t file_size, unsigned threads) {
+    const RunningStats &sensor = total.sensor.value;
+    const RunningStats &smart = total.smart.value;
+
+    std::cout << std::fixed;
+    std::cout << "\n" << std::string(60, '=') << "\n";
+    std::cout << "📊 STATISTICAL ANALYSIS\n";
+    std::cout << std::string(60, '=') << "\n";
+
+    std::cout << "\n  Rows: " << total.rows << " (" << total.hex_decoded << " re-decoded from hex, "
+              << total.skipped << " malformed rows skipped)\n";
+    std::cout << "  Coefficients: " << table.size << " rows, "
+              << (table.mode == COEFF_LINEAR ? "interpolated" : "step")
+              << " | Engine: " << compensation_engine_name() << "\n";
+
+    std::cout << std::setprecision(4);
+    std::cout << "\n🔴 Sensor Default EC (k=0.02 fixed):\n";
+    std::cout << "   Mean:     " << sensor.mean << " mS/cm\n";
+    std::cout << "   Std Dev:  " << sensor.stddev() << " mS/cm\n";
+    std::cout << "   Min:      " << sensor.min << " mS/cm\n";
+    std::cout << "   Max:      " << sensor.max << " mS/cm\n";
+    std::cout << "   Range:    " << (sensor.max - sensor.min) << " mS/cm\n";
+
+    std::cout << "\n🟢 Smart Algorithm EC (Dynamic k):\n";
+    std::cout << "   Mean:     " << smart.mean << " mS/cm\n";
+    std::cout << "   Std Dev:  " << smart.stddev() << " mS/cm\n";
+    std::cout << "   Min:      " << smart.min << " mS/cm\n";
+    std::cout << "   Max:      " << smart.max << " mS/cm\n";
+    std::cout << "   Range:    " << (smart.max - smart.min) << " mS/cm\n";
+
+    std::cout << std::setprecision(2);
+    if (sensor.stddev() > 0) {
+        std::cout << "\n💡 Stability Improvement: "
+                  << (sensor.stddev() - smart.stddev()) / sensor.stddev() * 100.0 << "%\n";
+    }
+
+    std::cout << std::setprecision(4);
+    std::cout << "\n📏 RMSE from Expected (12.88 mS/cm):\n";
+    std::cout << "   Sensor Default: " << total.sensor.rmse() << " mS/cm\n";
+    std::cout << "   Smart Algo:     " << total.smart.rmse() << " mS/cm\n";
+    if (total.sensor.rmse() > 0) {
+        std::cout << "   Improvement:    " << std::setprecision(2)
+                  << (total.sensor.rmse() - total.smart.rmse()) / total.sensor.rmse() * 100.0 << "%\n";
+    }
+
+    std::cout << std::setprecision(4);
+    std::cout << "\n⚖️  Errors against 12.88 mS/cm (tolerance ±" << std::setprecision(2) << TOLERANCE << "):\n";
+    std::cout << "   Sensor Default: MAE " << total.sensor.mae() << " mS/cm | Pass rate "
+              << std::setprecision(2) << total.sensor.pass_rate() << "%\n";
+    std::cout << std::setprecision(4);
+    std::cout << "   Smart Algo:     MAE " << total.smart.mae() << " mS/cm | Pass rate "
+              << std::setprecision(2) << total.smart.pass_rate() << "%\n";
+
+    std::cout << std::setprecision(4);
+    std::cout << "\n📐 Deviation (Sensor - Smart):\n";
+    std::cout << "   Mean:     " << total.deviation.mean << " mS/cm\n";
+    std::cout << "   Std Dev:  " << total.deviation.stddev() << " mS/cm\n";
+
+    std::cout << "\n⏱️  " << std::setprecision(1) << (file_size / 1048576.0) << " MiB in "
+              << std::setprecision(3) << elapsed_s << " s on " << threads << " thread(s) ("
+              << std::setprecision(0) << (elapsed_s > 0 ? total.rows / elapsed_s : 0.0) << " rows/s)\n";
+    std::cout << std::string(60, '=') << "\n" << std::endl;
+}
+
+// ===========================
+// MAIN PROGRAM
+// ===========================
+int main(int argc, char **argv) {
+    std::string csv_path = "ec_data_log.csv";
+    std::string table_path, output_path;
+    bool interpolate = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--coeff-table" && i + 1 < argc) {
+            table_path = argv[++i];
+        } else if (arg == "--interpolate") {
+            interpolate = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg[0] != '-') {
+            csv_path = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [ec_data_log.csv] [--threads N] [--coeff-table FILE]\n"
+                      << "       [--interpolate] [--output reprocessed.csv]" << std::endl;
+            return -1;
+        }
+    }
+
+    CoefficientTable table = DEFAULT_COEFFICIENT_TABLE;
+    if (!table_path.empty() && !load_coefficient_table(table_path, table)) {
+        return -1;
+    }
+    if (interpolate) {
+        table.mode = COEFF_LINEAR;
+    }
+
+    // Step 1: Map the log
+    int fd = open(csv_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+        std::cerr << "❌ ERROR: cannot read " << csv_path << std::endl;
+        return -1;
+    }
+    size_t size = st.st_size;
+    const char *base = static_cast<const char *>(mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    if (base == MAP_FAILED) {
+        std::cerr << "❌ mmap failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    madvise(const_cast<char *>(base), size, MADV_SEQUENTIAL);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Step 2: Header
+    const char *header_end = static_cast<const char *>(memchr(base, '\n', size));
+    if (header_end == NULL) header_end = base + size;
+    ColumnMap columns = parse_header(base, header_end);
+    if (columns.sensor_ec < 0 || (columns.hex_temp < 0 && columns.temperature < 0)
+        || (columns.hex_raw_ec < 0 && columns.raw_ec < 0)) {
+        std::cerr << "❌ ERROR: " << csv_path << " has no Temperature/Raw_EC/Sensor_Default_EC columns" << std::endl;
+        return -1;
+    }
+    size_t data_begin = std::min(size, (size_t)(header_end - base) + 1);
+
+    // Step 3: Line-aligned chunks, one per thread
+    std::vector<size_t> bounds(threads + 1);
+    bounds[0] = data_begin;
+    bounds[threads] = size;
+    for (unsigned t = 1; t < threads; t++) {
+        size_t pos = data_begin + (size - data_begin) * t / threads;
+        pos = std::max(pos, bounds[t - 1]);
+        const char *nl = static_cast<const char *>(memchr(base + pos, '\n', size - pos));
+        bounds[t] = nl ? (size_t)(nl - base) + 1 : size;
+    }
+
+    std::vector<ChunkResult> results(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        if (!output_path.empty()) {
+            results[t].part_path = output_path + ".part" + std::to_string(t);
+        }
+        workers.emplace_back(process_chunk, base, bounds[t], bounds[t + 1], std::cref(columns),
+                             std::cref(table), std::ref(results[t]));
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    // Step 4: Merge
+    ChunkResult total;
+    for (const auto &r : results) {
+        total.sensor.merge(r.sensor);
+        total.smart.merge(r.smart);
+        total.deviation.merge(r.deviation);
+        total.rows += r.rows;
+        total.skipped += r.skipped;
+        total.hex_decoded += r.hex_decoded;
+    }
+
+    // Step 5: Stitch the reprocessed CSV together in chunk order
+    if (!output_path.empty()) {
+        int out = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out == -1) {
+            std::cerr << "❌ Cannot write " << output_path << ": " << strerror(errno) << std::endl;
+            return -1;
+        }
+        const char *header = "Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation\n";
+        if (write(out, header, strlen(header)) == -1) {
+            std::cerr << "❌ Write failed: " << strerror(errno) << std::endl;
+        }
+        for (const auto &r : results) {
+            int part = open(r.part_path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat part_st;
+            if (part != -1 && fstat(part, &part_st) == 0) {
+                off_t offset = 0;
+                while (offset < part_st.st_size) {
+                    if (sendfile(out, part, &offset, part_st.st_size - offset) <= 0) break;
+                }
+            }
+            if (part != -1) close(part);
+            unlink(r.part_path.c_str());
+        }
+        close(out);
+        std::cout << "💾 Reprocessed log written to: " << output_path << std::endl;
+    }
+
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    print_report(total, table, elapsed_s, size, threads);
+
+    munmap(const_cast<char *>(base), size);
+    close(fd);
+    return 0;
+}
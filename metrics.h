@@ -0,0 +1,377 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <modbus.h>
+#include "sensor_registers.h"
+
+// ===========================
+// LATENCY HISTOGRAM
+// ===========================
+// Fixed 1-2-5 buckets from 10 µs to 5 s, covering batch compensation
+// (microseconds) as well as RTU transactions and timeouts (tens of ms to
+// seconds). observe_ns() is a short compare loop plus three relaxed atomic
+// adds, so it stays on in production.
+const int LATENCY_BUCKET_COUNT = 19;
+const int64_t LATENCY_BUCKETS_NS[LATENCY_BUCKET_COUNT] = {
+    10000, 20000, 50000,                        // 10-50 µs
+    100000, 200000, 500000,                     // 100-500 µs
+    1000000, 2000000, 5000000,                  // 1-5 ms
+    10000000, 20000000, 50000000,               // 10-50 ms
+    100000000, 200000000, 500000000,            // 100-500 ms
+    1000000000, 2000000000, 5000000000LL,       // 1-5 s
+    INT64_MAX                                   // +Inf
+};
+
+struct LatencyHistogram {
+    std::atomic<uint64_t> buckets[LATENCY_BUCKET_COUNT] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum_ns{0};
+
+    void observe_ns(int64_t ns) {
+        if (ns < 0) ns = 0;
+        int b = 0;
+        while (ns > LATENCY_BUCKETS_NS[b]) b++;
+        buckets[b].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add((uint64_t)ns, std::memory_order_relaxed);
+    }
+
+    void observe_since(std::chrono::steady_clock::time_point start) {
+        observe_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+// ===========================
+// PROMETHEUS TEXT FORMAT
+// ===========================
+inline void metric_header(std::string &out, const char *name, const char *type, const char *help) {
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+}
+
+// labels: "" or 'slave="4"' (without braces)
+inline void metric_value(std::string &out, const char *name, const std::string &labels, double value) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s%s%s%s %.9g\n", name, labels.empty() ? "" : "{",
+             labels.c_str(), labels.empty() ? "" : "}", value);
+    out += line;
+}
+
+// Cumulative buckets, as Prometheus expects
+inline void metric_histogram(std::string &out, const char *name, const std::string &labels,
+                             const LatencyHistogram &h) {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    std::string bucket_name = std::string(name) + "_bucket";
+    uint64_t cumulative = 0;
+    char le[64];
+
+    for (int b = 0; b < LATENCY_BUCKET_COUNT; b++) {
+        cumulative += h.buckets[b].load(std::memory_order_relaxed);
+        if (LATENCY_BUCKETS_NS[b] == INT64_MAX) {
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+        } else {
+            snprintf(le, sizeof(le), "le=\"%g\"", LATENCY_BUCKETS_NS[b] / 1e9);
+        }
+        metric_value(out, bucket_name.c_str(), prefix + le, (double)cumulative);
+    }
+    metric_value(out, (std::string(name) + "_sum").c_str(), labels,
+                 h.sum_ns.load(std::memory_order_relaxed) / 1e9);
+    metric_value(out, (std::string(name) + "_count").c_str(), labels,
+                 (double)h.count.load(std::memory_order_relaxed));
+}
+
+// ===========================
+// LOGGER METRICS
+// ===========================
+// Written by the acquisition thread (transactions, errors, read phase) and
+// the output stages (compute, log, render phases); read by the stats
+// endpoint. Everything is a relaxed atomic: counters may be a sample apart
+// from each other in one scrape, which is fine for monitoring.
+enum LoopPhase {
+    PHASE_READ = 0,     // Whole poll: every block of the read plan
+    PHASE_COMPUTE,      // Batch compensation
+    PHASE_LOG,          // CSV formatting/flush or binary append
+    PHASE_RENDER,       // Building and writing one dashboard frame
+    PHASE_COUNT
+};
+
+const char *const LOOP_PHASE_NAMES[PHASE_COUNT] = {"read", "compute", "log", "render"};
+
+enum ModbusErrorKind {
+    ERROR_TIMEOUT = 0,
+    ERROR_CRC,
+    ERROR_EXCEPTION,    // Slave answered with a Modbus exception
+    ERROR_OTHER,
+    ERROR_KIND_COUNT
+};
+
+const char *const MODBUS_ERROR_NAMES[ERROR_KIND_COUNT] = {"timeout", "crc", "exception", "other"};
+
+inline ModbusErrorKind classify_modbus_error(int error) {
+    if (error == ETIMEDOUT) return ERROR_TIMEOUT;
+    if (error == EMBBADCRC) return ERROR_CRC;
+    if (error >= EMBXILFUN && error <= EMBXGTAR) return ERROR_EXCEPTION;
+    return ERROR_OTHER;
+}
+
+// Register blocks are registered up front (main plan and fallback plan),
+// so the hot path only does a short linear search and never allocates.
+const int METRICS_MAX_BLOCKS = 8;
+
+struct BlockMetrics {
+    int address = -1;
+    int count = 0;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors[ERROR_KIND_COUNT] = {};
+};
+
+struct LoggerMetrics {
+    BlockMetrics blocks[METRICS_MAX_BLOCKS];
+    int block_count = 0;
+    LatencyHistogram phases[PHASE_COUNT];
+    LatencyHistogram poll_lateness;     // Poll start minus its deadline (fixed-rate slaves)
+    std::atomic<uint64_t> acquisition_allocations{0};  // Heap allocations per thread, counted
+    std::atomic<uint64_t> output_allocations{0};       // by alloc_counter.h (0 in steady state)
+
+    // Setup only (before the acquisition thread starts)
+    void add_plan(const ReadPlan &plan) {
+        for (const auto &block : plan.blocks) {
+            if (find_block(block.address, block.count) == NULL && block_count < METRICS_MAX_BLOCKS) {
+                blocks[block_count].address = block.address;
+                blocks[block_count].count = block.count;
+                block_count++;
+            }
+        }
+    }
+
+    BlockMetrics *find_block(int address, int count) {
+        for (int i = 0; i < block_count; i++) {
+            if (blocks[i].address == address && blocks[i].count == count) return &blocks[i];
+        }
+        return NULL;
+    }
+
+    // One poll: block_ns[b] holds the duration of every block that was
+    // attempted, from first_block on; failed_block is -1 on success.
+    void record_poll(const ReadPlan &plan, const int64_t *block_ns, size_t first_block, int failed_block,
+                     int error, int64_t total_ns) {
+        size_t attempted = failed_block == -1 ? plan.blocks.size() : (size_t)failed_block + 1;
+        for (size_t b = first_block; b < attempted; b++) {
+            BlockMetrics *m = find_block(plan.blocks[b].address, plan.blocks[b].count);
+            if (m == NULL) continue;
+            m->latency.observe_ns(block_ns[b]);
+            if ((int)b == failed_block) {
+                m->errors[classify_modbus_error(error)].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        phases[PHASE_READ].observe_ns(total_ns);
+    }
+
+    static std::string block_label(const BlockMetrics &m) {
+        return "block=\"" + std::to_string(m.address) + "-" + std::to_string(m.address + m.count - 1) + "\"";
+    }
+};
+
+// One LoggerMetrics per bus and its labels ('port="/dev/ttyUSB0"', or ""
+// with a single bus)
+typedef std::vector<std::pair<std::string, const LoggerMetrics *>> BusMetricsList;
+
+// Each bus records its own transactions, errors, poll lateness and
+// read/compute/log phases; `process` holds what is not tied to a bus: the
+// render phase and the hot-path allocation counters.
+inline void render_logger_metrics(std::string &out, const LoggerMetrics &process, const BusMetricsList &buses) {
+    metric_header(out, "ec_modbus_transaction_seconds", "histogram",
+                  "Duration of each modbus_read_registers call, per register block");
+    for (const auto &bus : buses) {
+        std::string prefix = bus.first.empty() ? "" : bus.first + ",";
+        for (int i = 0; i < bus.second->block_count; i++) {
+            const BlockMetrics &block = bus.second->blocks[i];
+            metric_histogram(out, "ec_modbus_transaction_seconds", prefix + LoggerMetrics::block_label(block),
+                             block.latency);
+        }
+    }
+
+    metric_header(out, "ec_modbus_errors_total", "counter", "Failed register reads by block and cause");
+    for (const auto &bus : buses) {
+        std::string prefix = bus.first.empty() ? "" : bus.first + ",";
+        for (int i = 0; i < bus.second->block_count; i++) {
+            const BlockMetrics &block = bus.second->blocks[i];
+            for (int k = 0; k < ERROR_KIND_COUNT; k++) {
+                metric_value(out, "ec_modbus_errors_total",
+                             prefix + LoggerMetrics::block_label(block) + ",kind=\"" + MODBUS_ERROR_NAMES[k] + "\"",
+                             (double)block.errors[k].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    metric_header(out, "ec_loop_phase_seconds", "histogram",
+                  "Time spent per loop phase (read per poll, the others per batch or frame)");
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        std::string phase = std::string("phase=\"") + LOOP_PHASE_NAMES[p] + "\"";
+        if (p == PHASE_RENDER) {
+            metric_histogram(out, "ec_loop_phase_seconds", phase, process.phases[p]);
+            continue;
+        }
+        for (const auto &bus : buses) {
+            metric_histogram(out, "ec_loop_phase_seconds", bus.first.empty() ? phase : bus.first + "," + phase,
+                             bus.second->phases[p]);
+        }
+    }
+
+    metric_header(out, "ec_poll_lateness_seconds", "histogram",
+                  "How late each poll started after its deadline");
+    for (const auto &bus : buses) {
+        metric_histogram(out, "ec_poll_lateness_seconds", bus.first, bus.second->poll_lateness);
+    }
+
+    metric_header(out, "ec_hot_path_allocations_total", "counter",
+                  "Heap allocations on the acquisition and output threads");
+    metric_value(out, "ec_hot_path_allocations_total", "thread=\"acquisition\"",
+                 (double)process.acquisition_allocations.load(std::memory_order_relaxed));
+    metric_value(out, "ec_hot_path_allocations_total", "thread=\"output\"",
+                 (double)process.output_allocations.load(std::memory_order_relaxed));
+}
+
+// ===========================
+// STATS ENDPOINT
+// ===========================
+// Minimal HTTP/1.0 server on its own thread: every connection gets the
+// current metrics and is closed, whatever the request path. Listens on
+// 127.0.0.1 only, or on a Unix socket:
+//
+//   curl http://127.0.0.1:9464/metrics
+//   curl --unix-socket /tmp/ec_logger.sock http://localhost/metrics
+class MetricsServer {
+public:
+    ~MetricsServer() {
+        stop();
+    }
+
+    bool listen_tcp(int port) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ == -1) return false;
+
+        int yes = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return bind_and_listen((struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    bool listen_unix(const std::string &path) {
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ == -1) return false;
+
+        unlink(path.c_str());  // Stale socket from a previous run
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        unix_path_ = path;
+        return bind_and_listen((struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    // render() is called on the server thread for every scrape
+    void start(std::function<void(std::string &)> render) {
+        render_ = render;
+        running_ = true;
+        worker_ = std::thread(&MetricsServer::serve, this);
+    }
+
+    void stop() {
+        running_ = false;
+        if (worker_.joinable()) worker_.join();
+        if (listen_fd_ != -1) close(listen_fd_);
+        listen_fd_ = -1;
+        if (!unix_path_.empty()) unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+
+    long scrapes() const { return scrapes_; }
+
+private:
+    int listen_fd_ = -1;
+    std::string unix_path_;
+    std::thread worker_;
+    std::atomic<bool> running_{false};
+    std::atomic<long> scrapes_{0};
+    std::function<void(std::string &)> render_;
+
+    bool bind_and_listen(const struct sockaddr *addr, socklen_t len) {
+        if (bind(listen_fd_, addr, len) == -1 || listen(listen_fd_, 8) == -1) {
+            close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    void serve() {
+        std::string body, response;
+        char request[1024];
+
+        while (running_) {
+            struct pollfd pfd = {listen_fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) continue;
+
+            int client = accept4(listen_fd_, NULL, NULL, SOCK_CLOEXEC);
+            if (client == -1) continue;
+
+            // Read (and ignore) the request; do not let a silent client stall us
+            struct pollfd cfd = {client, POLLIN, 0};
+            if (poll(&cfd, 1, 1000) > 0) {
+                ssize_t n = read(client, request, sizeof(request));
+                (void)n;
+            }
+
+            body.clear();
+            render_(body);
+            response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                       + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+            size_t sent = 0;
+            while (sent < response.size()) {
+                ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                sent += n;
+            }
+            close(client);
+            scrapes_++;
+        }
+    }
+};
+
+#endif // METRICS_H
@@ -0,0 +1,25 @@
+#ifndef MODBUS_CRC_H
+#define MODBUS_CRC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ===========================
+// MODBUS RTU CRC
+// ===========================
+// Shared by the simulator and the event-driven RTU client, which both build
+// and check frames themselves instead of going through libmodbus.
+
+// Modbus CRC-16 (poly 0xA001, init 0xFFFF), low byte first on the wire
+inline uint16_t modbus_crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+#endif // MODBUS_CRC_H
@@ -0,0 +1,359 @@
+#ifndef MODBUS_GATEWAY_H
+#define MODBUS_GATEWAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <modbus.h>
+#include "sensor_registers.h"
+#include "seqlock.h"
+
+// ===========================
+// GATEWAY REGISTER IMAGE
+// ===========================
+// What Modbus TCP clients see for each unit ID (= RS485 slave ID). The
+// sensor's own registers keep their addresses, so tools written for the
+// IOT-485-EC4A work unchanged; the computed values follow from 100 up.
+// Floats are ABCD like on the sensor, 32-bit integers high word first.
+//
+//   8        Device address (slave ID)
+//   41-42    Sensor EC (register words exactly as read from the sensor)
+//   45-46    Raw EC
+//   60-61    Temperature
+//   100-101  Smart EC (dynamic k)
+//   102-103  k used
+//   104-105  Deviation (sensor EC - smart EC)
+//   106-107  Sample counter
+//   108-109  Unix time of the sample (seconds)
+//   110-111  Age of the sample when the request was answered (ms)
+const int GATEWAY_REGISTER_COUNT = 112;
+const int GATEWAY_REG_SMART_EC = 100;
+const int GATEWAY_REG_K_USED = 102;
+const int GATEWAY_REG_DEVIATION = 104;
+const int GATEWAY_REG_SAMPLE_COUNT = 106;
+const int GATEWAY_REG_UNIX_TIME = 108;
+const int GATEWAY_REG_AGE_MS = 110;
+
+struct GatewayReading {
+    int64_t monotonic_ns;       // For the age register
+    uint16_t registers[GATEWAY_REGISTER_COUNT];
+};
+
+inline void gateway_set_u32(uint16_t *dest, uint32_t value) {
+    dest[0] = (uint16_t)(value >> 16);
+    dest[1] = (uint16_t)(value & 0xFFFF);
+}
+
+// Pre-encodes the whole register image once per sample, so answering a
+// client is a copy and never formats anything.
+inline GatewayReading make_gateway_reading(int slave_id, const SensorSample &sample, double smart_ec,
+                                           double k_used, long sample_count, int64_t monotonic_ns,
+                                           int64_t realtime_ns) {
+    GatewayReading reading;
+    memset(&reading, 0, sizeof(reading));
+    reading.monotonic_ns = monotonic_ns;
+
+    uint16_t *regs = reading.registers;
+    regs[8] = (uint16_t)slave_id;
+    for (const auto &f : EC4A_REGISTER_MAP) {
+        regs[f.address] = sample.raw[f.field][0];
+        regs[f.address + 1] = sample.raw[f.field][1];
+    }
+    modbus_set_float_abcd((float)smart_ec, &regs[GATEWAY_REG_SMART_EC]);
+    modbus_set_float_abcd((float)k_used, &regs[GATEWAY_REG_K_USED]);
+    modbus_set_float_abcd((float)(sample.value[FIELD_SENSOR_EC] - smart_ec), &regs[GATEWAY_REG_DEVIATION]);
+    gateway_set_u32(&regs[GATEWAY_REG_SAMPLE_COUNT], (uint32_t)sample_count);
+    gateway_set_u32(&regs[GATEWAY_REG_UNIX_TIME], (uint32_t)(realtime_ns / 1000000000LL));
+    return reading;
+}
+
+// ===========================
+// MODBUS TCP GATEWAY
+// ===========================
+// Answers FC03/FC04 from the latest-value cache only: a client read never
+// turns into RS485 traffic, however many clients there are or how fast they
+// poll. Each worker thread runs its own epoll loop on its own SO_REUSEPORT
+// listener; the kernel spreads new connections across them. Pipelined
+// requests on one connection are answered in order.
+const int GATEWAY_MAX_ADU = 260;        // Modbus TCP limit (MBAP + PDU)
+const size_t GATEWAY_MAX_PENDING = 65536;   // Stop reading a client that does not read its replies
+
+struct GatewayUnit {
+    int unit_id;
+    Seqlock<GatewayReading> cache;
+};
+
+struct GatewayConnection {
+    int fd;
+    uint8_t in[4 * GATEWAY_MAX_ADU];
+    size_t in_len = 0;
+    std::string out;
+    size_t out_sent = 0;
+    bool want_write = false;
+};
+
+class ModbusGateway {
+public:
+    // Statistics (any thread)
+    std::atomic<long> requests{0};
+    std::atomic<long> exceptions{0};
+    std::atomic<long> connections{0};       // Currently open
+    std::atomic<long> connections_total{0};
+
+    ~ModbusGateway() {
+        stop();
+    }
+
+    // Setup only: one unit per polled slave. Unit 0 and 255 (the usual
+    // "this device" IDs of Modbus TCP) map to the first unit.
+    size_t add_unit(int unit_id) {
+        units_.emplace_back();
+        units_.back().unit_id = unit_id;
+        return units_.size() - 1;
+    }
+
+    // Output stage: publish the newest sample of one unit (never blocks)
+    void publish(size_t unit_index, const GatewayReading &reading) {
+        units_[unit_index].cache.store(reading);
+    }
+
+    bool listen(const std::string &bind_address, int port, int threads) {
+        for (int t = 0; t < threads; t++) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd == -1) return false;
+
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((uint16_t)port);
+            if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1) {
+                close(fd);
+                errno = EINVAL;
+                return false;
+            }
+            if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || ::listen(fd, 128) == -1) {
+                int saved_errno = errno;
+                close(fd);
+                errno = saved_errno;
+                return false;
+            }
+            listen_fds_.push_back(fd);
+        }
+        return true;
+    }
+
+    void start() {
+        running_ = true;
+        for (int fd : listen_fds_) {
+            workers_.emplace_back(&ModbusGateway::serve, this, fd);
+        }
+    }
+
+    void stop() {
+        running_ = false;
+        for (auto &w : workers_) {
+            if (w.joinable()) w.join();
+        }
+        workers_.clear();
+        for (int fd : listen_fds_) {
+            close(fd);
+        }
+        listen_fds_.clear();
+    }
+
+private:
+    std::deque<GatewayUnit> units_;     // deque: caches never move once added
+    std::vector<int> listen_fds_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_{false};
+
+    GatewayUnit *find_unit(int unit_id) {
+        if ((unit_id == 0 || unit_id == 255) && !units_.empty()) return &units_[0];
+        for (auto &u : units_) {
+            if (u.unit_id == unit_id) return &u;
+        }
+        return NULL;
+    }
+
+    // Appends the response to one request PDU (FC03/FC04 only)
+    void answer(uint16_t transaction_id, uint8_t unit_id, const uint8_t *pdu, size_t pdu_len,
+                std::string &out) {
+        uint8_t reply[GATEWAY_MAX_ADU];
+        uint8_t function = pdu[0];
+        int exception = 0;
+        int address = 0, count = 0;
+        GatewayReading reading;
+        GatewayUnit *unit = find_unit(unit_id);
+
+        if (function != 3 && function != 4) {
+            exception = 1;                              // Illegal function
+        } else if (pdu_len != 5) {
+            exception = 3;                              // Illegal data value
+        } else {
+            address = (pdu[1] << 8) | pdu[2];
+            count = (pdu[3] << 8) | pdu[4];
+            if (count < 1 || count > 125) {
+                exception = 3;
+            } else if (address + count > GATEWAY_REGISTER_COUNT) {
+                exception = 2;                          // Illegal data address
+            } else if (unit == NULL || !unit->cache.load(reading)) {
+                exception = 0x0B;                       // Gateway target failed to respond
+            }
+        }
+
+        size_t len = 7;
+        reply[len++] = exception ? (uint8_t)(function | 0x80) : function;
+        if (exception) {
+            reply[len++] = (uint8_t)exception;
+            exceptions++;
+        } else {
+            int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            gateway_set_u32(&reading.registers[GATEWAY_REG_AGE_MS],
+                            (uint32_t)((now_ns - reading.monotonic_ns) / 1000000));
+            reply[len++] = (uint8_t)(2 * count);
+            for (int i = 0; i < count; i++) {
+                uint16_t value = reading.registers[address + i];
+                reply[len++] = (uint8_t)(value >> 8);
+                reply[len++] = (uint8_t)(value & 0xFF);
+            }
+        }
+
+        // MBAP header: transaction, protocol 0, length (unit + PDU), unit
+        reply[0] = (uint8_t)(transaction_id >> 8);
+        reply[1] = (uint8_t)(transaction_id & 0xFF);
+        reply[2] = 0;
+        reply[3] = 0;
+        reply[4] = (uint8_t)((len - 6) >> 8);
+        reply[5] = (uint8_t)((len - 6) & 0xFF);
+        reply[6] = unit_id;
+        out.append((const char *)reply, len);
+        requests++;
+    }
+
+    // Returns false when the connection must be closed
+    bool on_readable(GatewayConnection &c) {
+        while (c.out.size() - c.out_sent < GATEWAY_MAX_PENDING) {
+            ssize_t n = read(c.fd, c.in + c.in_len, sizeof(c.in) - c.in_len);
+            if (n == 0) return false;
+            if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            c.in_len += n;
+
+            size_t pos = 0;
+            while (c.in_len - pos >= 8) {
+                const uint8_t *adu = c.in + pos;
+                size_t length = (adu[4] << 8) | adu[5];    // Unit ID + PDU
+                if (adu[2] != 0 || adu[3] != 0 || length < 2 || length > GATEWAY_MAX_ADU - 6) {
+                    return false;                           // Not Modbus TCP
+                }
+                if (c.in_len - pos < 6 + length) break;     // Rest still in flight
+                answer((uint16_t)((adu[0] << 8) | adu[1]), adu[6], adu + 7, length - 1, c.out);
+                pos += 6 + length;
+            }
+            memmove(c.in, c.in + pos, c.in_len - pos);
+            c.in_len -= pos;
+
+            if (!flush(c)) return false;
+        }
+        return true;
+    }
+
+    bool flush(GatewayConnection &c) {
+        while (c.out_sent < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.out_sent, c.out.size() - c.out_sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            c.out_sent += n;
+        }
+        c.out.clear();
+        c.out_sent = 0;
+        return true;
+    }
+
+    void close_connection(int epoll_fd, GatewayConnection *c) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        delete c;
+        connections--;
+    }
+
+    void serve(int listen_fd) {
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;                             // NULL = the listener
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+        std::vector<GatewayConnection *> open_connections;
+        struct epoll_event events[64];
+
+        while (running_) {
+            int n = epoll_wait(epoll_fd, events, 64, 200);
+            for (int i = 0; i < n; i++) {
+                GatewayConnection *c = static_cast<GatewayConnection *>(events[i].data.ptr);
+
+                if (c == NULL) {
+                    int fd;
+                    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                        int yes = 1;
+                        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                        c = new GatewayConnection();
+                        c->fd = fd;
+                        ev.events = EPOLLIN | EPOLLRDHUP;
+                        ev.data.ptr = c;
+                        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+                        open_connections.push_back(c);
+                        connections++;
+                        connections_total++;
+                    }
+                    continue;
+                }
+
+                bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP));
+                if (ok && (events[i].events & EPOLLOUT)) ok = flush(*c);
+                if (ok && (events[i].events & (EPOLLIN | EPOLLRDHUP))) ok = on_readable(*c);
+
+                if (!ok) {
+                    open_connections.erase(std::find(open_connections.begin(), open_connections.end(), c));
+                    close_connection(epoll_fd, c);
+                    continue;
+                }
+
+                // Only ask for EPOLLOUT while replies are waiting
+                bool want_write = c->out_sent < c->out.size();
+                if (want_write != c->want_write) {
+                    c->want_write = want_write;
+                    ev.events = want_write ? EPOLLOUT | EPOLLRDHUP : EPOLLIN | EPOLLRDHUP;
+                    ev.data.ptr = c;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+                }
+            }
+        }
+
+        for (GatewayConnection *c : open_connections) {
+            close_connection(epoll_fd, c);
+        }
+        close(epoll_fd);
+    }
+};
+
+#endif // MODBUS_GATEWAY_H
@@ -0,0 +1,265 @@
+#ifndef OUTPUT_STAGES_H
+#define OUTPUT_STAGES_H
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <modbus.h>
+#include "sensor_registers.h"
+#include "bus_scheduler.h"
+#include "spsc_ring.h"
+#include "metrics.h"
+#include "modbus_gateway.h"
+#include "fast_format.h"
+
+// ===========================
+// CSV LOG
+// ===========================
+const char *const CSV_HEADER = "Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation";
+const char *const CSV_FILTER_COLUMNS = ",Readings,Rejected,Temp_Variance,Raw_EC_Variance,Sensor_EC_Variance";
+
+// Returns false if an existing log has other columns than this run writes
+inline bool open_csv_log(std::ofstream &csv_file, const std::string &path, bool oversample) {
+    bool file_exists = (access(path.c_str(), F_OK) != -1);
+    std::string header = std::string(CSV_HEADER) + (oversample ? CSV_FILTER_COLUMNS : "");
+    
+    if (file_exists) {
+        std::ifstream existing(path);
+        std::string first_line;
+        std::getline(existing, first_line);
+        if (!first_line.empty() && first_line.back() == '\r') first_line.pop_back();
+        if (!first_line.empty() && first_line != header) {
+            std::cerr << "❌ " << path << " has other columns than this run writes"
+                      << (oversample ? " (--oversample adds the filter columns)" : "")
+                      << ". Move it away first." << std::endl;
+            return false;
+        }
+    }
+    
+    csv_file.open(path, std::ios::app);
+    
+    // Write header if new file (with hex validation columns)
+    if (!file_exists) {
+        csv_file << header << "\n";
+    }
+    return true;
+}
+
+// --oversample: replaces the newline of a CSV row with the filter columns
+const size_t CSV_FILTER_COLUMNS_MAX = 64;
+
+inline size_t append_filter_columns(char *row, size_t length, size_t size, const FilterResult &result) {
+    char *p = row + length - 1;
+    char *end = row + size - 1;
+    *p++ = ',';
+    p = std::to_chars(p, end, result.readings).ptr;
+    *p++ = ',';
+    p = std::to_chars(p, end, result.rejected).ptr;
+    *p++ = ',';
+    p = format_number(p, end, result.variance[FIELD_TEMPERATURE]);
+    *p++ = ',';
+    p = format_number(p, end, result.variance[FIELD_RAW_EC]);
+    *p++ = ',';
+    p = format_number(p, end, result.variance[FIELD_SENSOR_EC]);
+    *p++ = '\n';
+    return (size_t)(p - row);
+}
+
+// ===========================
+// ACQUISITION PIPELINE
+// ===========================
+// acquisition thread --> SampleRing (lock-free SPSC) --> filter/compensate/log
+// (OutputStages below) --> dashboard (dashboard.h).
+//
+// smart_logger runs these stages on its output thread, and
+// bench_acquisition --check-allocations runs the same code, so the
+// allocation check covers what the logger really does per sample.
+const size_t PIPELINE_BATCH = 64;
+const useconds_t PIPELINE_IDLE_US = 10000;   // Consumer back-off when the ring is empty
+typedef SpscRing<AcquiredSample, 1024> SampleRing;
+
+// Stage 1: compensation. Samples are grouped per slave (each slave has its
+// own coefficient table) and compensated with one batch call per slave.
+inline void compensate_samples(const BusScheduler &bus, const AcquiredSample *batch, size_t count,
+                               double *smart_ec, double *k_used) {
+    double raw[PIPELINE_BATCH], temp[PIPELINE_BATCH], out[PIPELINE_BATCH], k[PIPELINE_BATCH];
+    size_t index[PIPELINE_BATCH];
+    
+    for (size_t s = 0; s < bus.slaves.size(); s++) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!batch[i].ok || batch[i].slave_index != s) continue;
+            index[n] = i;
+            raw[n] = batch[i].sample.value[FIELD_RAW_EC];
+            temp[n] = batch[i].sample.value[FIELD_TEMPERATURE];
+            n++;
+        }
+        if (n == 0) continue;
+        
+        compensate_batch(bus.slaves[s].table, raw, temp, out, n, k);
+        for (size_t j = 0; j < n; j++) {
+            smart_ec[index[j]] = out[j];
+            k_used[index[j]] = k[j];
+        }
+    }
+}
+
+// Stage 0 (--oversample): denoising. Each slave's readings go into its
+// SampleFilter; once the slave's output period is over, the window is
+// replaced by one filtered sample. The batch is compacted in place, so the
+// later stages only see filtered samples, plus failed polls, which are
+// still reported one by one. results[i] belongs to batch[i].
+inline size_t filter_samples(BusScheduler &bus, AcquiredSample *batch, size_t count, FilterResult *results) {
+    size_t emitted = 0;
+    for (size_t i = 0; i < count; i++) {
+        AcquiredSample reading = batch[i];      // batch[emitted] may be this slot
+        SampleFilter *filter = bus.slaves[reading.slave_index].filter.get();
+        if (!reading.ok || filter == NULL) {
+            batch[emitted++] = reading;
+            continue;
+        }
+        
+        if (filter->due(reading.monotonic_ns)) {
+            AcquiredSample &out = batch[emitted];
+            out.slave_index = reading.slave_index;
+            out.ok = true;
+            out.error = 0;
+            out.request_ns = filter->newest_request_ns;
+            out.monotonic_ns = filter->newest_monotonic_ns;
+            out.realtime_ns = filter->newest_realtime_ns;
+            if (filter->emit(reading.monotonic_ns, out.sample, results[emitted])) {
+                emitted++;
+            }
+        }
+        filter->add(reading.sample, reading.request_ns, reading.monotonic_ns, reading.realtime_ns);
+    }
+    return emitted;
+}
+
+
+// Stage 2: logging, and the output thread's state around stages 0-2
+struct OutputStages {
+    bool oversample = false;            // Run stage 0
+    ModbusGateway *gateway = NULL;      // Publishes every sample when set
+    size_t gateway_unit_base = 0;       // Gateway unit of this bus's first slave
+    LoggerMetrics *metrics = NULL;      // Phase timings when set
+    AcquiredSample newest = {};         // Latest successful sample, for the dashboard
+    bool frame_pending = false;         // Set when `newest` changed, cleared by the caller
+
+    // Pops one batch of `bus`'s samples from `ring`, runs it through stages
+    // 0-2 and flushes the logs. Returns the number of samples popped.
+    size_t process(BusScheduler &bus, SampleRing &ring) {
+        size_t popped = ring.pop_batch(batch_, PIPELINE_BATCH);
+        size_t count = popped;
+        auto phase_start = std::chrono::steady_clock::now();
+        if (oversample) {
+            count = filter_samples(bus, batch_, count, filter_);
+        }
+        if (count > 0) {
+            compensate_samples(bus, batch_, count, smart_ec_, k_used_);
+            if (metrics != NULL) metrics->phases[PHASE_COMPUTE].observe_since(phase_start);
+        }
+        
+        phase_start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            log_sample(bus, i);
+        }
+        
+        // One flush per batch instead of one per row
+        int64_t now_ns = clock_ns(CLOCK_MONOTONIC);
+        for (auto &slave : bus.slaves) {
+            if (slave.log.is_open()) slave.log.flush();
+            if (slave.binary_log) slave.binary_log->sync_if_due(now_ns);
+        }
+        if (count > 0 && metrics != NULL) {
+            metrics->phases[PHASE_LOG].observe_since(phase_start);
+        }
+        return popped;
+    }
+
+private:
+    AcquiredSample batch_[PIPELINE_BATCH];
+    double smart_ec_[PIPELINE_BATCH];
+    double k_used_[PIPELINE_BATCH];
+    FilterResult filter_[PIPELINE_BATCH];
+    char csv_row_[CSV_ROW_MAX + CSV_FILTER_COLUMNS_MAX];
+    TimestampCache log_clock_;
+
+    void log_sample(BusScheduler &bus, size_t i) {
+        const AcquiredSample &acquired = batch_[i];
+        SlaveChannel &slave = bus.slaves[acquired.slave_index];
+        
+        // Read Sensor EC (41-42), Raw EC (45-46) and Temperature (60-61)
+        if (!acquired.ok) {
+            std::cerr << "⚠️  Slave " << slave.slave_id << ": failed to read registers "
+                      << bus.active_plan().describe() << ": " << modbus_strerror(acquired.error) << std::endl;
+            if (acquired.error == EMBXILADD && bus.use_fallback) {
+                std::cerr << "   Falling back to per-value reads" << std::endl;
+            }
+            return;
+        }
+        
+        const SensorSample &sample = acquired.sample;
+        slave.last = sample;
+        newest = acquired;
+        frame_pending = true;
+        
+        double temp = sample.value[FIELD_TEMPERATURE];
+        double raw_ec = sample.value[FIELD_RAW_EC];
+        double sensor_ec = sample.value[FIELD_SENSOR_EC];  // "The Wrong Value"
+        
+        // Smart EC from the batch compensation stage
+        double smart_ec = smart_ec_[i];
+        double k_used = k_used_[i];
+        
+        if (gateway != NULL) {
+            gateway->publish(gateway_unit_base + acquired.slave_index,
+                             make_gateway_reading(slave.slave_id, sample, smart_ec, k_used, slave.samples,
+                                                  acquired.monotonic_ns, acquired.realtime_ns));
+        }
+        
+        if (slave.rollups) {
+            slave.rollups->add(acquired.realtime_ns / 1000000000LL, temp, raw_ec, sensor_ec, smart_ec);
+        }
+        
+        if (slave.calibration) {
+            slave.calibration->add(temp, raw_ec);
+        }
+        
+        // Binary mode: one memcpy into the mapped file, no syscall per row
+        if (slave.binary_log) {
+            slave.binary_log->append(make_log_record(slave.slave_id, sample, acquired.monotonic_ns,
+                                                     acquired.realtime_ns, smart_ec, k_used));
+            return;
+        }
+        
+        // Log to CSV with hex validation columns
+        size_t length = format_csv_row(csv_row_, log_clock_, acquired.realtime_ns / 1000000000LL, sample, smart_ec);
+        if (slave.filter) {
+            length = append_filter_columns(csv_row_, length, sizeof(csv_row_), filter_[i]);
+        }
+        slave.log.write(csv_row_, length);
+    }
+};
+
+// ===========================
+// ONE BUS
+// ===========================
+// Everything per RS485 adapter: its scheduler, the ring its acquisition
+// thread (or the event loop) fills, the output stages that drain it, and
+// the metrics both record. Several buses live in a std::deque, which never
+// moves them.
+struct BusPipeline {
+    BusScheduler bus;
+    SampleRing ring;
+    OutputStages stages;
+    LoggerMetrics metrics;              // Transactions, errors, read/compute/log phases
+
+    BusPipeline(const std::string &port, int baud, const ReadPlan &plan, const ReadPlan &fallback_plan)
+        : bus(port, baud, plan, fallback_plan) {}
+};
+
+#endif // OUTPUT_STAGES_H
@@ -0,0 +1,297 @@
+#ifndef PORT_DISCOVERY_H
+#define PORT_DISCOVERY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <modbus.h>
+
+#ifndef _WIN32
+#include <climits>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+// ===========================
+// DISCOVERY SETTINGS
+// ===========================
+// Last-known-good port/slave pair (and baud rate), stored next to
+// ec_data_log.csv. It is probed first, so a warm start costs a single
+// transaction.
+const char *const SENSOR_CACHE_FILE = ".sensor_port_cache";
+
+struct DiscoveryOptions {
+    int baud = 9600;
+    int preferred_slave_id = 4;         // Factory default, probed on every port first
+    std::vector<int> slave_ids;         // Extra IDs to sweep if the preferred one is silent
+    int handshake_register = 60;        // Temperature (60-61) by default
+    int handshake_count = 2;            // 1 or 2 registers
+    uint32_t timeout_usec = 100000;     // 100ms per probe
+    std::vector<std::string> extra_ports;  // Probed in addition to the standard device nodes
+    bool use_cache = true;
+};
+
+struct SensorLocation {
+    std::string port;
+    int slave_id = -1;
+    int baud = 9600;
+    uint16_t handshake[2] = {0, 0};
+    bool from_cache = false;
+    double elapsed_ms = 0.0;
+};
+
+struct SerialCandidate {
+    std::string path;       // Path we open (by-id link when one exists)
+    std::string device;     // Resolved /dev node, used to drop duplicates
+    int priority;           // 0 = known RS485 adapter, 1 = USB/ACM, 2 = legacy ttyS
+};
+
+// ===========================
+// CANDIDATE PORT LIST
+// ===========================
+inline std::vector<std::string> get_candidate_ports() {
+    std::vector<std::string> ports;
+
+    #ifdef _WIN32
+    // Windows: Scan COM1 to COM20
+    // NOTE: Ports above COM9 require the "\\\\.\\" prefix
+    for (int i = 1; i <= 20; i++) {
+        ports.push_back("\\\\.\\COM" + std::to_string(i));
+    }
+    #else
+    // Stable udev names first (survive ttyUSB renumbering)
+    DIR *dir = opendir("/dev/serial/by-id");
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            ports.push_back(std::string("/dev/serial/by-id/") + entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    // USB passthrough (WSL2) and native Linux adapters
+    for (int i = 0; i < 10; i++) {
+        ports.push_back("/dev/ttyUSB" + std::to_string(i));
+        ports.push_back("/dev/ttyACM" + std::to_string(i));
+    }
+
+    // /dev/ttyS0 through /dev/ttyS20 (WSL1/Legacy mode)
+    for (int i = 0; i <= 20; i++) {
+        ports.push_back("/dev/ttyS" + std::to_string(i));
+    }
+    #endif
+
+    return ports;
+}
+
+// ===========================
+// CANDIDATE PRE-FILTER
+// ===========================
+// Drops device nodes that cannot be our sensor before any Modbus traffic:
+//   - nodes that do not exist
+//   - by-id duplicates of the same /dev node
+//   - legacy 8250 ports that udev reports as having no UART (type == 0).
+//     WSL1 maps COM ports to ttyS without sysfs entries, so those are kept.
+#ifndef _WIN32
+inline bool is_phantom_serial_port(const std::string &device) {
+    std::string name = device.substr(device.find_last_of('/') + 1);
+    std::ifstream type_file("/sys/class/tty/" + name + "/type");
+    int type = -1;
+    if (type_file >> type) {
+        return type == 0;
+    }
+    return false;
+}
+
+inline bool is_known_adapter(const std::string &path) {
+    // QinHeng CH340/CH341 (VID 1a86), the adapter run_test.bat attaches
+    std::string lower = path;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower.find("1a86") != std::string::npos || lower.find("ch34") != std::string::npos;
+}
+#endif
+
+inline std::vector<SerialCandidate> filter_candidate_ports(const std::vector<std::string> &ports) {
+    std::vector<SerialCandidate> candidates;
+
+    for (const auto &port : ports) {
+        #ifdef _WIN32
+        candidates.push_back({port, port, 1});
+        #else
+        char resolved[PATH_MAX];
+        if (realpath(port.c_str(), resolved) == NULL) continue;  // Does not exist
+        std::string device = resolved;
+
+        bool duplicate = false;
+        for (const auto &c : candidates) {
+            if (c.device == device) duplicate = true;
+        }
+        if (duplicate || is_phantom_serial_port(device)) continue;
+
+        int priority = 2;
+        if (is_known_adapter(port)) {
+            priority = 0;
+        } else if (device.find("ttyS") == std::string::npos) {
+            priority = 1;
+        }
+        candidates.push_back({port, device, priority});
+        #endif
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const SerialCandidate &a, const SerialCandidate &b) {
+                         return a.priority < b.priority;
+                     });
+    return candidates;
+}
+
+// ===========================
+// SINGLE PORT PROBE
+// ===========================
+// Opens the port once and sweeps the slave IDs on the same context, instead
+// of rebuilding the context for every ID.
+inline bool probe_port(const std::string &port, const std::vector<int> &slave_ids,
+                       const DiscoveryOptions &options, const std::atomic<bool> &stop,
+                       SensorLocation &out) {
+    modbus_t *ctx = modbus_new_rtu(port.c_str(), options.baud, 'N', 8, 1);
+    if (ctx == NULL) return false;
+    out.baud = options.baud;
+
+    modbus_set_response_timeout(ctx, 0, options.timeout_usec);
+
+    bool found = false;
+    if (modbus_connect(ctx) != -1) {
+        for (int slave_id : slave_ids) {
+            if (stop) break;
+
+            modbus_set_slave(ctx, slave_id);
+            int rc = modbus_read_registers(ctx, options.handshake_register,
+                                           options.handshake_count, out.handshake);
+            if (rc != -1) {
+                out.port = port;
+                out.slave_id = slave_id;
+                found = true;
+                break;
+            }
+            // A late reply to the previous ID must not corrupt the next probe
+            modbus_flush(ctx);
+        }
+        modbus_close(ctx);
+    }
+    modbus_free(ctx);
+    return found;
+}
+
+// ===========================
+// PARALLEL PROBE
+// ===========================
+// One thread per candidate port. The first port to answer wins and tells the
+// others to stop after their current transaction, so the whole scan costs
+// about one timeout per slave ID instead of one per port.
+inline bool probe_ports_parallel(const std::vector<SerialCandidate> &candidates,
+                                 const std::vector<int> &slave_ids,
+                                 const DiscoveryOptions &options, SensorLocation &out) {
+    if (candidates.empty() || slave_ids.empty()) return false;
+
+    std::atomic<bool> found(false);
+    std::mutex result_mutex;
+    std::vector<std::thread> workers;
+
+    for (const auto &candidate : candidates) {
+        workers.emplace_back([&, candidate]() {
+            SensorLocation location;
+            if (probe_port(candidate.path, slave_ids, options, found, location)) {
+                std::lock_guard<std::mutex> lock(result_mutex);
+                if (!found.exchange(true)) {
+                    out = location;
+                }
+            }
+        });
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    return found;
+}
+
+// ===========================
+// LAST-KNOWN-GOOD CACHE
+// ===========================
+// "PORT SLAVE [BAUD]": files written before link tuning have no baud, so
+// `baud` keeps its value when the third field is missing.
+inline bool load_cached_location(std::string &port, int &slave_id, int &baud) {
+    std::ifstream cache(SENSOR_CACHE_FILE);
+    if (!(cache >> port >> slave_id)) return false;
+    int cached_baud;
+    if (cache >> cached_baud && cached_baud > 0) baud = cached_baud;
+    return true;
+}
+
+inline void save_cached_location(const SensorLocation &location) {
+    std::ofstream cache(SENSOR_CACHE_FILE, std::ios::trunc);
+    cache << location.port << " " << location.slave_id << " " << location.baud << "\n";
+}
+
+// ===========================
+// DISCOVERY ENGINE
+// ===========================
+// 1. Cached port/slave at the cached baud rate (one transaction on a warm start),
+//    only when the cached slave is one of the requested IDs: the cache is
+//    shared with auto_detect_sensor, which may have found another slave
+// 2. Preferred slave ID on every candidate port in parallel
+// 3. Remaining slave IDs on every candidate port in parallel
+inline SensorLocation discover_sensor(const DiscoveryOptions &options) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&start]() {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+    };
+
+    SensorLocation location;
+    std::atomic<bool> never_stop(false);
+
+    std::string cached_port;
+    int cached_slave = -1;
+    DiscoveryOptions cached = options;
+    if (options.use_cache && load_cached_location(cached_port, cached_slave, cached.baud)) {
+        bool requested = cached_slave == options.preferred_slave_id
+            || std::find(options.slave_ids.begin(), options.slave_ids.end(), cached_slave) != options.slave_ids.end();
+        if (requested && probe_port(cached_port, {cached_slave}, cached, never_stop, location)) {
+            location.from_cache = true;
+            location.elapsed_ms = elapsed_ms();
+            return location;
+        }
+    }
+
+    std::vector<std::string> ports = options.extra_ports;
+    std::vector<std::string> standard = get_candidate_ports();
+    ports.insert(ports.end(), standard.begin(), standard.end());
+    std::vector<SerialCandidate> candidates = filter_candidate_ports(ports);
+
+    std::vector<int> sweep;
+    for (int id : options.slave_ids) {
+        if (id != options.preferred_slave_id) sweep.push_back(id);
+    }
+
+    if (probe_ports_parallel(candidates, {options.preferred_slave_id}, options, location)
+        || probe_ports_parallel(candidates, sweep, options, location)) {
+        if (options.use_cache) save_cached_location(location);
+    } else {
+        location = SensorLocation();
+    }
+
+    location.elapsed_ms = elapsed_ms();
+    return location;
+}
+
+#endif // PORT_DISCOVERY_H
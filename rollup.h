@@ -0,0 +1,261 @@
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ===========================
+// ROLLUP TIERS
+// ===========================
+// Streaming downsampling of the logged values into 1 minute, 1 hour and
+// 1 day buckets, so long time ranges never need the raw log again.
+//
+// Every tier is a fixed-size ring of buckets in its own memory-mapped file.
+// A bucket's slot is derived from its start time (start / width % capacity),
+// which makes each update O(1) and makes retention automatic: a slot is
+// reused once its bucket is `capacity` widths old. Buckets are aligned to
+// UTC (the daily tier runs midnight to midnight UTC).
+//
+// A non-finite value (a NaN from a failed decode, an infinite EC from a
+// zero compensation factor) is counted as skipped and left out of that
+// metric's stats only, so one bad reading cannot poison a day's mean.
+enum RollupMetric {
+    ROLLUP_TEMPERATURE = 0,
+    ROLLUP_RAW_EC,
+    ROLLUP_SENSOR_EC,
+    ROLLUP_SMART_EC,
+    ROLLUP_DEVIATION,
+    ROLLUP_METRIC_COUNT
+};
+
+const char *const ROLLUP_METRIC_NAMES[ROLLUP_METRIC_COUNT] = {
+    "Temperature", "Raw_EC", "Sensor_Default_EC", "Smart_Calc_EC", "Deviation"
+};
+
+enum RollupTierIndex {
+    TIER_MINUTE = 0,
+    TIER_HOUR,
+    TIER_DAY,
+    TIER_COUNT
+};
+
+struct RollupTier {
+    const char *name;           // File suffix and query name
+    int64_t width_s;
+    int retention_days;
+};
+
+// Defaults: about 1.7 MB, 0.4 MB and 0.6 MB per slave
+const RollupTier DEFAULT_ROLLUP_TIERS[TIER_COUNT] = {
+    {"1m", 60, 7},
+    {"1h", 3600, 90},
+    {"1d", 86400, 3650},
+};
+
+// ===========================
+// ROLLUP FILE FORMAT (v2)
+// ===========================
+// v2 added the per-metric count and skipped fields; v1 files are refused.
+const char ROLLUP_MAGIC[8] = {'E', 'C', 'R', 'O', 'L', 'L', 'U', 'P'};
+const uint32_t ROLLUP_VERSION = 2;
+
+struct RollupHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bucket_size;
+    int64_t width_s;
+    uint64_t capacity;          // Buckets in the ring
+    uint8_t reserved[32];
+};
+
+struct RollupStats {
+    double min;                 // min, max and last are only valid if count > 0
+    double max;
+    double sum;
+    double last;
+    uint32_t count;             // Finite values
+    uint32_t skipped;           // Non-finite values left out
+};
+
+struct RollupBucket {
+    int64_t start_s;            // Unix time the bucket starts at, 0 = empty slot
+    uint32_t count;             // Samples, finite or not
+    uint32_t reserved;
+    RollupStats stats[ROLLUP_METRIC_COUNT];
+
+    double mean(int metric) const {
+        return stats[metric].count > 0 ? stats[metric].sum / stats[metric].count : NAN;
+    }
+};
+
+static_assert(sizeof(RollupHeader) == 64, "RollupHeader must stay 64 bytes");
+static_assert(sizeof(RollupBucket) == 216, "RollupBucket layout changed");
+
+// ===========================
+// ONE TIER (one file)
+// ===========================
+struct RollupFile {
+    int fd = -1;
+    char *map = NULL;
+    size_t map_size = 0;
+    int64_t width_s = 0;
+    uint64_t capacity = 0;
+    std::string path;
+
+    RollupFile() {}
+    RollupFile(const RollupFile &) = delete;
+    RollupFile &operator=(const RollupFile &) = delete;
+
+    ~RollupFile() {
+        close();
+    }
+
+    RollupBucket *buckets() const {
+        return reinterpret_cast<RollupBucket *>(map + sizeof(RollupHeader));
+    }
+
+    // Opens or creates a tier. writable = false maps it read-only (queries).
+    // An existing file keeps its own width and capacity; a different
+    // retention only applies to newly created files.
+    bool open(const std::string &file_path, int64_t width, uint64_t buckets_wanted, bool writable) {
+        path = file_path;
+        fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+        if (fd == -1) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) return false;
+
+        RollupHeader h;
+        bool fresh = st.st_size < (off_t)sizeof(RollupHeader);
+        if (fresh) {
+            if (!writable) {
+                errno = EINVAL;
+                return false;
+            }
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, ROLLUP_MAGIC, sizeof(h.magic));
+            h.version = ROLLUP_VERSION;
+            h.bucket_size = sizeof(RollupBucket);
+            h.width_s = width;
+            h.capacity = buckets_wanted;
+            if (ftruncate(fd, sizeof(RollupHeader) + buckets_wanted * sizeof(RollupBucket)) == -1
+                || pwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+                return false;
+            }
+        } else if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)
+                   || memcmp(h.magic, ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC)) != 0
+                   || h.version != ROLLUP_VERSION || h.bucket_size != sizeof(RollupBucket) || h.width_s <= 0 || h.capacity == 0
+                   || st.st_size < (off_t)(sizeof(RollupHeader) + h.capacity * sizeof(RollupBucket))) {
+            errno = EINVAL;  // Not a rollup file, or an incompatible layout
+            return false;
+        }
+
+        width_s = h.width_s;
+        capacity = h.capacity;
+        map_size = sizeof(RollupHeader) + capacity * sizeof(RollupBucket);
+        void *m = mmap(NULL, map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED) return false;
+        map = static_cast<char *>(m);
+        return true;
+    }
+
+    int64_t bucket_start(int64_t unix_s) const {
+        int64_t start = unix_s - unix_s % width_s;
+        return unix_s < 0 && start != unix_s ? start - width_s : start;
+    }
+
+    RollupBucket &slot(int64_t start_s) const {
+        return buckets()[(uint64_t)(start_s / width_s) % capacity];
+    }
+
+    // The bucket starting at start_s, or NULL if it was never written or
+    // has already been overwritten by a newer one.
+    const RollupBucket *find(int64_t start_s) const {
+        const RollupBucket &b = slot(start_s);
+        return b.start_s == start_s && b.count > 0 ? &b : NULL;
+    }
+
+    void add(int64_t unix_s, const double *values) {
+        int64_t start = bucket_start(unix_s);
+        RollupBucket &b = slot(start);
+
+        if (b.start_s != start) {
+            if (b.start_s > start) return;  // Clock stepped back past retention
+            memset(&b, 0, sizeof(b));
+            b.start_s = start;
+        }
+
+        for (int m = 0; m < ROLLUP_METRIC_COUNT; m++) {
+            RollupStats &s = b.stats[m];
+            double v = values[m];
+            if (!std::isfinite(v)) {
+                s.skipped++;
+                continue;
+            }
+            if (s.count == 0 || v < s.min) s.min = v;
+            if (s.count == 0 || v > s.max) s.max = v;
+            s.sum += v;
+            s.last = v;
+            s.count++;
+        }
+        b.count++;
+    }
+
+    void close() {
+        if (map != NULL) {
+            msync(map, map_size, MS_ASYNC);
+            munmap(map, map_size);
+            map = NULL;
+        }
+        if (fd != -1) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+// ===========================
+// ALL TIERS OF ONE SLAVE
+// ===========================
+// Files: <prefix>_1m.bin, <prefix>_1h.bin, <prefix>_1d.bin
+inline std::string rollup_tier_path(const std::string &prefix, int tier) {
+    return prefix + "_" + DEFAULT_ROLLUP_TIERS[tier].name + ".bin";
+}
+
+struct RollupStore {
+    RollupFile tiers[TIER_COUNT];
+
+    bool open(const std::string &prefix, const int *retention_days) {
+        for (int t = 0; t < TIER_COUNT; t++) {
+            const RollupTier &tier = DEFAULT_ROLLUP_TIERS[t];
+            uint64_t buckets = (uint64_t)retention_days[t] * 86400 / tier.width_s;
+            if (!tiers[t].open(rollup_tier_path(prefix, t), tier.width_s, buckets > 0 ? buckets : 1, true)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        for (int t = 0; t < TIER_COUNT; t++) {
+            tiers[t].close();
+        }
+    }
+
+    // O(1): one bucket update per tier
+    void add(int64_t unix_s, double temp, double raw_ec, double sensor_ec, double smart_ec) {
+        double values[ROLLUP_METRIC_COUNT] = {temp, raw_ec, sensor_ec, smart_ec, sensor_ec - smart_ec};
+        for (int t = 0; t < TIER_COUNT; t++) {
+            tiers[t].add(unix_s, values);
+        }
+    }
+};
+
+#endif // ROLLUP_H
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "rollup.h"
+
+// ===========================
+// ROLLUP QUERY TOOL
+// ===========================
+// Prints the rollup buckets of a time range as CSV, reading only the tier
+// that fits the range:
+//
+//   ./rollup_query                              # last 24 h, tier picked automatically
+//   ./rollup_query --from 365d --tier 1d        # one row per day for a year
+//   ./rollup_query ec_rollup_slave5 --from "2026-03-01" --to "2026-03-02 12:00"
+//
+// Times are UTC: YYYY-MM-DD[ HH:MM[:SS]], or relative to now (30m, 12h, 7d).
+//
+// Usage: ./rollup_query [PREFIX] [--tier 1m|1h|1d|auto] [--from TIME] [--to TIME]
+
+const long AUTO_TIER_MAX_BUCKETS = 1500;    // Finest tier that stays under this many rows
+
+bool parse_time(const std::string &text, int64_t now, int64_t &out) {
+    char unit;
+    long amount;
+    if (sscanf(text.c_str(), "%ld%c", &amount, &unit) == 2 && text.find('-') == std::string::npos) {
+        int64_t seconds = unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0;
+        if (seconds == 0) return false;
+        out = now - amount * seconds;
+        return true;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(text.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if (end == NULL) end = strptime(text.c_str(), "%Y-%m-%d %H:%M", &tm);
+    if (end == NULL) end = strptime(text.c_str(), "%Y-%m-%d", &tm);
+    if (end == NULL || *end != '\0') return false;
+    out = timegm(&tm);
+    return true;
+}
+
+std::string format_utc(int64_t unix_s) {
+    time_t t = (time_t)unix_s;
+    struct tm tm;
+    char buf[32];
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    std::string prefix = "ec_rollup";
+    std::string tier_name = "auto";
+    int64_t now = time(NULL);
+    int64_t from = now - 86400, to = now;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--tier" && i + 1 < argc) {
+            tier_name = argv[++i];
+        } else if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+            if (!parse_time(argv[++i], now, arg == "--from" ? from : to)) {
+                std::cerr << "❌ Cannot parse time: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (arg[0] != '-') {
+            prefix = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [PREFIX] [--tier 1m|1h|1d|auto] [--from TIME] [--to TIME]\n"
+                      << "       TIME: YYYY-MM-DD[ HH:MM[:SS]] (UTC) or 30m, 12h, 7d ago" << std::endl;
+            return -1;
+        }
+    }
+    if (to < from) {
+        std::cerr << "❌ --to is before --from" << std::endl;
+        return -1;
+    }
+
+    // Pick the tier: the one asked for, or the finest tier that still holds
+    // `from` and answers with at most AUTO_TIER_MAX_BUCKETS rows
+    RollupFile files[TIER_COUNT];
+    int chosen = -1;
+    for (int t = 0; t < TIER_COUNT; t++) {
+        const RollupTier &tier = DEFAULT_ROLLUP_TIERS[t];
+        bool requested = (tier_name == tier.name);
+        if (tier_name != "auto" && !requested) continue;
+
+        if (!files[t].open(rollup_tier_path(prefix, t), tier.width_s, 1, false)) {
+            if (requested) {
+                std::cerr << "❌ Cannot open " << rollup_tier_path(prefix, t) << ": " << strerror(errno) << std::endl;
+                return -1;
+            }
+            continue;
+        }
+
+        int64_t retained_from = files[t].bucket_start(now) - (int64_t)(files[t].capacity - 1) * files[t].width_s;
+        long buckets = (long)((to - from) / files[t].width_s) + 1;
+        if (requested || (from >= retained_from && buckets <= AUTO_TIER_MAX_BUCKETS)) {
+            chosen = t;
+            break;
+        }
+        if (chosen == -1 || t > chosen) chosen = t;     // Coarsest available as last resort
+    }
+    if (chosen == -1) {
+        std::cerr << "❌ No rollup files found for prefix " << prefix
+                  << " (run smart_logger with --rollups)" << std::endl;
+        return -1;
+    }
+
+    const RollupFile &file = files[chosen];
+    std::cerr << "📊 Tier " << DEFAULT_ROLLUP_TIERS[chosen].name << " (" << file.path << "), "
+              << format_utc(from) << " to " << format_utc(to) << " UTC" << std::endl;
+
+    std::cout << "Bucket_Start_UTC,Count";
+    for (int m = 0; m < ROLLUP_METRIC_COUNT; m++) {
+        const char *name = ROLLUP_METRIC_NAMES[m];
+        std::cout << "," << name << "_Min," << name << "_Max," << name << "_Mean," << name << "_Last,"
+                  << name << "_Skipped";
+    }
+    std::cout << "\n";
+
+    long rows = 0;
+    for (int64_t start = file.bucket_start(from); start <= to; start += file.width_s) {
+        const RollupBucket *b = file.find(start);
+        if (b == NULL) continue;
+
+        std::cout << format_utc(start) << "," << b->count;
+        for (int m = 0; m < ROLLUP_METRIC_COUNT; m++) {
+            const RollupStats &s = b->stats[m];
+            if (s.count > 0) {
+                std::cout << "," << s.min << "," << s.max << "," << b->mean(m) << "," << s.last;
+            } else {
+                std::cout << ",,,,";    // Every value of this metric was skipped
+            }
+            std::cout << "," << s.skipped;
+        }
+        std::cout << "\n";
+        rows++;
+    }
+    std::cerr << "   " << rows << " bucket(s)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,421 @@
+#ifndef RTU_EVENT_LOOP_H
+#define RTU_EVENT_LOOP_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+#include <modbus.h>
+#include "modbus_crc.h"
+#include "bus_scheduler.h"
+
+// ===========================
+// EVENT-DRIVEN RTU ACQUISITION
+// ===========================
+// BusScheduler::poll_once blocks inside libmodbus for every transaction, so
+// each serial adapter needs a thread that mostly waits for the line.
+// RtuEventLoop serves any number of adapters from one thread: every port is
+// a non-blocking descriptor plus a timerfd in one epoll set, and a small
+// state machine per port does what libmodbus does for FC03 reads (framing,
+// CRC check, exception replies, response and byte timeouts). While one
+// adapter waits for its slave, the others keep their transactions going.
+//
+// The schedule is unchanged: each port keeps its BusScheduler, which picks
+// the next slave, keeps deadlines, retries and adaptive periods, and records
+// the metrics. Failed reads carry the errno values libmodbus would set
+// (ETIMEDOUT, EMBBADCRC, MODBUS_ENOBASE + exception code, ...), so
+// fall_back_if_refused() and modbus_strerror() work as before.
+//
+// Port states:
+//   RTU_IDLE            timer = due time of the next slave
+//   RTU_SENDING         request partly written, waiting for EPOLLOUT
+//   RTU_AWAITING_REPLY  timer = response timeout, then byte timeout once
+//                       the first bytes are in
+// Fixed buffers only: the loop does not allocate once the ports are added.
+const uint8_t RTU_FC_READ_HOLDING = 3;
+const size_t RTU_REQUEST_BYTES = 8;         // slave + fc + addr(2) + count(2) + crc(2)
+const size_t RTU_EXCEPTION_REPLY_BYTES = 5; // slave + fc|0x80 + code + crc(2)
+const size_t RTU_MAX_ADU = 256;
+const int64_t RTU_DEFAULT_BYTE_TIMEOUT_NS = 500000000;  // libmodbus default
+const int EVENT_LOOP_MAX_EVENTS = 32;
+
+// B-constant of a baud rate, B0 if termios has none
+inline speed_t rtu_speed(int baud) {
+    switch (baud) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        default: return B0;
+    }
+}
+
+// Opens a serial port as 8N1 raw, like modbus_connect() does, but
+// non-blocking. Returns the descriptor, or -1 with errno set.
+inline int open_rtu_port(const std::string &path, int baud) {
+    speed_t speed = rtu_speed(baud);
+    if (speed == B0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(PARENB | CSTOPB | CSIZE);
+    tio.c_cflag |= CS8 | CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+enum RtuPortState {
+    RTU_IDLE = 0,
+    RTU_SENDING,
+    RTU_AWAITING_REPLY
+};
+
+// One adapter: its bus, descriptors and the transaction in flight
+struct RtuPort {
+    BusScheduler *bus = NULL;
+    uint64_t key = 0;                   // epoll data: port index * 2 (+1 for the timer)
+    int fd = -1;
+    int timer_fd = -1;
+    int64_t response_timeout_ns = 0;
+    int64_t byte_timeout_ns = RTU_DEFAULT_BYTE_TIMEOUT_NS;
+    RtuPortState state = RTU_IDLE;
+    bool hung_up = false;               // Adapter gone: no longer watched, polls fail
+
+    // Current poll
+    size_t slave_idx = 0;
+    const ReadPlan *plan = NULL;
+    size_t first_block = 0;
+    size_t block = 0;
+    int64_t block_start_ns = 0;
+    int64_t block_ns[FIELD_COUNT];
+    AcquiredSample acquired;
+
+    uint8_t tx[RTU_REQUEST_BYTES];
+    size_t tx_sent = 0;
+    uint8_t rx[RTU_MAX_ADU];
+    size_t rx_len = 0;
+
+    long transactions = 0;              // Block reads attempted
+};
+
+// ===========================
+// EVENT LOOP
+// ===========================
+class RtuEventLoop {
+public:
+    RtuEventLoop() {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    ~RtuEventLoop() {
+        for (auto &p : ports_) {
+            if (p.fd != -1) close(p.fd);
+            if (p.timer_fd != -1) close(p.timer_fd);
+        }
+        if (epoll_fd_ != -1) close(epoll_fd_);
+    }
+
+    // Opens bus.port at bus.baud. Replaces bus.connect(): the BusScheduler
+    // keeps its schedule, but its modbus_t is not used. byte_timeout_usec = 0
+    // keeps the libmodbus default (500 ms).
+    bool add_port(BusScheduler &bus, uint32_t response_timeout_usec, uint32_t byte_timeout_usec = 0) {
+        if (epoll_fd_ == -1) return false;
+        int fd = open_rtu_port(bus.port, bus.baud);
+        if (fd == -1) return false;
+        int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd == -1) {
+            close(fd);
+            return false;
+        }
+
+        ports_.emplace_back();
+        RtuPort &p = ports_.back();
+        p.bus = &bus;
+        p.key = (uint64_t)(ports_.size() - 1) * 2;
+        p.fd = fd;
+        p.timer_fd = timer_fd;
+        p.response_timeout_ns = (int64_t)response_timeout_usec * 1000;
+        if (byte_timeout_usec > 0) {
+            p.byte_timeout_ns = (int64_t)byte_timeout_usec * 1000;
+        }
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = p.key;
+        struct epoll_event timer_ev = {};
+        timer_ev.events = EPOLLIN;
+        timer_ev.data.u64 = p.key + 1;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == -1
+            || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd, &timer_ev) == -1) {
+            int saved_errno = errno;
+            close(fd);
+            close(timer_fd);
+            ports_.pop_back();
+            errno = saved_errno;
+            return false;
+        }
+        return true;
+    }
+
+    size_t port_count() const {
+        return ports_.size();
+    }
+
+    const RtuPort &port(size_t i) const {
+        return ports_[i];
+    }
+
+    // Arms every port for its first poll. Call after each bus.start().
+    void start() {
+        for (auto &p : ports_) {
+            arm_next_poll(p);
+        }
+    }
+
+    // Waits up to timeout_ms for the next event and handles every event
+    // that is ready. on_sample(bus, acquired) runs once per finished poll,
+    // on this thread. Returns the number of events, -1 on error.
+    template <typename Callback>
+    int run_once(int timeout_ms, Callback on_sample) {
+        struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+        int n = epoll_wait(epoll_fd_, events, EVENT_LOOP_MAX_EVENTS, timeout_ms);
+        if (n == -1) {
+            return errno == EINTR ? 0 : -1;
+        }
+        for (int i = 0; i < n; i++) {
+            RtuPort &p = ports_[events[i].data.u64 / 2];
+            if (events[i].data.u64 % 2 == 1) {
+                on_timer(p, on_sample);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                on_writable(p, on_sample);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                on_readable(p, events[i].events, on_sample);
+            }
+        }
+        return n;
+    }
+
+private:
+    int epoll_fd_ = -1;
+    std::deque<RtuPort> ports_;         // deque: ports never move once added
+
+    // Absolute CLOCK_MONOTONIC deadline; a deadline in the past fires at once
+    void arm_timer(RtuPort &p, int64_t deadline_ns) {
+        deadline_ns = std::max<int64_t>(deadline_ns, 1);   // 0 would disarm
+        struct itimerspec its = {};
+        its.it_value.tv_sec = deadline_ns / 1000000000LL;
+        its.it_value.tv_nsec = deadline_ns % 1000000000LL;
+        timerfd_settime(p.timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+
+    void watch_writable(RtuPort &p, bool writable) {
+        if (p.hung_up) return;
+        struct epoll_event ev = {};
+        ev.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.u64 = p.key;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, p.fd, &ev);
+    }
+
+    void arm_next_poll(RtuPort &p) {
+        p.state = RTU_IDLE;
+        arm_timer(p, p.bus->slaves[p.bus->next_slave()].next_due_ns);
+    }
+
+    // Same slave selection and bookkeeping as BusScheduler::poll_once
+    void begin_poll(RtuPort &p) {
+        BusScheduler &bus = *p.bus;
+        p.slave_idx = bus.next_slave();
+        p.plan = &bus.active_plan();
+        p.first_block = bus.slaves[p.slave_idx].resume_block;
+        p.block = p.first_block;
+        p.acquired.request_ns = bus.begin_poll(p.slave_idx);
+    }
+
+    template <typename Callback>
+    void send_request(RtuPort &p, Callback &on_sample) {
+        const ReadBlock &block = p.plan->blocks[p.block];
+        p.tx[0] = (uint8_t)p.bus->slaves[p.slave_idx].slave_id;
+        p.tx[1] = RTU_FC_READ_HOLDING;
+        p.tx[2] = (uint8_t)(block.address >> 8);
+        p.tx[3] = (uint8_t)(block.address & 0xFF);
+        p.tx[4] = (uint8_t)(block.count >> 8);
+        p.tx[5] = (uint8_t)(block.count & 0xFF);
+        uint16_t crc = modbus_crc16(p.tx, 6);
+        p.tx[6] = (uint8_t)(crc & 0xFF);
+        p.tx[7] = (uint8_t)(crc >> 8);
+
+        tcflush(p.fd, TCIFLUSH);        // Leftovers of a reply that timed out
+        p.tx_sent = 0;
+        p.rx_len = 0;
+        p.transactions++;
+        p.block_start_ns = clock_ns(CLOCK_MONOTONIC);
+        p.state = RTU_SENDING;
+        arm_timer(p, p.block_start_ns + p.response_timeout_ns);
+        on_writable(p, on_sample);
+    }
+
+    template <typename Callback>
+    void on_writable(RtuPort &p, Callback &on_sample) {
+        if (p.state != RTU_SENDING) {
+            watch_writable(p, false);
+            return;
+        }
+        while (p.tx_sent < RTU_REQUEST_BYTES) {
+            ssize_t n = write(p.fd, p.tx + p.tx_sent, RTU_REQUEST_BYTES - p.tx_sent);
+            if (n > 0) {
+                p.tx_sent += (size_t)n;
+            } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch_writable(p, true);
+                return;
+            } else if (n == -1 && errno == EINTR) {
+                continue;
+            } else {
+                finish_block(p, errno, on_sample);
+                return;
+            }
+        }
+        if (p.tx_sent == RTU_REQUEST_BYTES) {
+            watch_writable(p, false);
+        }
+        // The response timeout runs from the end of the request
+        p.state = RTU_AWAITING_REPLY;
+        arm_timer(p, clock_ns(CLOCK_MONOTONIC) + p.response_timeout_ns);
+    }
+
+    template <typename Callback>
+    void on_readable(RtuPort &p, uint32_t events, Callback &on_sample) {
+        uint8_t discard[RTU_MAX_ADU];
+        while (true) {
+            bool wanted = p.state == RTU_AWAITING_REPLY && p.rx_len < RTU_MAX_ADU;
+            uint8_t *dst = wanted ? p.rx + p.rx_len : discard;
+            size_t room = wanted ? RTU_MAX_ADU - p.rx_len : sizeof(discard);
+            ssize_t n = read(p.fd, dst, room);
+            if (n > 0) {
+                if (wanted) p.rx_len += (size_t)n;
+                continue;
+            }
+            if (n == -1 && errno == EINTR) continue;
+            // VMIN = VTIME = 0: an empty line reads 0 bytes, not EAGAIN
+            bool failed = n == -1 && errno != EAGAIN && errno != EWOULDBLOCK;
+            if (!p.hung_up && (failed || (events & EPOLLHUP))) {
+                // Adapter unplugged (or pty closed): EPOLLHUP would fire on
+                // every wait, so stop watching it. Its polls fail from now on.
+                p.hung_up = true;
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, p.fd, NULL);
+            }
+            break;
+        }
+        if (p.state != RTU_AWAITING_REPLY || p.rx_len == 0) return;
+
+        size_t expected = expected_reply_bytes(p);
+        if (expected > 0 && p.rx_len >= expected) {
+            finish_block(p, check_reply(p, expected), on_sample);
+        } else {
+            arm_timer(p, clock_ns(CLOCK_MONOTONIC) + p.byte_timeout_ns);
+        }
+    }
+
+    template <typename Callback>
+    void on_timer(RtuPort &p, Callback &on_sample) {
+        uint64_t expirations;
+        if (read(p.timer_fd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) {
+            return;                     // Re-armed since the event was queued
+        }
+        if (p.state == RTU_IDLE) {
+            begin_poll(p);
+            send_request(p, on_sample);
+        } else {
+            finish_block(p, ETIMEDOUT, on_sample);
+        }
+    }
+
+    // Reply length once its first bytes are in, 0 while still unknown
+    static size_t expected_reply_bytes(const RtuPort &p) {
+        if (p.rx_len < 2) return 0;
+        if (p.rx[1] & 0x80) return RTU_EXCEPTION_REPLY_BYTES;
+        if (p.rx_len < 3) return 0;
+        return std::min<size_t>(5 + p.rx[2], RTU_MAX_ADU);
+    }
+
+    // 0, or the errno libmodbus would report for this reply
+    static int check_reply(const RtuPort &p, size_t length) {
+        uint16_t crc = modbus_crc16(p.rx, length - 2);
+        if (crc != (uint16_t)(p.rx[length - 2] | (p.rx[length - 1] << 8))) return EMBBADCRC;
+        if (p.rx[0] != p.tx[0]) return EMBBADSLAVE;
+        if (p.rx[1] == (RTU_FC_READ_HOLDING | 0x80)) return MODBUS_ENOBASE + p.rx[2];
+        if (p.rx[1] != RTU_FC_READ_HOLDING) return EMBBADDATA;
+        if (p.rx[2] != 2 * p.plan->blocks[p.block].count) return EMBBADDATA;
+        return 0;
+    }
+
+    // Ends the transaction of p.block: decodes it and sends the next block,
+    // or completes the poll (success, or the block that failed).
+    template <typename Callback>
+    void finish_block(RtuPort &p, int error, Callback &on_sample) {
+        BusScheduler &bus = *p.bus;
+        SlaveChannel &s = bus.slaves[p.slave_idx];
+        p.block_ns[p.block] = clock_ns(CLOCK_MONOTONIC) - p.block_start_ns;
+        if (p.state == RTU_SENDING) {
+            watch_writable(p, false);
+        }
+
+        int failed_block = -1;
+        if (error == 0) {
+            const ReadBlock &block = p.plan->blocks[p.block];
+            uint16_t block_data[MODBUS_MAX_READ_REGISTERS];
+            for (int i = 0; i < block.count; i++) {
+                block_data[i] = (uint16_t)((p.rx[3 + 2 * i] << 8) | p.rx[4 + 2 * i]);
+            }
+            decode_block(*p.plan, block, block_data, s.partial);
+            p.block++;
+            if (p.block < p.plan->blocks.size()) {
+                send_request(p, on_sample);
+                return;
+            }
+        } else {
+            failed_block = (int)p.block;
+        }
+
+        p.acquired.error = error;
+        bus.finish_poll(p.slave_idx, *p.plan, p.block_ns, p.first_block, failed_block, p.acquired);
+        on_sample(bus, p.acquired);
+        arm_next_poll(p);
+    }
+};
+
+#endif // RTU_EVENT_LOOP_H
@@ -154,7 +154,7 @@ echo.
 echo ============================================================================
 echo  If the program is missing or outdated, compile manually in WSL:
 echo.
-echo    g++ smart_logger.cpp -o smart_logger -I/usr/include/modbus -lmodbus
+echo    g++ -pthread smart_logger.cpp -o smart_logger -I/usr/include/modbus -lmodbus
 echo.
 echo ============================================================================
 echo.
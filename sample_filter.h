@@ -0,0 +1,227 @@
+#ifndef SAMPLE_FILTER_H
+#define SAMPLE_FILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <modbus.h>
+#include "sensor_registers.h"
+
+// ===========================
+// OVERSAMPLING FILTER
+// ===========================
+// With --oversample the slaves are polled as fast as the bus allows and the
+// readings of each output period are reduced to one denoised sample:
+//
+//   1. Hampel: per field, the median m and the MAD of the window. A reading
+//      more than FILTER_HAMPEL_SIGMAS * 1.4826 * MAD away from m in any
+//      field is rejected as a whole, so temperature and EC of the emitted
+//      sample still come from the same reads. The sigma is floored at about
+//      the sensor's resolution (FILTER_MIN_SIGMA), and a field with a MAD of
+//      0 rejects nothing: a sensor that refreshes slower than it is polled
+//      repeats its last value, and a real change after the refresh would
+//      otherwise be thrown away.
+//   2. Trimmed mean of the remaining readings, per field: the lowest and
+//      highest `trim` fraction are left out.
+//
+// FILTER_MEDIAN skips both steps and emits the per-field median. A period
+// whose readings were all NaN/Inf emits nothing and counts as dropped.
+//
+// The window is a fixed ring: when the bus delivers more readings per
+// period than `window`, the newest ones are kept. Fixed arrays only, so the
+// output thread still does not allocate per sample.
+const int FILTER_WINDOW_MAX = 64;
+const int FILTER_WINDOW_DEFAULT = 32;
+const double FILTER_TRIM_DEFAULT = 0.1;         // Per side
+const double FILTER_HAMPEL_SIGMAS = 3.0;
+const double FILTER_MAD_TO_SIGMA = 1.4826;      // MAD of normal noise -> standard deviation
+const double FILTER_MIN_SIGMA[FIELD_COUNT] = {  // Absolute, per field: about one step of resolution
+    0.01,                                       // Sensor EC, mS/cm
+    0.01,                                       // Raw EC, mS/cm
+    0.1,                                        // Temperature, °C
+};
+const int FILTER_HAMPEL_MIN_READINGS = 3;
+
+enum FilterMode {
+    FILTER_HAMPEL = 0,      // Reject outliers, then trimmed mean
+    FILTER_MEDIAN = 1
+};
+
+// What one emitted sample was made of
+struct FilterResult {
+    int readings;                       // Successful reads in the window
+    int rejected;                       // Hampel outliers and non-finite values among them
+    double variance[FIELD_COUNT];       // Sample variance of the readings that were kept
+};
+
+class SampleFilter {
+public:
+    FilterMode mode = FILTER_HAMPEL;
+    int window = FILTER_WINDOW_DEFAULT;
+    double trim = FILTER_TRIM_DEFAULT;
+    double period_ms = 1000.0;          // One emitted sample per period
+
+    // Output thread only
+    FilterResult last = {};
+    int64_t newest_request_ns = 0;      // Stamps of the newest reading in the window
+    int64_t newest_monotonic_ns = 0;
+    int64_t newest_realtime_ns = 0;
+
+    // Read by the metrics thread
+    std::atomic<long> readings_total{0};
+    std::atomic<long> rejected_total{0};
+    std::atomic<long> emitted_total{0};
+    std::atomic<long> dropped_total{0};     // Periods without a single valid reading
+
+    // True once a reading stamped `now_ns` belongs to the next period: emit()
+    // the current window before add()ing it.
+    bool due(int64_t now_ns) {
+        int64_t period_ns = (int64_t)(period_ms * 1e6);
+        if (next_emit_ns_ == 0) {
+            next_emit_ns_ = now_ns + period_ns;
+            return false;
+        }
+        return count_ + invalid_ > 0 && now_ns >= next_emit_ns_;
+    }
+
+    void add(const SensorSample &sample, int64_t request_ns, int64_t monotonic_ns, int64_t realtime_ns) {
+        newest_request_ns = request_ns;
+        newest_monotonic_ns = monotonic_ns;
+        newest_realtime_ns = realtime_ns;
+        readings_total.fetch_add(1, std::memory_order_relaxed);
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            if (!std::isfinite(sample.value[f])) {
+                invalid_++;
+                return;
+            }
+        }
+        ring_[head_] = sample;
+        head_ = (head_ + 1) % window;
+        count_ = std::min(count_ + 1, window);
+    }
+
+    // Reduces the window to one sample and starts the next period. The raw
+    // words are the Float ABCD encoding of the result, so the Hex columns
+    // still decode to the logged values. Returns false, leaving `out` alone,
+    // when the period only had NaN/Inf readings.
+    bool emit(int64_t now_ns, SensorSample &out, FilterResult &result) {
+        if (count_ == 0) {
+            rejected_total.fetch_add(invalid_, std::memory_order_relaxed);
+            dropped_total.fetch_add(1, std::memory_order_relaxed);
+            invalid_ = 0;
+            next_period(now_ns);
+            return false;
+        }
+
+        bool keep[FILTER_WINDOW_MAX];
+        std::fill(keep, keep + count_, true);
+        result.readings = count_ + invalid_;
+        result.rejected = invalid_;
+        if (mode == FILTER_HAMPEL && count_ >= FILTER_HAMPEL_MIN_READINGS) {
+            result.rejected += reject_outliers(keep);
+        }
+
+        double values[FILTER_WINDOW_MAX];
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            int n = 0;
+            for (int i = 0; i < count_; i++) {
+                if (keep[i]) values[n++] = ring_[i].value[f];
+            }
+            std::sort(values, values + n);
+            double estimate = mode == FILTER_MEDIAN ? median_of_sorted(values, n)
+                                                    : trimmed_mean_of_sorted(values, n);
+            result.variance[f] = variance(values, n);
+
+            modbus_set_float_abcd((float)estimate, out.raw[f]);
+            out.value[f] = (float)estimate;     // As if decoded from out.raw
+        }
+
+        last = result;
+        rejected_total.fetch_add(result.rejected, std::memory_order_relaxed);
+        emitted_total.fetch_add(1, std::memory_order_relaxed);
+        count_ = 0;
+        head_ = 0;
+        invalid_ = 0;
+        next_period(now_ns);
+        return true;
+    }
+
+private:
+    SensorSample ring_[FILTER_WINDOW_MAX];
+    int head_ = 0;
+    int count_ = 0;
+    int invalid_ = 0;                   // NaN/Inf readings, never in the ring
+    int64_t next_emit_ns_ = 0;
+
+    // Next slot on the period grid; periods without readings are skipped
+    void next_period(int64_t now_ns) {
+        int64_t period_ns = (int64_t)(period_ms * 1e6);
+        next_emit_ns_ += period_ns;
+        if (now_ns >= next_emit_ns_) {
+            next_emit_ns_ += ((now_ns - next_emit_ns_) / period_ns + 1) * period_ns;
+        }
+    }
+
+    // Marks readings that are outliers in any field; returns how many
+    int reject_outliers(bool *keep) const {
+        double values[FILTER_WINDOW_MAX];
+        double deviations[FILTER_WINDOW_MAX];
+        int rejected = 0;
+
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            for (int i = 0; i < count_; i++) {
+                values[i] = ring_[i].value[f];
+            }
+            std::sort(values, values + count_);
+            double median = median_of_sorted(values, count_);
+            for (int i = 0; i < count_; i++) {
+                deviations[i] = std::fabs(values[i] - median);
+            }
+            std::sort(deviations, deviations + count_);
+            double mad = median_of_sorted(deviations, count_);
+            if (mad == 0.0) continue;   // No spread to judge by: most readings are one repeated value
+            double sigma = std::max(FILTER_MAD_TO_SIGMA * mad, FILTER_MIN_SIGMA[f]);
+
+            for (int i = 0; i < count_; i++) {
+                double deviation = std::fabs(ring_[i].value[f] - median);
+                if (keep[i] && deviation > FILTER_HAMPEL_SIGMAS * sigma) {
+                    keep[i] = false;
+                    rejected++;
+                }
+            }
+        }
+        return rejected;
+    }
+
+    static double median_of_sorted(const double *v, int n) {
+        if (n == 0) return NAN;
+        return n % 2 == 1 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    }
+
+    double trimmed_mean_of_sorted(const double *v, int n) const {
+        if (n == 0) return NAN;
+        int cut = std::min((int)(trim * n), (n - 1) / 2);
+        double sum = 0.0;
+        for (int i = cut; i < n - cut; i++) {
+            sum += v[i];
+        }
+        return sum / (n - 2 * cut);
+    }
+
+    static double variance(const double *v, int n) {
+        if (n < 2) return 0.0;
+        double mean = 0.0;
+        for (int i = 0; i < n; i++) {
+            mean += v[i];
+        }
+        mean /= n;
+        double ss = 0.0;
+        for (int i = 0; i < n; i++) {
+            ss += (v[i] - mean) * (v[i] - mean);
+        }
+        return ss / (n - 1);
+    }
+};
+
+#endif // SAMPLE_FILTER_H
@@ -0,0 +1,231 @@
+#ifndef SENSOR_REGISTERS_H
+#define SENSOR_REGISTERS_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <modbus.h>
+
+// ===========================
+// IOT-485-EC4A REGISTER MAP
+// ===========================
+// Every value we sample is an IEEE 754 float spread over two holding
+// registers in ABCD (Big Endian) order. Keep this table in sync with the
+// "Modbus Register Map" section of SMART_LOGGER_README.md.
+enum SensorField {
+    FIELD_SENSOR_EC = 0,    // Reg 41-42: Sensor internal EC ("The Wrong Value")
+    FIELD_RAW_EC,           // Reg 45-46: Raw EC (Uncompensated)
+    FIELD_TEMPERATURE,      // Reg 60-61: Temperature
+    FIELD_COUNT
+};
+
+struct RegisterField {
+    SensorField field;
+    const char *name;
+    int address;
+    int count;
+};
+
+const RegisterField EC4A_REGISTER_MAP[FIELD_COUNT] = {
+    {FIELD_SENSOR_EC,   "sensor EC",   41, 2},
+    {FIELD_RAW_EC,      "raw EC",      45, 2},
+    {FIELD_TEMPERATURE, "temperature", 60, 2},
+};
+
+// ===========================
+// LINE SPEED REGISTER
+// ===========================
+// Like most RS485 probes, the sensor selects its baud rate with a code in a
+// holding register (code = index into this table). Our documentation does
+// not give the EC4A's register number, so the link tuner only switches
+// rates when it is told which register to write (--baud-register).
+const int BAUD_RATE_CODES[] = {2400, 4800, 9600, 19200, 38400, 57600, 115200};
+const int BAUD_RATE_CODE_COUNT = sizeof(BAUD_RATE_CODES) / sizeof(BAUD_RATE_CODES[0]);
+
+inline int baud_rate_code(int baud) {
+    for (int c = 0; c < BAUD_RATE_CODE_COUNT; c++) {
+        if (BAUD_RATE_CODES[c] == baud) return c;
+    }
+    return -1;
+}
+
+// ===========================
+// RTU BUS TIMING MODEL
+// ===========================
+// 8N1 framing = 10 bits per character on the wire.
+// Request (FC03):  slave + fc + addr(2) + count(2) + crc(2) = 8 bytes
+// Response (FC03): slave + fc + byte count + 2*N data + crc(2) = 5 + 2N bytes
+// Each frame is followed by a 3.5 character silent interval (fixed at
+// 1.75 ms above 19200 baud, per the Modbus over serial line spec).
+// The slave also needs time to prepare its answer (turnaround). 20 ms is a
+// conservative default until we measure the real sensor.
+const double DEFAULT_TURNAROUND_MS = 20.0;
+
+inline double rtu_char_time_ms(int baud) {
+    return 10.0 * 1000.0 / baud;
+}
+
+inline double rtu_frame_gap_ms(int baud) {
+    return baud > 19200 ? 1.75 : 3.5 * rtu_char_time_ms(baud);
+}
+
+inline double rtu_read_time_ms(int reg_count, int baud,
+                               double turnaround_ms = DEFAULT_TURNAROUND_MS) {
+    int request_bytes = 8;
+    int response_bytes = 5 + 2 * reg_count;
+    return (request_bytes + response_bytes) * rtu_char_time_ms(baud)
+           + 2.0 * rtu_frame_gap_ms(baud)
+           + turnaround_ms;
+}
+
+// ===========================
+// READ PLANNER
+// ===========================
+// Merges the register ranges of a field list into as few block reads as
+// possible. Two neighbouring ranges are merged when reading the unused
+// registers between them costs less bus time than a separate transaction.
+struct ReadBlock {
+    int address;
+    int count;
+};
+
+struct ReadPlan {
+    std::vector<ReadBlock> blocks;
+    std::vector<RegisterField> fields;
+    int baud = 9600;
+    double turnaround_ms = DEFAULT_TURNAROUND_MS;
+
+    int transactions() const {
+        return (int)blocks.size();
+    }
+
+    double bus_time_ms() const {
+        double total = 0.0;
+        for (const auto &b : blocks) {
+            total += rtu_read_time_ms(b.count, baud, turnaround_ms);
+        }
+        return total;
+    }
+
+    std::string describe() const {
+        std::string s;
+        for (const auto &b : blocks) {
+            if (!s.empty()) s += ", ";
+            s += std::to_string(b.address) + "-" + std::to_string(b.address + b.count - 1);
+        }
+        return s;
+    }
+};
+
+inline ReadPlan plan_register_reads(const RegisterField *fields, int field_count,
+                                    int baud = 9600,
+                                    double turnaround_ms = DEFAULT_TURNAROUND_MS,
+                                    bool merge = true) {
+    ReadPlan plan;
+    plan.baud = baud;
+    plan.turnaround_ms = turnaround_ms;
+    plan.fields.assign(fields, fields + field_count);
+
+    std::vector<ReadBlock> ranges;
+    for (int i = 0; i < field_count; i++) {
+        ranges.push_back({fields[i].address, fields[i].count});
+    }
+    std::sort(ranges.begin(), ranges.end(),
+              [](const ReadBlock &a, const ReadBlock &b) { return a.address < b.address; });
+
+    // Bus time of one extra transaction, minus the data it carries
+    double transaction_overhead_ms = rtu_read_time_ms(0, baud, turnaround_ms);
+    double register_time_ms = 2.0 * rtu_char_time_ms(baud);
+
+    for (const auto &r : ranges) {
+        if (!plan.blocks.empty()) {
+            ReadBlock &last = plan.blocks.back();
+            int last_end = last.address + last.count;
+            int gap = r.address - last_end;
+            int merged_count = std::max(last_end, r.address + r.count) - last.address;
+
+            if (merge && merged_count <= MODBUS_MAX_READ_REGISTERS
+                && (gap <= 0 || gap * register_time_ms < transaction_overhead_ms)) {
+                last.count = merged_count;
+                continue;
+            }
+        }
+        plan.blocks.push_back(r);
+    }
+
+    return plan;
+}
+
+// ===========================
+// FLOAT CONVERSION (ABCD Big Endian)
+// ===========================
+// Every tool decodes with this one function instead of libmodbus's
+// modbus_get_float_abcd, whose behaviour has changed between versions, so
+// a re-decoded log always matches what the logger wrote.
+inline float decode_float_abcd(const uint16_t *src) {
+    // src[0] contains high word (AB), src[1] contains low word (CD)
+    uint32_t i = (((uint32_t)src[0]) << 16) | src[1];
+    float f;
+    memcpy(&f, &i, sizeof(float));
+    return f;
+}
+
+// ===========================
+// BLOCK READ + DECODE
+// ===========================
+struct SensorSample {
+    uint16_t raw[FIELD_COUNT][2];   // Register words exactly as received (for Hex columns)
+    double value[FIELD_COUNT];      // Decoded Float ABCD values
+};
+
+// Decodes every field of the plan that lies inside `block` from the block's
+// register words (Float ABCD).
+inline void decode_block(const ReadPlan &plan, const ReadBlock &block, const uint16_t *block_data,
+                         SensorSample &out) {
+    for (const auto &f : plan.fields) {
+        if (f.address < block.address || f.address + f.count > block.address + block.count) {
+            continue;
+        }
+        const uint16_t *src = &block_data[f.address - block.address];
+        out.raw[f.field][0] = src[0];
+        out.raw[f.field][1] = src[1];
+        out.value[f.field] = decode_float_abcd(src);
+    }
+}
+
+// Executes every block of the plan and decodes each field with
+// decode_float_abcd. Returns the index of the failed block (so the caller
+// can report which range timed out), or -1 on success. errno is preserved
+// from the failing modbus_read_registers call.
+//
+// block_ns (optional, one slot per block) receives the duration of every
+// modbus_read_registers call that was made, including the failed one.
+// first_block resumes a sample whose earlier blocks are already in `out`.
+inline int read_sensor_sample(modbus_t *ctx, const ReadPlan &plan, SensorSample &out,
+                              int64_t *block_ns = NULL, size_t first_block = 0) {
+    uint16_t block_data[MODBUS_MAX_READ_REGISTERS];
+
+    for (size_t b = first_block; b < plan.blocks.size(); b++) {
+        const ReadBlock &block = plan.blocks[b];
+        auto start = std::chrono::steady_clock::now();
+        int rc = modbus_read_registers(ctx, block.address, block.count, block_data);
+        if (block_ns != NULL) {
+            int saved_errno = errno;
+            block_ns[b] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            errno = saved_errno;
+        }
+        if (rc == -1) {
+            return (int)b;
+        }
+        decode_block(plan, block, block_data, out);
+    }
+
+    return -1;
+}
+
+#endif // SENSOR_REGISTERS_H
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <unistd.h>
+#include "sensor_simulator.h"
+
+// ===========================
+// STANDALONE SENSOR SIMULATOR
+// ===========================
+// Runs the pty simulator until Ctrl+C so smart_logger or auto_detect_sensor
+// can be exercised without the IOT-485-EC4A attached:
+//
+//   ./sensor_simulator --link /tmp/ttyEC4A --latency 25 --jitter 5 &
+//   echo "/tmp/ttyEC4A 4" > .sensor_port_cache
+//   ./smart_logger
+//
+// Usage: ./sensor_simulator [--slave ID]... [--baud N] [--latency MS]
+//        [--jitter MS] [--crc-errors RATE] [--dropouts RATE] [--strict-map]
+//        [--sweep SECONDS] [--baud-register ADDR] [--max-baud N]
+//        [--reliable-baud N] [--noise-temp C] [--noise-ec F] [--spikes RATE]
+//        [--link PATH]
+
+volatile sig_atomic_t keep_running = 1;
+
+void handle_signal(int) {
+    keep_running = 0;
+}
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --slave ID          Answer as this slave ID (repeatable, default 4)\n"
+              << "  --baud N            Pace replies as if on an N baud line (default 9600, 0 = instant)\n"
+              << "  --latency MS        Turnaround before each reply (default 20)\n"
+              << "  --jitter MS         Uniform +/- jitter on the turnaround (default 0)\n"
+              << "  --crc-errors RATE   Fraction of replies with a corrupted CRC (0-1)\n"
+              << "  --dropouts RATE     Fraction of requests left unanswered (0-1)\n"
+              << "  --strict-map        Refuse reads that touch unmapped registers\n"
+              << "  --sweep SECONDS     Temperature cycle length (default 600, 0 = constant)\n"
+              << "  --baud-register A   Serve a writable baud code at register A (FC06)\n"
+              << "  --max-baud N        Refuse baud codes above N (default 115200)\n"
+              << "  --reliable-baud N   Corrupt every reply above N baud (long cable)\n"
+              << "  --noise-temp C      Gaussian temperature noise, standard deviation in °C\n"
+              << "  --noise-ec F        Gaussian raw EC noise, relative standard deviation (0.01 = 1%)\n"
+              << "  --spikes RATE       Fraction of replies with a raw EC spike (0-1)\n"
+              << "  --link PATH         Also expose the pty under PATH (symlink)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    SimulatorConfig config;
+    std::vector<int> slave_ids;
+    std::string link;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--slave" && has_value) {
+            slave_ids.push_back(atoi(argv[++i]));
+        } else if (arg == "--baud" && has_value) {
+            config.baud = atoi(argv[++i]);
+        } else if (arg == "--latency" && has_value) {
+            config.latency_ms = atof(argv[++i]);
+        } else if (arg == "--jitter" && has_value) {
+            config.jitter_ms = atof(argv[++i]);
+        } else if (arg == "--crc-errors" && has_value) {
+            config.crc_error_rate = atof(argv[++i]);
+        } else if (arg == "--dropouts" && has_value) {
+            config.dropout_rate = atof(argv[++i]);
+        } else if (arg == "--strict-map") {
+            config.strict_map = true;
+        } else if (arg == "--sweep" && has_value) {
+            config.sweep_period_s = atof(argv[++i]);
+        } else if (arg == "--baud-register" && has_value) {
+            config.baud_register = atoi(argv[++i]);
+        } else if (arg == "--max-baud" && has_value) {
+            config.max_baud = atoi(argv[++i]);
+        } else if (arg == "--reliable-baud" && has_value) {
+            config.reliable_baud = atoi(argv[++i]);
+        } else if (arg == "--noise-temp" && has_value) {
+            config.noise_temp_c = atof(argv[++i]);
+        } else if (arg == "--noise-ec" && has_value) {
+            config.noise_ec = atof(argv[++i]);
+        } else if (arg == "--spikes" && has_value) {
+            config.spike_rate = atof(argv[++i]);
+        } else if (arg == "--link" && has_value) {
+            link = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (!slave_ids.empty()) {
+        config.slave_ids = slave_ids;
+    }
+
+    SensorSimulator simulator;
+    if (!simulator.start(config)) {
+        return -1;
+    }
+
+    if (!link.empty()) {
+        unlink(link.c_str());
+        if (symlink(simulator.path().c_str(), link.c_str()) == -1) {
+            std::cerr << "❌ Cannot create link " << link << ": " << strerror(errno) << std::endl;
+            return -1;
+        }
+    }
+
+    std::cout << "🧪 Simulated IOT-485-EC4A on " << simulator.path();
+    if (!link.empty()) std::cout << " (" << link << ")";
+    std::cout << "\n   Slave ID(s):";
+    for (int id : config.slave_ids) std::cout << " " << id;
+    std::cout << " | " << config.baud << " baud | latency " << config.latency_ms
+              << " ± " << config.jitter_ms << " ms | CRC errors " << config.crc_error_rate * 100
+              << "% | dropouts " << config.dropout_rate * 100 << "%" << std::endl;
+    if (config.noise_temp_c > 0 || config.noise_ec > 0 || config.spike_rate > 0) {
+        std::cout << "   Noise: temperature σ " << config.noise_temp_c << " °C | raw EC σ "
+                  << config.noise_ec * 100 << "% | spikes " << config.spike_rate * 100 << "%" << std::endl;
+    }
+    std::cout << "   Press Ctrl+C to stop" << std::endl;
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    while (keep_running) {
+        pause();
+    }
+
+    simulator.stop();
+    if (!link.empty()) unlink(link.c_str());
+
+    std::cout << "\n📊 Requests: " << simulator.stats.requests
+              << " | Replies: " << simulator.stats.replies
+              << " | Exceptions: " << simulator.stats.exceptions
+              << " | CRC errors: " << simulator.stats.crc_errors
+              << " | Dropouts: " << simulator.stats.dropouts
+              << " | Framing errors: " << simulator.stats.framing_errors
+              << " | Wrong baud: " << simulator.stats.wrong_baud << std::endl;
+    if (simulator.baud() != config.baud) {
+        std::cout << "   Line speed was switched to " << simulator.baud() << " baud" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,356 @@
+#ifndef SENSOR_SIMULATOR_H
+#define SENSOR_SIMULATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "compensation.h"
+#include "modbus_crc.h"
+
+// ===========================
+// BOQU IOT-485-EC4A SIMULATOR
+// ===========================
+// A Modbus RTU slave on a Linux pseudo-terminal. Anything that opens
+// `path()` (smart_logger, auto_detect_sensor, discover_sensor via
+// DiscoveryOptions::extra_ports) sees a sensor on an RS485 adapter.
+//
+// Served registers (FC03 and FC04, ABCD floats):
+//   8      Device address (slave ID), the auto_detect_sensor handshake
+//   41-42  Sensor EC, compensated with the fixed k = 0.02
+//   45-46  Raw EC at the current temperature
+//   60-61  Temperature, sweeping temp_min..temp_max
+//   baud_register (optional)  Baud code, also writable with FC06
+//
+// The raw EC follows the dynamic k, so a correct smart algorithm recovers
+// exactly 12.88 mS/cm while the sensor default drifts with temperature.
+//
+// Link behaviour: the reply is held back for the time the request and the
+// response need on the wire at `baud` (8N1) plus the turnaround latency and
+// a uniform ±jitter. CRC errors corrupt the reply, dropouts suppress it.
+//
+// Measurement noise (optional): Gaussian noise on the temperature and the
+// raw EC of every reply, and spikes, where the raw EC of a reply is off by
+// SIM_SPIKE_FACTOR. The sensor EC is compensated from the noisy readings,
+// as a real transmitter would.
+// A pty carries bytes at any speed, so the simulator reads the speed the
+// client configured and ignores requests sent at the wrong rate, the way
+// a real UART would only see garbage.
+const int SIM_REGISTER_COUNT = 128;
+
+// Same codes as BAUD_RATE_CODES in sensor_registers.h (kept separate so the
+// simulator builds without libmodbus)
+const int SIM_BAUD_RATES[] = {2400, 4800, 9600, 19200, 38400, 57600, 115200};
+const speed_t SIM_BAUD_SPEEDS[] = {B2400, B4800, B9600, B19200, B38400, B57600, B115200};
+const int SIM_BAUD_CODE_COUNT = 7;
+const double SIM_SPIKE_FACTOR = 1.5;    // A spike reads 1.5x or 1/1.5x the raw EC
+
+struct SimulatorConfig {
+    std::vector<int> slave_ids = {4};
+    int baud = 9600;                    // Wire-time pacing, 0 = instant
+    double latency_ms = 20.0;           // Slave turnaround
+    double jitter_ms = 0.0;             // Uniform ± around the latency
+    double crc_error_rate = 0.0;        // Fraction of replies with a bad CRC
+    double dropout_rate = 0.0;          // Fraction of requests never answered
+    bool strict_map = false;            // Refuse reads touching unmapped registers
+    int baud_register = -1;             // Register holding the baud code, -1 = fixed rate
+    int max_baud = 115200;              // Faster codes are refused (exception 03)
+    int reliable_baud = 0;              // Above this rate every reply is corrupted (long cable), 0 = off
+    double temp_min = 5.0;
+    double temp_max = 35.0;
+    double sweep_period_s = 600.0;      // One full temperature cycle
+    double noise_temp_c = 0.0;          // Standard deviation of the temperature noise
+    double noise_ec = 0.0;              // Standard deviation of the raw EC noise, relative
+    double spike_rate = 0.0;            // Fraction of replies with a raw EC spike
+    unsigned seed = 1;
+};
+
+struct SimulatorStats {
+    std::atomic<long> requests{0};
+    std::atomic<long> replies{0};
+    std::atomic<long> crc_errors{0};
+    std::atomic<long> dropouts{0};
+    std::atomic<long> exceptions{0};
+    std::atomic<long> framing_errors{0};  // Bytes discarded while resynchronising
+    std::atomic<long> wrong_baud{0};      // Requests sent at another rate than ours
+};
+
+class SensorSimulator {
+public:
+    SimulatorConfig config;
+    SimulatorStats stats;
+
+    ~SensorSimulator() {
+        stop();
+    }
+
+    // Opens the pty and starts answering on a background thread.
+    bool start(const SimulatorConfig &cfg) {
+        config = cfg;
+        master_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master_fd_ == -1 || grantpt(master_fd_) == -1 || unlockpt(master_fd_) == -1) {
+            std::cerr << "❌ Cannot create pseudo-terminal: " << strerror(errno) << std::endl;
+            return false;
+        }
+        path_ = ptsname(master_fd_);
+
+        // Keep one handle on the slave side open: otherwise the master reads
+        // EIO every time a client closes the port between probes.
+        slave_fd_ = open(path_.c_str(), O_RDWR | O_NOCTTY);
+        if (slave_fd_ == -1) {
+            std::cerr << "❌ Cannot open " << path_ << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        struct termios tio;
+        tcgetattr(slave_fd_, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave_fd_, TCSANOW, &tio);
+
+        running_ = true;
+        baud_ = config.baud;
+        started_ = std::chrono::steady_clock::now();
+        worker_ = std::thread(&SensorSimulator::serve, this);
+        return true;
+    }
+
+    void stop() {
+        running_ = false;
+        if (worker_.joinable()) worker_.join();
+        if (slave_fd_ != -1) close(slave_fd_);
+        if (master_fd_ != -1) close(master_fd_);
+        slave_fd_ = master_fd_ = -1;
+    }
+
+    // Device node clients open (/dev/pts/N)
+    const std::string &path() const { return path_; }
+
+    // Current line speed (changes when a client writes the baud register)
+    int baud() const { return baud_; }
+
+    // Current simulated temperature
+    double temperature() const {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+        double phase = config.sweep_period_s > 0 ? 2.0 * M_PI * t / config.sweep_period_s : 0.0;
+        double mid = 0.5 * (config.temp_min + config.temp_max);
+        return mid - 0.5 * (config.temp_max - config.temp_min) * std::cos(phase);
+    }
+
+private:
+    int master_fd_ = -1;
+    int slave_fd_ = -1;
+    std::string path_;
+    std::thread worker_;
+    std::atomic<bool> running_{false};
+    std::atomic<int> baud_{0};
+    int pending_baud_ = 0;              // Applied once the FC06 reply is on the wire
+    std::chrono::steady_clock::time_point started_;
+
+    bool serves(int slave_id) const {
+        for (int id : config.slave_ids) {
+            if (id == slave_id) return true;
+        }
+        return false;
+    }
+
+    bool mapped(int address) const {
+        return address == 8 || (address >= 41 && address <= 42)
+               || (address >= 45 && address <= 46) || (address >= 60 && address <= 61)
+               || address == config.baud_register;
+    }
+
+    static int baud_code(int baud) {
+        for (int c = 0; c < SIM_BAUD_CODE_COUNT; c++) {
+            if (SIM_BAUD_RATES[c] == baud) return c;
+        }
+        return -1;
+    }
+
+    // False when the client's port is set to another speed than ours
+    bool line_speed_matches() const {
+        int code = baud_code(baud_);
+        if (code == -1) return true;    // 0 = instant, or a rate we cannot check
+        struct termios tio;
+        if (tcgetattr(slave_fd_, &tio) == -1) return true;
+        return cfgetospeed(&tio) == SIM_BAUD_SPEEDS[code];
+    }
+
+    static void set_float(uint16_t *regs, int address, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        regs[address] = (uint16_t)(bits >> 16);
+        regs[address + 1] = (uint16_t)(bits & 0xFFFF);
+    }
+
+    void fill_registers(int slave_id, uint16_t *regs, std::mt19937 &rng) const {
+        memset(regs, 0, SIM_REGISTER_COUNT * sizeof(uint16_t));
+        double temp = temperature();
+        double raw_ec = 12.88 * (1.0 + get_dynamic_k(temp) * (temp - 25.0));
+        if (config.noise_temp_c > 0 || config.noise_ec > 0) {
+            std::normal_distribution<double> gauss(0.0, 1.0);
+            raw_ec *= 1.0 + config.noise_ec * gauss(rng);
+            temp += config.noise_temp_c * gauss(rng);
+        }
+        if (config.spike_rate > 0) {
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            if (uniform(rng) < config.spike_rate) {
+                raw_ec = uniform(rng) < 0.5 ? raw_ec * SIM_SPIKE_FACTOR : raw_ec / SIM_SPIKE_FACTOR;
+            }
+        }
+        regs[8] = (uint16_t)slave_id;
+        if (config.baud_register >= 0 && config.baud_register < SIM_REGISTER_COUNT) {
+            regs[config.baud_register] = (uint16_t)std::max(baud_code(baud_), 0);
+        }
+        set_float(regs, 41, (float)(raw_ec / (1.0 + 0.02 * (temp - 25.0))));
+        set_float(regs, 45, (float)raw_ec);
+        set_float(regs, 60, (float)temp);
+    }
+
+    // Builds the reply to one valid request frame; returns its length
+    size_t build_reply(const uint8_t *req, uint8_t *reply, std::mt19937 &rng) {
+        int slave_id = req[0];
+        int function = req[1];
+        int address = (req[2] << 8) | req[3];
+        int count = (req[4] << 8) | req[5];
+        size_t len = 0;
+
+        // FC06 on the baud register: echo the request, switch after the reply
+        if (function == 6) {
+            int value = count;
+            int exception = 0;
+            if (address != config.baud_register) {
+                exception = 2;
+            } else if (value >= SIM_BAUD_CODE_COUNT || SIM_BAUD_RATES[value] > config.max_baud) {
+                exception = 3;                          // Illegal data value
+            }
+            if (exception == 0) {
+                memcpy(reply, req, 6);
+                pending_baud_ = SIM_BAUD_RATES[value];
+                len = 6;
+            } else {
+                stats.exceptions++;
+                reply[len++] = (uint8_t)slave_id;
+                reply[len++] = (uint8_t)(function | 0x80);
+                reply[len++] = (uint8_t)exception;
+            }
+            uint16_t crc = modbus_crc16(reply, len);
+            reply[len++] = (uint8_t)(crc & 0xFF);
+            reply[len++] = (uint8_t)(crc >> 8);
+            return len;
+        }
+
+        int exception = 0;
+        if (function != 3 && function != 4) {
+            exception = 1;                              // Illegal function
+        } else if (count < 1 || count > 125 || address + count > SIM_REGISTER_COUNT) {
+            exception = 2;                              // Illegal data address
+        } else if (config.strict_map) {
+            for (int a = address; a < address + count; a++) {
+                if (!mapped(a)) exception = 2;
+            }
+        }
+
+        reply[len++] = (uint8_t)slave_id;
+        if (exception != 0) {
+            stats.exceptions++;
+            reply[len++] = (uint8_t)(function | 0x80);
+            reply[len++] = (uint8_t)exception;
+        } else {
+            uint16_t regs[SIM_REGISTER_COUNT];
+            fill_registers(slave_id, regs, rng);
+            reply[len++] = (uint8_t)function;
+            reply[len++] = (uint8_t)(2 * count);
+            for (int i = 0; i < count; i++) {
+                reply[len++] = (uint8_t)(regs[address + i] >> 8);
+                reply[len++] = (uint8_t)(regs[address + i] & 0xFF);
+            }
+        }
+
+        uint16_t crc = modbus_crc16(reply, len);
+        reply[len++] = (uint8_t)(crc & 0xFF);
+        reply[len++] = (uint8_t)(crc >> 8);
+        return len;
+    }
+
+    void serve() {
+        std::mt19937 rng(config.seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        uint8_t buf[512];
+        size_t used = 0;
+
+        while (running_) {
+            struct pollfd pfd = {master_fd_, POLLIN, 0};
+            if (poll(&pfd, 1, 100) <= 0) continue;
+
+            ssize_t n = read(master_fd_, buf + used, sizeof(buf) - used);
+            if (n <= 0) continue;
+            used += n;
+
+            // Every request we answer (FC03/FC04/FC06) is 8 bytes. Anything that
+            // does not carry a valid CRC is skipped a byte at a time, which is
+            // how a real slave resynchronises after line noise.
+            while (used >= 8) {
+                if (modbus_crc16(buf, 6) != (uint16_t)(buf[6] | (buf[7] << 8))) {
+                    memmove(buf, buf + 1, --used);
+                    stats.framing_errors++;
+                    continue;
+                }
+
+                uint8_t request[8];
+                memcpy(request, buf, 8);
+                memmove(buf, buf + 8, used - 8);
+                used -= 8;
+
+                if (!serves(request[0])) continue;     // Another slave on the bus
+                if (!line_speed_matches()) {
+                    stats.wrong_baud++;
+                    continue;
+                }
+                stats.requests++;
+
+                if (uniform(rng) < config.dropout_rate) {
+                    stats.dropouts++;
+                    continue;
+                }
+
+                uint8_t reply[8 + 2 * SIM_REGISTER_COUNT];
+                size_t len = build_reply(request, reply, rng);
+                bool unreliable = config.reliable_baud > 0 && baud_ > config.reliable_baud;
+                if (unreliable || uniform(rng) < config.crc_error_rate) {
+                    reply[len - 1] ^= 0x5A;
+                    stats.crc_errors++;
+                }
+
+                double delay_ms = config.latency_ms + config.jitter_ms * (2.0 * uniform(rng) - 1.0);
+                if (baud_ > 0) {
+                    delay_ms += (8 + len) * 10.0 * 1000.0 / baud_;
+                }
+                if (delay_ms > 0) {
+                    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delay_ms));
+                }
+
+                if (write(master_fd_, reply, len) == (ssize_t)len) {
+                    stats.replies++;
+                }
+                if (pending_baud_ != 0) {
+                    tcdrain(master_fd_);
+                    baud_ = pending_baud_;
+                    pending_baud_ = 0;
+                }
+            }
+        }
+    }
+};
+
+#endif // SENSOR_SIMULATOR_H
@@ -0,0 +1,70 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// ===========================
+// SEQLOCK LATEST-VALUE CACHE
+// ===========================
+// One writer (the output stage publishing samples) and any number of
+// readers (gateway threads answering clients):
+//
+// - store() never waits for readers, so a flood of client reads cannot slow
+//   the acquisition pipeline down.
+// - load() copies the value and retries if a store() ran at the same time,
+//   so readers always see one complete sample, never a mix of two.
+//
+// The value is kept in relaxed atomic words (not a plain struct) so the
+// concurrent copy is well-defined C++. T must be trivially copyable.
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock needs a trivially copyable type");
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+    void store(const T &value) {
+        uint64_t words[WORDS] = {};
+        memcpy(words, &value, sizeof(T));
+
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);     // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) {
+            data_[i].store(words[i], std::memory_order_relaxed);
+        }
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // Returns false while nothing has been stored yet.
+    bool load(T &out) const {
+        uint64_t words[WORDS];
+        uint32_t before, after;
+
+        do {
+            before = seq_.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) {
+                words[i] = data_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq_.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        memcpy(&out, words, sizeof(T));
+        return before != 0;
+    }
+
+    // Number of completed stores
+    uint32_t version() const {
+        return seq_.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> seq_{0};
+    std::atomic<uint64_t> data_[WORDS] = {};
+};
+
+#endif // SEQLOCK_H
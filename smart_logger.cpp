@@ -1,412 +1,922 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
-#include <sstream>
 #include <string>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <ctime>
 #include <cmath>
 #include <cstring>
 #include <modbus.h>
 #include <unistd.h>
 #include <cerrno>
+#include <csignal>
+#include <thread>
+#include "compensation.h"
+#include "sensor_registers.h"
+#include "port_discovery.h"
+#include "bus_scheduler.h"
+#include "rtu_event_loop.h"
+#include "spsc_ring.h"
+#include "term_renderer.h"
+#include "metrics.h"
+#include "modbus_gateway.h"
+#include "link_tuner.h"
+#include "fast_format.h"
+#include "output_stages.h"
+#include "dashboard.h"
+#include "alloc_counter.h"
 
 // ===========================
-// DYNAMIC COEFFICIENT LOOKUP
+// PORT AUTO-DISCOVERY
 // ===========================
-double get_dynamic_k(double temp) {
-    if (temp <= 5.0) {
-        return 0.0180;  // 1.80%
-    } else if (temp <= 10.0) {
-        return 0.0184;  // 1.84%
-    } else if (temp <= 15.0) {
-        return 0.0190;  // 1.90%
-    } else if (temp <= 25.0) {
-        return 0.0190;  // 1.90% (flat range)
-    } else if (temp <= 30.0) {
-        return 0.0192;  // 1.92%
-    } else {
-        return 0.0194;  // 1.94%
+// Candidate ports are pre-filtered, probed in parallel and the last port
+// that answered is tried first (see port_discovery.h).
+SensorLocation find_sensor(int slave_id, int baud) {
+    std::cout << "🔍 Scanning ports for BOQU IOT-485-EC4A (Slave ID: " << slave_id << ")..." << std::endl;
+    
+    DiscoveryOptions options;  // Temperature (60-61) handshake, 100ms timeout
+    options.preferred_slave_id = slave_id;
+    options.baud = baud;       // The cached rate is tried first when there is one
+    SensorLocation location = discover_sensor(options);
+    
+    if (!location.port.empty()) {
+        std::cout << "✅ FOUND SENSOR at: " << location.port
+                  << (location.from_cache ? " (cached)" : "")
+                  << " in " << (int)location.elapsed_ms << " ms, " << location.baud << " baud" << std::endl;
     }
+    
+    return location;
 }
 
-// ===========================
-// SMART ALGORITHM
-// ===========================
-double calculate_smart_ec(double raw_ec, double temp) {
-    double k = get_dynamic_k(temp);
-    // C25 = raw_ec / (1 + k * (temp - 25))
-    return raw_ec / (1.0 + k * (temp - 25.0));
+// Set by SIGINT/SIGTERM: drain the ring, close the logs and exit.
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
 }
 
-// ===========================
-// PORT AUTO-DISCOVERY
-// ===========================
-std::string find_sensor_port() {
-    std::vector<std::string> ports;
-    
-    // Scan /dev/ttyS0 through /dev/ttyS20 (WSL1/Legacy mode)
-    for (int i = 0; i <= 20; i++) {
-        ports.push_back("/dev/ttyS" + std::to_string(i));
+void run_acquisition(BusScheduler &bus, SampleRing &ring, LoggerMetrics &metrics) {
+    allocation_counter = &metrics.acquisition_allocations;
+    while (bus.running) {
+        bus.poll_once([&](const AcquiredSample &acquired) {
+            if (!acquired.ok) {
+                bus.fall_back_if_refused(acquired.error);
+            }
+            ring.push(acquired);  // Never blocks; counts an overrun if full
+        });
     }
-    
-    // Also scan USB ports in case user switches to WSL2 USB passthrough
-    for (int i = 0; i < 5; i++) {
-        ports.push_back("/dev/ttyUSB" + std::to_string(i));
-        ports.push_back("/dev/ttyACM" + std::to_string(i));
+}
+
+// --event-loop: one acquisition thread for every bus, driven by
+// RtuEventLoop. Each sample goes to the ring of the bus it came from. The
+// wait is bounded so a stop is noticed within EVENT_LOOP_STOP_CHECK_MS;
+// all buses are stopped together, so the first one's flag stands for all.
+const int EVENT_LOOP_STOP_CHECK_MS = 100;
+
+void run_event_acquisition(RtuEventLoop &loop, std::deque<BusPipeline> &buses, LoggerMetrics &metrics) {
+    allocation_counter = &metrics.acquisition_allocations;
+    loop.start();
+    while (buses.front().bus.running) {
+        loop.run_once(EVENT_LOOP_STOP_CHECK_MS, [&](BusScheduler &bus, const AcquiredSample &acquired) {
+            if (!acquired.ok) {
+                bus.fall_back_if_refused(acquired.error);
+            }
+            for (auto &p : buses) {
+                if (&p.bus == &bus) {
+                    p.ring.push(acquired);  // Never blocks; counts an overrun if full
+                    break;
+                }
+            }
+        });
     }
-    
-    std::cout << "🔍 Scanning ports for BOQU IOT-485-EC4A (Slave ID: 4)..." << std::endl;
-    
-    uint16_t test_reg[2];
-    
-    for (const auto &port : ports) {
-        modbus_t *ctx = modbus_new_rtu(port.c_str(), 9600, 'N', 8, 1);
-        if (ctx == NULL) continue;
+}
+
+// ===========================
+// ONLINE CALIBRATION
+// ===========================
+// Set by SIGUSR1: apply the current candidate tables once.
+volatile sig_atomic_t calibration_apply_requested = 0;
+
+void request_calibration_apply(int) {
+    calibration_apply_requested = 1;
+}
+
+// Publishes every slave's candidate table. With `apply`, a slave's table is
+// swapped for its candidate when a confident band moved by more than its
+// standard error (and CALIBRATION_MIN_CHANGE). The table is only used on
+// this (the output) thread, so the swap takes effect from the next batch
+// on, without a restart.
+void publish_calibration(BusScheduler &bus, bool apply) {
+    for (auto &slave : bus.slaves) {
+        if (!slave.calibration) continue;
         
-        modbus_set_slave(ctx, 4);  // CRITICAL: Slave ID 4, not 1
-        modbus_set_response_timeout(ctx, 0, 100000);  // 100ms timeout
+        CalibrationCandidate c = slave.calibration->publish(slave.table, slave.slave_id);
+        if (!apply) continue;
         
-        if (modbus_connect(ctx) != -1) {
-            // Try to read temperature register (60-61) as handshake
-            int rc = modbus_read_registers(ctx, 60, 2, test_reg);
-            
-            if (rc != -1) {
-                std::cout << "✅ FOUND SENSOR at: " << port << std::endl;
-                modbus_close(ctx);
-                modbus_free(ctx);
-                return port;
+        std::string changed;
+        for (int i = 0; i < c.table.size; i++) {
+            double change = fabs(c.table.k[i] - slave.table.k[i]);
+            if (c.confident[i] && change > c.std_error[i] && change > CALIBRATION_MIN_CHANGE) {
+                char band[96];
+                snprintf(band, sizeof(band), " %s°C %.5f->%.5f", coefficient_band_label(c.table, i).c_str(),
+                         slave.table.k[i], c.table.k[i]);
+                changed += band;
             }
-            modbus_close(ctx);
         }
-        modbus_free(ctx);
+        if (changed.empty()) continue;
+        
+        slave.table = c.table;
+        std::cerr << "🎯 Slave " << slave.slave_id << ": coefficient table updated:" << changed << std::endl;
     }
-    
-    return "";
 }
 
 // ===========================
-// FLOAT CONVERSION (ABCD Big Endian)
+// STATS ENDPOINT
 // ===========================
-float modbus_get_float_abcd(const uint16_t *src) {
-    // ABCD format: [AB][CD] -> Big Endian
-    uint32_t i;
-    float f;
+// Prometheus labels of one bus, and of one slave on it. The port is only
+// added with several buses, so a single-bus setup keeps its series names.
+std::string bus_labels(const std::deque<BusPipeline> &buses, const BusScheduler &bus) {
+    return buses.size() > 1 ? "port=\"" + bus.port + "\"" : "";
+}
+
+std::string slave_labels(const std::deque<BusPipeline> &buses, const BusScheduler &bus, int slave_id) {
+    std::string labels = bus_labels(buses, bus);
+    return labels + (labels.empty() ? "" : ",") + "slave=\"" + std::to_string(slave_id) + "\"";
+}
+
+// Runs on the metrics server thread: only atomics are read here.
+void render_metrics(std::string &out, const LoggerMetrics &metrics, const std::deque<BusPipeline> &buses,
+                    const ModbusGateway *gateway) {
+    BusMetricsList bus_metrics;
+    for (const auto &p : buses) {
+        bus_metrics.push_back(std::make_pair(bus_labels(buses, p.bus), &p.metrics));
+    }
+    render_logger_metrics(out, metrics, bus_metrics);
     
-    // Combine two 16-bit registers into one 32-bit value
-    // src[0] contains high word (AB), src[1] contains low word (CD)
-    i = (((uint32_t)src[0]) << 16) | src[1];
+    metric_header(out, "ec_samples_total", "counter", "Successful polls per slave");
+    for (const auto &p : buses) {
+        for (const auto &s : p.bus.slaves) {
+            metric_value(out, "ec_samples_total", slave_labels(buses, p.bus, s.slave_id), (double)s.samples);
+        }
+    }
+    metric_header(out, "ec_poll_failures_total", "counter", "Failed polls per slave");
+    for (const auto &p : buses) {
+        for (const auto &s : p.bus.slaves) {
+            metric_value(out, "ec_poll_failures_total", slave_labels(buses, p.bus, s.slave_id), (double)s.failures);
+        }
+    }
+    metric_header(out, "ec_missed_deadlines_total", "counter", "Poll periods skipped because the previous poll overran");
+    for (const auto &p : buses) {
+        for (const auto &s : p.bus.slaves) {
+            metric_value(out, "ec_missed_deadlines_total", slave_labels(buses, p.bus, s.slave_id),
+                         (double)s.missed_deadlines);
+        }
+    }
+    metric_header(out, "ec_poll_period_seconds", "gauge", "Current poll period per slave (changes in adaptive mode)");
+    for (const auto &p : buses) {
+        for (const auto &s : p.bus.slaves) {
+            metric_value(out, "ec_poll_period_seconds", slave_labels(buses, p.bus, s.slave_id), s.period_ms / 1000.0);
+        }
+    }
     
-    // Reinterpret as float
-    memcpy(&f, &i, sizeof(float));
+    metric_header(out, "ec_pipeline_queue_depth", "gauge", "Samples waiting between acquisition and output");
+    for (const auto &p : buses) {
+        metric_value(out, "ec_pipeline_queue_depth", bus_labels(buses, p.bus), (double)p.ring.depth());
+    }
+    metric_header(out, "ec_pipeline_queue_high_water", "gauge", "Deepest the queue has been");
+    for (const auto &p : buses) {
+        metric_value(out, "ec_pipeline_queue_high_water", bus_labels(buses, p.bus), (double)p.ring.high_water());
+    }
+    metric_header(out, "ec_pipeline_overruns_total", "counter", "Samples dropped because the queue was full");
+    for (const auto &p : buses) {
+        metric_value(out, "ec_pipeline_overruns_total", bus_labels(buses, p.bus), (double)p.ring.overruns());
+    }
+    metric_header(out, "ec_read_plan_fallback", "gauge", "1 once the sensor refused the merged read");
+    for (const auto &p : buses) {
+        metric_value(out, "ec_read_plan_fallback", bus_labels(buses, p.bus), p.bus.use_fallback ? 1.0 : 0.0);
+    }
     
-    return f;
+    bool oversampling = false;
+    bool calibrating = false;
+    for (const auto &p : buses) {
+        for (const auto &s : p.bus.slaves) {
+            oversampling = oversampling || s.filter;
+            calibrating = calibrating || s.calibration;
+        }
+    }
+    if (oversampling) {
+        metric_header(out, "ec_filter_readings_total", "counter", "Readings that went into the oversampling filter");
+        for (const auto &p : buses) {
+            for (const auto &s : p.bus.slaves) {
+                metric_value(out, "ec_filter_readings_total", slave_labels(buses, p.bus, s.slave_id),
+                             (double)s.filter->readings_total);
+            }
+        }
+        metric_header(out, "ec_filter_rejected_total", "counter", "Readings rejected as outliers or non-finite");
+        for (const auto &p : buses) {
+            for (const auto &s : p.bus.slaves) {
+                metric_value(out, "ec_filter_rejected_total", slave_labels(buses, p.bus, s.slave_id),
+                             (double)s.filter->rejected_total);
+            }
+        }
+        metric_header(out, "ec_filter_samples_total", "counter", "Denoised samples emitted");
+        for (const auto &p : buses) {
+            for (const auto &s : p.bus.slaves) {
+                metric_value(out, "ec_filter_samples_total", slave_labels(buses, p.bus, s.slave_id),
+                             (double)s.filter->emitted_total);
+            }
+        }
+        metric_header(out, "ec_filter_dropped_total", "counter", "Output periods with only non-finite readings");
+        for (const auto &p : buses) {
+            for (const auto &s : p.bus.slaves) {
+                metric_value(out, "ec_filter_dropped_total", slave_labels(buses, p.bus, s.slave_id),
+                             (double)s.filter->dropped_total);
+            }
+        }
+    }
+    
+    if (calibrating) {
+        static const char *const NAMES[4] = {"ec_calibration_k", "ec_calibration_k_std_error",
+                                             "ec_calibration_samples", "ec_calibration_confident"};
+        static const char *const HELP[4] = {"Temperature coefficient fitted online per band",
+                                            "Standard error of the fitted coefficient",
+                                            "Samples in the band's fit",
+                                            "1 once the band's fit may replace the table value"};
+        for (int m = 0; m < 4; m++) {
+            metric_header(out, NAMES[m], "gauge", HELP[m]);
+            for (const auto &p : buses) {
+                for (const auto &s : p.bus.slaves) {
+                    CalibrationCandidate c;
+                    if (!s.calibration || !s.calibration->published.load(c)) continue;
+                    for (int i = 0; i < c.table.size; i++) {
+                        double values[4] = {c.fitted_k[i], c.std_error[i], (double)c.samples[i], c.confident[i] ? 1.0 : 0.0};
+                        if (!std::isfinite(values[m])) continue;
+                        metric_value(out, NAMES[m], slave_labels(buses, p.bus, s.slave_id) + ",band=\""
+                                     + coefficient_band_label(c.table, i) + "\"", values[m]);
+                    }
+                }
+            }
+        }
+    }
+    
+    if (gateway != NULL) {
+        metric_header(out, "ec_gateway_requests_total", "counter", "Modbus TCP requests answered from the cache");
+        metric_value(out, "ec_gateway_requests_total", "", (double)gateway->requests);
+        metric_header(out, "ec_gateway_exceptions_total", "counter", "Modbus TCP requests answered with an exception");
+        metric_value(out, "ec_gateway_exceptions_total", "", (double)gateway->exceptions);
+        metric_header(out, "ec_gateway_connections", "gauge", "Open Modbus TCP client connections");
+        metric_value(out, "ec_gateway_connections", "", (double)gateway->connections);
+    }
 }
 
 // ===========================
-// HEX STRING CONVERTER (For Data Validation)
+// COMMAND LINE
 // ===========================
-// Converts two 16-bit Modbus registers to an 8-character hex string.
-// This allows validation of IEEE 754 float conversion by logging the raw bytes.
-// Example: reg_high=0x4135 (16693), reg_low=0x1A86 (6790) → "41351A86"
-// You can verify this at: https://www.h-schmidt.net/FloatConverter/IEEE754.html
-std::string to_hex_string(uint16_t reg_high, uint16_t reg_low) {
-    std::stringstream ss;
-    // Use std::hex to switch to hexadecimal mode
-    // std::uppercase for capital letters (A-F)
-    // std::setfill('0') ensures leading zeros are preserved
-    // std::setw(4) ensures each 16-bit value outputs exactly 4 hex characters
-    ss << std::uppercase << std::hex << std::setfill('0')
-       << std::setw(4) << reg_high
-       << std::setw(4) << reg_low;
-    return ss.str();
-}
+struct SlaveSpec {
+    int slave_id;
+    double period_ms;
+    std::string table_path;     // Empty = --coeff-table or the built-in table
+    size_t bus;                 // Index into LoggerOptions::ports
+};
 
-// ===========================
-// CLEAR SCREEN (Cross-platform)
-// ===========================
-void clear_screen() {
-    #ifdef _WIN32
-        system("cls");
-    #else
-        system("clear");
-    #endif
-}
+struct LoggerOptions {
+    std::vector<std::string> ports; // Empty = auto-discover one port
+    std::vector<SlaveSpec> slaves;
+    bool binary_log = false;
+    bool headless = false;
+    double max_fps = 4.0;
+    std::string table_path;
+    bool interpolate = false;
+    bool calibrate = false;         // Fit k online against the 12.88 mS/cm standard
+    bool calibrate_apply = false;   // ... and hot-swap confident bands into the table
+    bool oversample = false;        // Poll back to back, log one filtered sample per period
+    FilterMode filter_mode = FILTER_HAMPEL;
+    int filter_window = FILTER_WINDOW_DEFAULT;
+    double filter_trim = FILTER_TRIM_DEFAULT;
+    int metrics_port = 0;           // 0 = no TCP endpoint
+    std::string metrics_socket;     // Empty = no Unix socket endpoint
+    int gateway_port = 0;           // 0 = no Modbus TCP gateway
+    std::string gateway_bind = "0.0.0.0";
+    int gateway_threads = 1;
+    double adaptive_min_ms = 0.0;   // 0 = fixed-rate polling
+    double adaptive_max_ms = 0.0;
+    int baud = 9600;
+    bool tune_link = false;
+    LinkTuneOptions link;
+    bool event_loop = false;        // Non-blocking RTU on epoll instead of libmodbus reads
+    bool rollups = false;
+    int rollup_retention_days[TIER_COUNT] = {DEFAULT_ROLLUP_TIERS[TIER_MINUTE].retention_days,
+                                             DEFAULT_ROLLUP_TIERS[TIER_HOUR].retention_days,
+                                             DEFAULT_ROLLUP_TIERS[TIER_DAY].retention_days};
+};
 
-// ===========================
-// GET TIMESTAMP
-// ===========================
-std::string get_timestamp() {
-    time_t now = time(0);
-    struct tm tstruct;
-    char buf[80];
-    tstruct = *localtime(&now);
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tstruct);
-    return buf;
+void print_usage(const char *program) {
+    std::cout << "Usage: " << program << " [[--port PATH] [--slave ID[:PERIOD_MS]]...]... [--adaptive MIN_MS:MAX_MS]\n"
+              << "       [--baud N] [--tune-link [--baud-register ADDR] [--max-baud N]] [--event-loop]\n"
+              << "       [--log-format csv|binary]\n"
+              << "       [--fps N] [--headless] [--coeff-table FILE] [--interpolate]\n"
+              << "       [--calibrate | --calibrate-apply]\n"
+              << "       [--oversample [--filter hampel|median] [--filter-window N] [--trim F]]\n"
+              << "       [--metrics-port N | --metrics-socket PATH]\n"
+              << "       [--gateway-port N [--gateway-bind ADDR] [--gateway-threads N]]\n"
+              << "       [--rollups] [--rollup-retention TIER:DAYS]...\n\n"
+              << "  --port PATH             Use this RS485 adapter instead of auto-discovery.\n"
+              << "                          Repeat to poll several adapters; each --slave\n"
+              << "                          belongs to the --port before it. Uses --baud.\n"
+              << "  --slave ID[:PERIOD_MS[:TABLE]]\n"
+              << "                          Poll this slave ID every PERIOD_MS (default 1000).\n"
+              << "                          Repeat to poll several probes on one bus.\n"
+              << "                          PERIOD_MS=0 polls as fast as the bus allows.\n"
+              << "                          TABLE overrides the coefficient table for this slave.\n"
+              << "  Without --slave, slave 4 is polled once per second (on each --port).\n"
+              << "  --adaptive MIN_MS:MAX_MS\n"
+              << "                          Poll faster (down to MIN_MS) while temperature or EC\n"
+              << "                          is changing and slower (up to MAX_MS) when stable.\n"
+              << "  --baud N                Line speed when no cached rate is known (default 9600).\n"
+              << "  --tune-link             Measure the sensor's round trips at startup and set\n"
+              << "                          tight response/byte timeouts (instead of 1 s).\n"
+              << "  --baud-register ADDR    Also switch the sensor to the fastest baud rate that\n"
+              << "                          works, by writing a baud code to register ADDR (check\n"
+              << "                          the sensor manual). Falls back if a rate fails.\n"
+              << "  --max-baud N            Fastest rate --baud-register tries (default 115200).\n"
+              << "  --event-loop            Talk RTU through a non-blocking epoll loop instead of\n"
+              << "                          blocking libmodbus reads (same schedule and timeouts);\n"
+              << "                          one thread serves every --port.\n"
+              << "  --log-format binary     Log fixed-size records to a memory-mapped .bin file\n"
+              << "                          (export with ./log_export ec_data_log.bin out.csv).\n"
+              << "  --fps N                 Redraw the dashboard at most N times per second\n"
+              << "                          (default 4, independent of the sample rate).\n"
+              << "  --headless              Log only, never draw the dashboard.\n"
+              << "  --coeff-table FILE      Load the temperature coefficient table from FILE\n"
+              << "                          (default: the built-in get_dynamic_k() bands).\n"
+              << "  --interpolate           Interpolate k linearly between table rows.\n"
+              << "  --calibrate             Probe sits in the 12.88 mS/cm standard: refit k per\n"
+              << "                          table band while logging and write the candidate\n"
+              << "                          table to ec_calibration.txt every 10 s. SIGUSR1\n"
+              << "                          applies its confident bands without a restart.\n"
+              << "  --calibrate-apply       Like --calibrate, applying confident bands automatically.\n"
+              << "  --oversample            Poll as fast as the bus allows and log one denoised\n"
+              << "                          sample per PERIOD_MS, with its variance and the\n"
+              << "                          number of rejected readings.\n"
+              << "  --filter hampel|median  hampel (default): drop outliers beyond 3 sigma (MAD),\n"
+              << "                          then a trimmed mean. median: the per-value median.\n"
+              << "  --filter-window N       Newest readings kept per period (default 32, max 64).\n"
+              << "  --trim F                Fraction trimmed from each end (default 0.1).\n"
+              << "  --metrics-port N        Serve Prometheus metrics on http://127.0.0.1:N/metrics.\n"
+              << "  --metrics-socket PATH   Serve the same metrics on a Unix socket.\n"
+              << "  --gateway-port N        Share the readings over Modbus TCP (502 is standard).\n"
+              << "                          Clients are answered from the latest sample and never\n"
+              << "                          cause RS485 traffic.\n"
+              << "  --gateway-bind ADDR     Address to listen on (default 0.0.0.0).\n"
+              << "  --gateway-threads N     Threads answering gateway clients (default 1).\n"
+              << "  --rollups               Keep 1 min / 1 h / 1 day min-max-mean rollups\n"
+              << "                          (ec_rollup_1m.bin ...; query with ./rollup_query).\n"
+              << "  --rollup-retention TIER:DAYS\n"
+              << "                          Days kept per tier (1m:7, 1h:90, 1d:3650 by default;\n"
+              << "                          applies when the tier file is created).\n";
 }
 
-// ===========================
-// TEACHER MODE: GET TEMPERATURE CONDITION
-// ===========================
-std::string get_temp_condition(double temp) {
-    if (temp <= 5.0) {
-        return "Very Cold Range (≤5°C)";
-    } else if (temp <= 10.0) {
-        return "Cold Range (5-10°C)";
-    } else if (temp <= 15.0) {
-        return "Cool Range (10-15°C)";
-    } else if (temp <= 25.0) {
-        return "Normal Range (15-25°C)";
-    } else {
-        return "Warm Range (>25°C)";
+bool parse_args(int argc, char **argv, LoggerOptions &options) {
+    std::vector<SlaveSpec> &slaves = options.slaves;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc) {
+            options.ports.push_back(argv[++i]);
+        } else if (arg == "--slave" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            // A --slave belongs to the --port before it (the first port if none)
+            SlaveSpec s = {0, 1000.0, "", options.ports.empty() ? 0 : options.ports.size() - 1};
+            size_t colon = spec.find(':');
+            size_t table_colon = (colon == std::string::npos) ? colon : spec.find(':', colon + 1);
+            try {
+                s.slave_id = std::stoi(spec.substr(0, colon));
+                if (colon != std::string::npos) {
+                    s.period_ms = std::stod(spec.substr(colon + 1, table_colon - colon - 1));
+                }
+                if (table_colon != std::string::npos) {
+                    s.table_path = spec.substr(table_colon + 1);
+                }
+            } catch (const std::exception &) {
+                std::cerr << "❌ Invalid --slave value: " << spec << std::endl;
+                return false;
+            }
+            if (s.slave_id < 1 || s.slave_id > 247 || s.period_ms < 0) {
+                std::cerr << "❌ Invalid --slave value: " << spec << std::endl;
+                return false;
+            }
+            slaves.push_back(s);
+        } else if (arg == "--adaptive" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            if (sscanf(spec.c_str(), "%lf:%lf", &options.adaptive_min_ms, &options.adaptive_max_ms) != 2
+                || options.adaptive_min_ms <= 0 || options.adaptive_max_ms < options.adaptive_min_ms) {
+                std::cerr << "❌ Invalid --adaptive value: " << spec << " (expected MIN_MS:MAX_MS)" << std::endl;
+                return false;
+            }
+        } else if ((arg == "--baud" || arg == "--max-baud") && i + 1 < argc) {
+            int baud = atoi(argv[++i]);
+            if (baud_rate_code(baud) == -1) {
+                std::cerr << "❌ Invalid " << arg << " value: " << argv[i] << " (2400-115200)" << std::endl;
+                return false;
+            }
+            (arg == "--baud" ? options.baud : options.link.max_baud) = baud;
+        } else if (arg == "--tune-link") {
+            options.tune_link = true;
+        } else if (arg == "--baud-register" && i + 1 < argc) {
+            options.link.baud_register = atoi(argv[++i]);
+            if (options.link.baud_register < 0 || options.link.baud_register > 65535) {
+                std::cerr << "❌ Invalid --baud-register value: " << argv[i] << std::endl;
+                return false;
+            }
+            options.tune_link = true;
+        } else if (arg == "--log-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "csv" && format != "binary") {
+                std::cerr << "❌ Unknown log format: " << format << std::endl;
+                return false;
+            }
+            options.binary_log = (format == "binary");
+        } else if (arg == "--fps" && i + 1 < argc) {
+            std::string fps = argv[++i];
+            try {
+                options.max_fps = std::stod(fps);
+            } catch (const std::exception &) {
+                options.max_fps = -1;
+            }
+            if (options.max_fps <= 0) {
+                std::cerr << "❌ Invalid --fps value: " << fps << std::endl;
+                return false;
+            }
+        } else if (arg == "--event-loop") {
+            options.event_loop = true;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--coeff-table" && i + 1 < argc) {
+            options.table_path = argv[++i];
+        } else if (arg == "--interpolate") {
+            options.interpolate = true;
+        } else if (arg == "--calibrate" || arg == "--calibrate-apply") {
+            options.calibrate = true;
+            options.calibrate_apply = options.calibrate_apply || arg == "--calibrate-apply";
+        } else if (arg == "--oversample") {
+            options.oversample = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode != "hampel" && mode != "median") {
+                std::cerr << "❌ Unknown filter: " << mode << " (expected hampel or median)" << std::endl;
+                return false;
+            }
+            options.filter_mode = mode == "median" ? FILTER_MEDIAN : FILTER_HAMPEL;
+            options.oversample = true;
+        } else if (arg == "--filter-window" && i + 1 < argc) {
+            options.filter_window = atoi(argv[++i]);
+            if (options.filter_window < 1 || options.filter_window > FILTER_WINDOW_MAX) {
+                std::cerr << "❌ Invalid --filter-window value: " << argv[i] << " (1-" << FILTER_WINDOW_MAX << ")" << std::endl;
+                return false;
+            }
+            options.oversample = true;
+        } else if (arg == "--trim" && i + 1 < argc) {
+            options.filter_trim = atof(argv[++i]);
+            if (options.filter_trim < 0.0 || options.filter_trim >= 0.5) {
+                std::cerr << "❌ Invalid --trim value: " << argv[i] << " (0 to below 0.5)" << std::endl;
+                return false;
+            }
+            options.oversample = true;
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            options.metrics_port = atoi(argv[++i]);
+            if (options.metrics_port <= 0 || options.metrics_port > 65535) {
+                std::cerr << "❌ Invalid --metrics-port value: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--metrics-socket" && i + 1 < argc) {
+            options.metrics_socket = argv[++i];
+        } else if (arg == "--gateway-port" && i + 1 < argc) {
+            options.gateway_port = atoi(argv[++i]);
+            if (options.gateway_port <= 0 || options.gateway_port > 65535) {
+                std::cerr << "❌ Invalid --gateway-port value: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--gateway-bind" && i + 1 < argc) {
+            options.gateway_bind = argv[++i];
+        } else if (arg == "--rollups") {
+            options.rollups = true;
+        } else if (arg == "--rollup-retention" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t colon = spec.find(':');
+            int tier = -1;
+            for (int t = 0; t < TIER_COUNT; t++) {
+                if (spec.substr(0, colon) == DEFAULT_ROLLUP_TIERS[t].name) tier = t;
+            }
+            int days = colon == std::string::npos ? 0 : atoi(spec.c_str() + colon + 1);
+            if (tier == -1 || days <= 0) {
+                std::cerr << "❌ Invalid --rollup-retention value: " << spec << " (expected 1m|1h|1d:DAYS)" << std::endl;
+                return false;
+            }
+            options.rollup_retention_days[tier] = days;
+            options.rollups = true;
+        } else if (arg == "--gateway-threads" && i + 1 < argc) {
+            options.gateway_threads = atoi(argv[++i]);
+            if (options.gateway_threads < 1) {
+                std::cerr << "❌ Invalid --gateway-threads value: " << argv[i] << std::endl;
+                return false;
+            }
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    
+    size_t bus_count = options.ports.empty() ? 1 : options.ports.size();
+    for (size_t b = 0; b < bus_count; b++) {
+        bool has_slave = false;
+        for (const auto &s : slaves) {
+            has_slave = has_slave || s.bus == b;
+        }
+        if (!has_slave) {
+            slaves.push_back({4, 1000.0, "", b});  // Factory default, 1 sample per second
+        }
+    }
+    if (options.oversample) {
+        if (options.adaptive_max_ms > 0) {
+            std::cerr << "❌ --oversample and --adaptive cannot be combined" << std::endl;
+            return false;
+        }
+        for (const auto &s : slaves) {
+            if (s.period_ms <= 0) {
+                std::cerr << "❌ --oversample needs an output period for slave " << s.slave_id
+                          << " (PERIOD_MS > 0)" << std::endl;
+                return false;
+            }
+        }
     }
+    return true;
 }
 
 // ===========================
-// TEACHER MODE: DISPLAY EDUCATIONAL DASHBOARD
+// BUS SETUP
 // ===========================
-void display_teacher_dashboard(double temp, double raw_ec, double sensor_ec, double smart_ec, 
-                               double k_used, int sample_count, const std::string &port,
-                               const std::string &hex_temp, const std::string &hex_raw_ec) {
-    clear_screen();
-    
-    // Calculate validation metrics
-    const double STANDARD_VALUE = 12.88;
-    double sensor_error = fabs(sensor_ec - STANDARD_VALUE);
-    double smart_error = fabs(smart_ec - STANDARD_VALUE);
-    double improvement = sensor_error - smart_error;
-    
-    // Determine pass/fail
-    const double TOLERANCE = 0.10;  // ±0.10 mS/cm tolerance
-    bool sensor_pass = sensor_error <= TOLERANCE;
-    bool smart_pass = smart_error <= TOLERANCE;
-    
-    std::cout << "╔═══════════════════════════════════════════════════════════════════════╗\n";
-    std::cout << "║           🎓 TEACHER MODE: LIVE ALGORITHM VALIDATION 🎓              ║\n";
-    std::cout << "╚═══════════════════════════════════════════════════════════════════════╝\n\n";
-    
-    std::cout << "  📡 Port: " << port << " | Samples: " << sample_count 
-              << " | Time: " << get_timestamp() << "\n\n";
-    
-    // ========== SECTION A: THE "WHY" (LOGIC DISPLAY) ==========
-    std::cout << "┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓\n";
-    std::cout << "┃ 📚 SECTION A: THE \"WHY\" - Understanding the Logic                   ┃\n";
-    std::cout << "┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n\n";
-    
-    std::cout << "  Current Condition:\n";
-    std::cout << "    🌡️  Measured Temperature = " << std::fixed << std::setprecision(2) 
-              << temp << "°C  (0x" << hex_temp << ")  →  " << get_temp_condition(temp) << "\n\n";
-    
-    std::cout << "  Decision Logic:\n";
-    std::cout << "    🧠 Therefore, using Dynamic Coefficient k = " << std::setprecision(4) 
-              << k_used << " (" << (k_used * 100) << "%)\n";
-    std::cout << "    🔴 Sensor uses FIXED Coefficient k = 0.0200 (2.00%) ← WRONG!\n\n";
-    
-    std::cout << "  Why This Matters:\n";
-    std::cout << "    • At low temps, sensor OVER-compensates (k too high)\n";
-    std::cout << "    • Our algorithm adjusts k based on actual calibration data\n";
-    std::cout << "    • Result: More accurate readings across temperature range\n\n";
-    
-    // ========== SECTION B: THE MATH (FORMULA VISUALIZATION) ==========
-    std::cout << "┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓\n";
-    std::cout << "┃ 🧮 SECTION B: THE MATH - Live Formula Calculation                   ┃\n";
-    std::cout << "┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n\n";
-    
-    std::cout << "  Temperature Compensation Formula:\n\n";
-    std::cout << "    C₂₅ = Raw_EC / (1 + k × (Temp - 25))\n\n";
-    
-    std::cout << "  Sensor's Calculation (FIXED k=0.02):\n";
-    std::cout << "    " << std::setprecision(2) << sensor_ec << " = " << raw_ec 
-              << " / (1 + 0.0200 × (" << temp << " - 25.0))\n";
-    std::cout << "    " << sensor_ec << " = " << raw_ec << " / " 
-              << std::setprecision(4) << (1.0 + 0.02 * (temp - 25.0)) << "\n\n";
-    
-    std::cout << "  Smart Algorithm (DYNAMIC k=" << std::setprecision(4) << k_used << "):\n";
-    std::cout << "    " << std::setprecision(2) << smart_ec << " = " << raw_ec 
-              << " / (1 + " << std::setprecision(4) << k_used << " × (" 
-              << std::setprecision(2) << temp << " - 25.0))\n";
-    std::cout << "    " << smart_ec << " = " << raw_ec << " / " 
-              << std::setprecision(4) << (1.0 + k_used * (temp - 25.0)) << "\n\n";
-    
-    // ========== SECTION C: THE VERDICT (VALIDATION) ==========
-    std::cout << "┏━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┓\n";
-    std::cout << "┃ ⚖️  SECTION C: THE VERDICT - Validation Against Standard            ┃\n";
-    std::cout << "┗━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━┛\n\n";
-    
-    std::cout << "  Standard Reference: 12.88 mS/cm @ 25°C\n";
-    std::cout << "  Tolerance: ±" << TOLERANCE << " mS/cm\n\n";
-    
-    std::cout << "  Distance from Standard:\n";
-    std::cout << "    🔴 Sensor Error:  " << std::setprecision(4) << std::setw(8) << sensor_error 
-              << " mS/cm  ";
-    if (sensor_pass) {
-        std::cout << "✅ PASS\n";
-    } else {
-        std::cout << "❌ FAIL (exceeds tolerance)\n";
+// Everything one RS485 adapter needs before polling starts: optional link
+// tuning, the read plans, its slaves, the connection (or its place in the
+// event loop) and the logs. `discovered` is set when the port came from
+// auto-discovery, whose cache then learns a new baud rate. With several
+// ports every file name carries the port's name, e.g.
+// ec_data_log_ttyUSB1_slave4.csv.
+bool open_bus(std::deque<BusPipeline> &buses, SensorLocation location, bool discovered, size_t bus_index,
+              const LoggerOptions &options, const CoefficientTable &default_table, RtuEventLoop *event_loop) {
+    const std::string &port = location.port;
+    std::vector<SlaveSpec> slave_specs;
+    for (const auto &spec : options.slaves) {
+        if (spec.bus == bus_index) slave_specs.push_back(spec);
     }
-    
-    std::cout << "    🟢 Smart Error:   " << std::setw(8) << smart_error << " mS/cm  ";
-    if (smart_pass) {
-        std::cout << "✅ PASS\n";
-    } else {
-        std::cout << "❌ FAIL (exceeds tolerance)\n";
+    bool per_slave_files = options.slaves.size() > 1;
+    std::string file_tag = options.ports.size() > 1 ? "_" + port.substr(port.find_last_of('/') + 1) : "";
+    const char *log_extension = options.binary_log ? ".bin" : ".csv";
+    
+    // Step 2: Plan the register reads
+    // All three values live in 41-61, so they are fetched in one RTU
+    // transaction instead of three separate round trips.
+    int baud = location.baud;
+    double turnaround_ms = DEFAULT_TURNAROUND_MS;
+    ReadPlan read_plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud);
+    uint32_t response_timeout_usec = 1000000;  // 1 second for main loop
+    uint32_t byte_timeout_usec = 0;            // libmodbus default
+    
+    // Optional: measure the link (and move it to a faster rate)
+    if (options.tune_link) {
+        std::vector<int> slave_ids;
+        for (const auto &spec : slave_specs) {
+            slave_ids.push_back(spec.slave_id);
+        }
+        ReadBlock largest = read_plan.blocks[0];
+        for (const auto &block : read_plan.blocks) {
+            if (block.count > largest.count) largest = block;
+        }
+        
+        std::cout << "🔧 Tuning link on " << port << " (" << options.link.reads << " reads of " << largest.address
+                  << "-" << largest.address + largest.count - 1 << " per rate and slave)..." << std::endl;
+        LinkTuneResult link;
+        bool tuned = tune_link(port, slave_ids, baud, largest, options.link, link);
+        for (const auto &note : link.notes) {
+            std::cout << "   " << note << std::endl;
+        }
+        if (!tuned) {
+            std::cerr << "❌ Link tuning failed, sensor not answering on " << port << std::endl;
+            return false;
+        }
+        
+        if (link.baud != baud && discovered) {
+            location.baud = link.baud;
+            save_cached_location(location);  // Next start talks to it at the new rate
+        } else if (link.baud != baud) {
+            std::cout << "   Next time start with --port " << port << " --baud " << link.baud << std::endl;
+        }
+        baud = link.baud;
+        turnaround_ms = link.measurement.turnaround_ms;
+        response_timeout_usec = link.response_timeout_usec;
+        byte_timeout_usec = link.byte_timeout_usec;
+        std::cout << "   Timeouts: response " << response_timeout_usec / 1000 << " ms (was 1000 ms), byte "
+                  << byte_timeout_usec / 1000 << " ms" << std::endl;
+        std::cout << "   Max " << std::fixed << std::setprecision(1) << link.max_transactions_per_s
+                  << " transactions/s at " << baud << " baud" << std::endl;
+        read_plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud, turnaround_ms);
     }
-    
-    std::cout << "\n  Improvement Score:\n";
-    std::cout << "    📈 Error Reduction: " << std::setprecision(4) << improvement << " mS/cm";
-    
-    if (improvement > 0) {
-        std::cout << "  ✅ Smart Algorithm is BETTER!\n";
-    } else if (improvement < 0) {
-        std::cout << "  ⚠️  Sensor Default is better (rare)\n";
-    } else {
-        std::cout << "  ➡️  No difference\n";
+    ReadPlan unmerged_plan = plan_register_reads(EC4A_REGISTER_MAP, FIELD_COUNT, baud,
+                                                 turnaround_ms, false);  // Fallback
+    
+    // Step 3: Establish main connection (one context shared by every slave)
+    buses.emplace_back(port, baud, read_plan, unmerged_plan);
+    BusScheduler &bus = buses.back().bus;
+    buses.back().metrics.add_plan(read_plan);
+    buses.back().metrics.add_plan(unmerged_plan);
+    bus.metrics = &buses.back().metrics;
+    
+    for (const auto &spec : slave_specs) {
+        CoefficientTable table = default_table;
+        if (!spec.table_path.empty() && !load_coefficient_table(spec.table_path, table)) {
+            return false;
+        }
+        if (options.interpolate) {
+            table.mode = COEFF_LINEAR;
+        }
+        
+        std::string log_path = "ec_data_log" + file_tag
+            + (per_slave_files ? "_slave" + std::to_string(spec.slave_id) : "") + log_extension;
+        // --oversample: the bus runs flat out, the period is the filter's
+        SlaveChannel &slave = bus.add_slave(spec.slave_id, options.oversample ? 0.0 : spec.period_ms,
+                                            table, log_path);
+        if (options.oversample) {
+            slave.filter.reset(new SampleFilter());
+            slave.filter->mode = options.filter_mode;
+            slave.filter->window = options.filter_window;
+            slave.filter->trim = options.filter_trim;
+            slave.filter->period_ms = spec.period_ms;
+        }
+    }
+    if (options.adaptive_max_ms > 0) {
+        bus.set_adaptive(options.adaptive_min_ms, options.adaptive_max_ms);
     }
     
-    std::cout << "    📊 Improvement: " << std::setprecision(1) 
-              << (sensor_error > 0 ? (improvement / sensor_error * 100.0) : 0.0) << "%\n\n";
-    
-    // ========== SUMMARY BOX ==========
-    std::cout << "┌───────────────────────────────────────────────────────────────────────┐\n";
-    std::cout << "│                         📊 QUICK SUMMARY                              │\n";
-    std::cout << "├───────────────────────────────────────────────────────────────────────┤\n";
-    std::cout << "│  🌡️  Temperature:     " << std::setprecision(2) << std::setw(10) << temp << " °C";
-    std::cout << "  [Hex: " << hex_temp << "]             │\n";
-    std::cout << "│  📊 Raw EC:           " << std::setw(10) << raw_ec << " mS/cm";
-    std::cout << "  [Hex: " << hex_raw_ec << "]             │\n";
-    std::cout << "│  🔴 Sensor Output:    " << std::setw(10) << sensor_ec << " mS/cm  ";
-    std::cout << (sensor_pass ? "✅ PASS" : "❌ FAIL") << "                    │\n";
-    std::cout << "│  🟢 Smart Output:     " << std::setw(10) << smart_ec << " mS/cm  ";
-    std::cout << (smart_pass ? "✅ PASS" : "❌ FAIL") << "                    │\n";
-    std::cout << "└───────────────────────────────────────────────────────────────────────┘\n\n";
+    bool connected = event_loop != NULL
+        ? event_loop->add_port(bus, response_timeout_usec, byte_timeout_usec)
+        : bus.connect(response_timeout_usec / 1000000, response_timeout_usec % 1000000, byte_timeout_usec);
+    if (!connected) {
+        std::cerr << "❌ Connection to " << port << " failed: " << modbus_strerror(errno) << std::endl;
+        return false;
+    }
     
-    std::cout << "  💾 Logging to CSV: ec_data_log.csv\n";
-    std::cout << "  ⏹️  Press Ctrl+C to stop and analyze data\n\n";
+    std::cout << "\n🚀 Connected to sensor on " << port
+              << (event_loop != NULL ? " (non-blocking event loop)" : "") << std::endl;
+    std::cout << "📦 Read plan: " << read_plan.transactions() << " transaction(s) per sample ["
+              << read_plan.describe() << "], ~" << std::fixed << std::setprecision(1)
+              << read_plan.bus_time_ms() << " ms bus time (was "
+              << unmerged_plan.transactions() << " transactions, ~"
+              << unmerged_plan.bus_time_ms() << " ms)" << std::endl;
+    
+    // Step 4: Create/Open log files
+    for (auto &slave : bus.slaves) {
+        std::string slave_tag = file_tag + (per_slave_files ? "_slave" + std::to_string(slave.slave_id) : "");
+        if (options.binary_log) {
+            slave.binary_log.reset(new BinaryLog());
+            if (!slave.binary_log->open(slave.log_path)) {
+                std::cerr << "❌ Cannot open binary log " << slave.log_path << ": "
+                          << strerror(errno) << std::endl;
+                return false;
+            }
+        } else {
+            if (!open_csv_log(slave.log, slave.log_path, options.oversample)) {
+                return false;
+            }
+        }
+        if (options.rollups) {
+            std::string prefix = "ec_rollup" + slave_tag;
+            slave.rollups.reset(new RollupStore());
+            if (!slave.rollups->open(prefix, options.rollup_retention_days)) {
+                std::cerr << "❌ Cannot open rollup files " << prefix << "_*.bin: " << strerror(errno) << std::endl;
+                return false;
+            }
+            std::cout << "📈 Slave " << slave.slave_id << " rollups: " << prefix << "_{1m,1h,1d}.bin" << std::endl;
+        }
+        if (options.calibrate) {
+            slave.calibration.reset(new CoefficientFitter());
+            slave.calibration->reset(slave.table);
+            slave.calibration->path = "ec_calibration" + slave_tag + ".txt";
+            std::cout << "🎯 Slave " << slave.slave_id << " calibration: fitting k against "
+                      << std::setprecision(2) << CALIBRATION_STANDARD_EC << " mS/cm, candidate table in " << slave.calibration->path
+                      << (options.calibrate_apply ? " (applied automatically)" : " (kill -USR1 to apply)")
+                      << std::endl;
+        }
+        if (slave.filter) {
+            std::cout << "🔬 Slave " << slave.slave_id << " oversampling: one "
+                      << (slave.filter->mode == FILTER_MEDIAN ? "median" : "Hampel + trimmed mean")
+                      << " sample per " << std::setprecision(0) << slave.filter->period_ms << " ms from up to "
+                      << slave.filter->window << " readings" << std::endl;
+        }
+        std::cout << "📝 Slave " << slave.slave_id << " will be logged to: " << slave.log_path
+                  << " (" << slave.table.size << " coefficient rows, "
+                  << (slave.table.mode == COEFF_LINEAR ? "interpolated" : "step") << ")" << std::endl;
+    }
+    return true;
 }
 
 // ===========================
 // MAIN PROGRAM
 // ===========================
-int main() {
-    // Step 1: Auto-discover the sensor
-    std::string port = find_sensor_port();
-    
-    if (port.empty()) {
-        std::cerr << "❌ ERROR: Sensor not found!" << std::endl;
-        std::cerr << "   Check: USB connection, Slave ID (must be 4), Baud Rate (9600)" << std::endl;
+int main(int argc, char **argv) {
+    LoggerOptions options;
+    if (!parse_args(argc, argv, options)) {
         return -1;
     }
     
-    // Step 2: Establish main connection
-    modbus_t *ctx = modbus_new_rtu(port.c_str(), 9600, 'N', 8, 1);
-    if (ctx == NULL) {
-        std::cerr << "❌ Failed to create Modbus context" << std::endl;
-        return -1;
+    // Step 1: Auto-discover the sensor (unless --port names the adapters)
+    SensorLocation location;
+    bool discovered = options.ports.empty();
+    if (discovered) {
+        location = find_sensor(options.slaves[0].slave_id, options.baud);
+        if (location.port.empty()) {
+            std::cerr << "❌ ERROR: Sensor not found!" << std::endl;
+            std::cerr << "   Check: USB connection, Slave ID (must be " << options.slaves[0].slave_id
+                      << "), Baud Rate (" << options.baud << ", see --baud)" << std::endl;
+            return -1;
+        }
+        options.ports.push_back(location.port);
     }
     
-    modbus_set_slave(ctx, 4);
-    modbus_set_response_timeout(ctx, 1, 0);  // 1 second for main loop
+    // Instrumentation is always on; --metrics-port/--metrics-socket only
+    // decide whether it is served. Each bus keeps its own metrics (see
+    // BusPipeline); these are the render phase and the allocation counters.
+    static LoggerMetrics metrics;
     
-    if (modbus_connect(ctx) == -1) {
-        std::cerr << "❌ Connection failed: " << modbus_strerror(errno) << std::endl;
-        modbus_free(ctx);
+    CoefficientTable default_table = DEFAULT_COEFFICIENT_TABLE;
+    if (!options.table_path.empty() && !load_coefficient_table(options.table_path, default_table)) {
         return -1;
     }
     
-    std::cout << "\n🚀 Connected to sensor on " << port << std::endl;
+    // --event-loop: one non-blocking loop serves every port. It owns an
+    // epoll descriptor, so it only exists when asked for.
+    std::unique_ptr<RtuEventLoop> event_loop;
+    if (options.event_loop) {
+        event_loop.reset(new RtuEventLoop());
+    }
+    
+    // Steps 2-4 for every adapter: its own scheduler, ring and output stages
+    static std::deque<BusPipeline> buses;
+    for (size_t b = 0; b < options.ports.size(); b++) {
+        if (!discovered) {
+            location = SensorLocation();
+            location.port = options.ports[b];
+            location.baud = options.baud;
+        }
+        if (!open_bus(buses, location, discovered, b, options, default_table, event_loop.get())) {
+            return -1;
+        }
+    }
     std::cout << "📊 Starting Smart Logger..." << std::endl;
-    std::cout << "📝 Data will be logged to: ec_data_log.csv" << std::endl;
+    std::cout << "🧮 Compensation engine: " << compensation_engine_name() << std::endl;
+    if (options.calibrate) {
+        signal(SIGUSR1, request_calibration_apply);
+    }
     std::cout << "   Press Ctrl+C to stop.\n" << std::endl;
     
     sleep(2);
     
-    // Step 3: Create/Open CSV file
-    std::ofstream csv_file;
-    bool file_exists = (access("ec_data_log.csv", F_OK) != -1);
+    // Step 5: Start the acquisition thread(s) (Modbus only)
+    // Optional Modbus TCP gateway: one unit per slave, fed by the output
+    // stages. A slave ID on several buses is answered for the first one.
+    static ModbusGateway gateway;
+    bool gateway_enabled = options.gateway_port > 0;
+    if (gateway_enabled) {
+        std::vector<int> unit_ids;
+        for (auto &p : buses) {
+            for (const auto &slave : p.bus.slaves) {
+                for (int id : unit_ids) {
+                    if (id == slave.slave_id) {
+                        std::cerr << "⚠️  Slave " << id << " is on several buses, gateway unit " << id
+                                  << " answers for the first one" << std::endl;
+                    }
+                }
+                unit_ids.push_back(slave.slave_id);
+                size_t unit = gateway.add_unit(slave.slave_id);
+                if (&slave == &p.bus.slaves[0]) p.stages.gateway_unit_base = unit;
+            }
+        }
+        if (!gateway.listen(options.gateway_bind, options.gateway_port, options.gateway_threads)) {
+            std::cerr << "❌ Cannot open Modbus TCP gateway on " << options.gateway_bind << ":"
+                      << options.gateway_port << ": " << strerror(errno) << std::endl;
+            return -1;
+        }
+        gateway.start();
+        std::cout << "🌐 Modbus TCP gateway on " << options.gateway_bind << ":" << options.gateway_port
+                  << " (" << options.gateway_threads << " thread(s))" << std::endl;
+    }
     
-    csv_file.open("ec_data_log.csv", std::ios::app);
+    static MetricsServer metrics_server;
+    if (options.metrics_port > 0 || !options.metrics_socket.empty()) {
+        bool listening = options.metrics_port > 0
+            ? metrics_server.listen_tcp(options.metrics_port)
+            : metrics_server.listen_unix(options.metrics_socket);
+        if (!listening) {
+            std::cerr << "❌ Cannot open metrics endpoint: " << strerror(errno) << std::endl;
+            return -1;
+        }
+        const ModbusGateway *served_gateway = gateway_enabled ? &gateway : NULL;
+        metrics_server.start([served_gateway](std::string &out) {
+            render_metrics(out, metrics, buses, served_gateway);
+        });
+    }
     
-    // Write header if new file (with hex validation columns)
-    if (!file_exists) {
-        csv_file << "Timestamp,Temperature,Hex_Temp,Raw_EC,Hex_Raw_EC,Sensor_Default_EC,Smart_Calc_EC,Deviation\n";
+    // One blocking thread per bus, or one event-loop thread for all of them
+    std::vector<std::thread> acquisition;
+    for (auto &p : buses) {
+        p.bus.start();
+    }
+    if (event_loop) {
+        acquisition.emplace_back(run_event_acquisition, std::ref(*event_loop), std::ref(buses), std::ref(metrics));
+    } else {
+        for (auto &p : buses) {
+            acquisition.emplace_back(run_acquisition, std::ref(p.bus), std::ref(p.ring), std::ref(metrics));
+        }
     }
     
-    // Step 4: Main data acquisition loop
-    uint16_t reg_data[2];
-    int loop_count = 0;
-    std::string hex_temp, hex_raw_ec;  // Raw hex strings for data validation
+    // Step 6: Output stages - drain every ring in batches
+    // Compensation and logging run for every sample; the dashboard is drawn
+    // from the newest samples at most --fps times per second, so a slow
+    // terminal only makes the display skip frames and never delays a poll.
+    for (auto &p : buses) {
+        p.stages.oversample = options.oversample;
+        p.stages.gateway = gateway_enabled ? &gateway : NULL;
+        p.stages.metrics = &p.metrics;
+    }
+    static TermRenderer screen;
+    screen.headless = options.headless;
+    screen.max_fps = options.max_fps;
+    
+    allocation_counter = &metrics.output_allocations;
+    time_t next_calibration_publish = time(NULL) + CALIBRATION_PUBLISH_INTERVAL_S;
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    bool stopping = false;
     
     while (true) {
-        loop_count++;
-        
-        // Read Temperature (Reg 60-61)
-        double temp = 0.0;
-        if (modbus_read_registers(ctx, 60, 2, reg_data) != -1) {
-            // Capture raw hex BEFORE float conversion for validation
-            hex_temp = to_hex_string(reg_data[0], reg_data[1]);
-            temp = modbus_get_float_abcd(reg_data);
-        } else {
-            std::cerr << "⚠️  Failed to read temperature" << std::endl;
-            sleep(1);
-            continue;
+        // Ctrl+C: stop polling, then log what is still in the rings
+        if (stop_requested && !stopping) {
+            stopping = true;
+            for (auto &p : buses) {
+                p.bus.running = false;
+            }
+            for (auto &t : acquisition) {
+                t.join();
+            }
+        }
+        // Stages 0-2: filter, compensation, logging
+        size_t count = 0;
+        bool frame_pending = false;
+        for (auto &p : buses) {
+            count += p.stages.process(p.bus, p.ring);
+            frame_pending = frame_pending || p.stages.frame_pending;
+        }
+        if (stopping && count == 0) {
+            break;
         }
         
-        // Read Raw EC (Reg 45-46)
-        double raw_ec = 0.0;
-        if (modbus_read_registers(ctx, 45, 2, reg_data) != -1) {
-            // Capture raw hex BEFORE float conversion for validation
-            hex_raw_ec = to_hex_string(reg_data[0], reg_data[1]);
-            raw_ec = modbus_get_float_abcd(reg_data);
-        } else {
-            std::cerr << "⚠️  Failed to read raw EC" << std::endl;
-            sleep(1);
-            continue;
+        // Candidate coefficient tables: every few seconds, or now on SIGUSR1
+        if (options.calibrate && (calibration_apply_requested || time(NULL) >= next_calibration_publish)) {
+            bool requested = calibration_apply_requested;
+            calibration_apply_requested = 0;
+            for (auto &p : buses) {
+                publish_calibration(p.bus, options.calibrate_apply || requested);
+            }
+            next_calibration_publish = time(NULL) + CALIBRATION_PUBLISH_INTERVAL_S;
         }
         
-        // Read Sensor's Internal EC (Reg 41-42) - "The Wrong Value"
-        double sensor_ec = 0.0;
-        if (modbus_read_registers(ctx, 41, 2, reg_data) != -1) {
-            sensor_ec = modbus_get_float_abcd(reg_data);
-        } else {
-            std::cerr << "⚠️  Failed to read sensor EC" << std::endl;
-            sleep(1);
+        if (!frame_pending || !screen.frame_due()) {
+            if (count == 0) usleep(PIPELINE_IDLE_US);
             continue;
         }
+        for (auto &p : buses) {
+            p.stages.frame_pending = false;
+        }
         
-        // Calculate Smart EC
-        double smart_ec = calculate_smart_ec(raw_ec, temp);
-        double k_used = get_dynamic_k(temp);
-        double deviation = sensor_ec - smart_ec;
-        
-        // Calculate validation metrics
-        const double STANDARD_VALUE = 12.88;
-        double distance_sensor = fabs(sensor_ec - STANDARD_VALUE);
-        double distance_smart = fabs(smart_ec - STANDARD_VALUE);
-        double improvement_score = distance_sensor - distance_smart;
-        
+        // Stage 3: display
         // Display educational dashboard (with hex validation data)
-        display_teacher_dashboard(temp, raw_ec, sensor_ec, smart_ec, k_used, loop_count, port,
-                                  hex_temp, hex_raw_ec);
-        
-        // Log to CSV with hex validation columns
-        csv_file << get_timestamp() << ","
-                 << temp << ","
-                 << hex_temp << ","
-                 << raw_ec << ","
-                 << hex_raw_ec << ","
-                 << sensor_ec << ","
-                 << smart_ec << ","
-                 << deviation << "\n";
-        csv_file.flush();
-        
-        // Wait 1 second before next reading
-        sleep(1);
+        auto phase_start = std::chrono::steady_clock::now();
+        render_dashboard(screen, buses);
+        metrics.phases[PHASE_RENDER].observe_since(phase_start);
     }
     
-    // Cleanup (unreachable, but good practice)
-    csv_file.close();
-    modbus_close(ctx);
-    modbus_free(ctx);
-    
+    // Step 7: Shut down - the binary log syncs and gives back its preallocation
+    allocation_counter = nullptr;
+    metrics_server.stop();
+    if (gateway_enabled) {
+        gateway.stop();
+    }
+    for (auto &p : buses) {
+        for (auto &slave : p.bus.slaves) {
+            if (slave.binary_log) slave.binary_log->close();
+            if (slave.log.is_open()) slave.log.close();
+            if (slave.rollups) slave.rollups->close();
+        }
+    }
+    std::cout << "\n⏹️  Stopped. Logs closed." << std::endl;
     return 0;
 }
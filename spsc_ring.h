@@ -0,0 +1,84 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// ===========================
+// LOCK-FREE SPSC RING
+// ===========================
+// Single-producer / single-consumer queue between the acquisition thread
+// (Modbus only) and the output stages (compensation, logging, display).
+//
+// - push() never blocks: when the consumer falls behind and the ring is
+//   full, the sample is dropped and counted as an overrun, so poll timing
+//   never depends on how fast the terminal or disk is.
+// - pop_batch() drains up to N items in one go, so the consumer pays the
+//   atomic synchronization once per batch instead of once per sample.
+//
+// Capacity must be a power of two. head/tail live on separate cache lines
+// so producer and consumer do not false-share.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(const T &item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ == Capacity) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ == Capacity) {
+                overruns_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        slots_[head & (Capacity - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+
+        size_t depth = head + 1 - tail_.load(std::memory_order_relaxed);
+        if (depth > high_water_.load(std::memory_order_relaxed)) {
+            high_water_.store(depth, std::memory_order_relaxed);
+        }
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t pop_batch(T *out, size_t max_items) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t available = head_.load(std::memory_order_acquire) - tail;
+        size_t n = available < max_items ? available : max_items;
+
+        for (size_t i = 0; i < n; i++) {
+            out[i] = slots_[(tail + i) & (Capacity - 1)];
+        }
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Counters (safe to read from any thread). depth() loads tail before
+    // head: head is never behind tail and only grows, so a later head
+    // cannot be smaller. Both may move in between, hence the clamp.
+    size_t depth() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t depth = head - tail;
+        return depth < Capacity ? depth : Capacity;
+    }
+    size_t capacity() const { return Capacity; }
+    size_t high_water() const { return high_water_.load(std::memory_order_relaxed); }
+    uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+    uint64_t pushed() const { return pushed_.load(std::memory_order_relaxed); }
+
+private:
+    alignas(64) std::atomic<size_t> head_{0};   // Written by producer
+    size_t cached_tail_ = 0;                    // Producer's view of tail_
+    alignas(64) std::atomic<size_t> tail_{0};   // Written by consumer
+    alignas(64) std::atomic<size_t> high_water_{0};
+    std::atomic<uint64_t> overruns_{0};
+    std::atomic<uint64_t> pushed_{0};
+    alignas(64) T slots_[Capacity];
+};
+
+#endif // SPSC_RING_H
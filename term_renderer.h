@@ -0,0 +1,119 @@
+#ifndef TERM_RENDERER_H
+#define TERM_RENDERER_H
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+// ===========================
+// FLICKER-FREE TERMINAL RENDERER
+// ===========================
+// Replaces system("clear") + ~60 std::cout lines per sample:
+//
+// - A frame is built line by line (printf-style) into preallocated buffers.
+// - Only lines that differ from the previous frame are repainted, using
+//   ANSI cursor addressing (ESC[row;1H ... ESC[K). Unchanged lines cost
+//   nothing on the wire, which matters over SSH.
+// - The whole update goes out in a single write() per frame.
+// - Frames are rate-limited independently of the sample rate, and a
+//   headless renderer never draws at all.
+//
+// Lines are the unit of change (not single cells): the dashboard mixes
+// emoji and box-drawing characters whose display width differs from their
+// byte length, so column-precise patching is not reliable.
+const int RENDER_MAX_LINES = 96;
+const int RENDER_LINE_BYTES = 384;
+const int RENDER_FULL_REPAINT_FRAMES = 50;   // Self-heal after stray stderr output
+
+struct TermRenderer {
+    char lines[2][RENDER_MAX_LINES][RENDER_LINE_BYTES];
+    int line_count[2] = {0, 0};
+    int current = 0;                // Index of the frame being built
+    char out[RENDER_MAX_LINES * (RENDER_LINE_BYTES + 16) + 16];
+    bool headless = false;
+    int fd = STDOUT_FILENO;         // Where frames are written
+    bool first_frame = true;
+    double max_fps = 4.0;
+    long frames = 0;
+    long bytes_written = 0;
+    std::chrono::steady_clock::time_point last_frame;
+
+    // True when a new frame may be drawn. Callers skip building the frame
+    // entirely otherwise, so rate limiting also saves the formatting work.
+    bool frame_due() const {
+        if (headless) return false;
+        if (first_frame || max_fps <= 0) return true;
+        double elapsed_s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - last_frame).count();
+        return elapsed_s >= 1.0 / max_fps;
+    }
+
+    void begin_frame() {
+        line_count[current] = 0;
+    }
+
+    // Appends one line to the frame (no trailing newline needed).
+    void line(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        int n = line_count[current];
+        if (n >= RENDER_MAX_LINES) return;
+
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(lines[current][n], RENDER_LINE_BYTES, fmt, args);
+        va_end(args);
+        line_count[current] = n + 1;
+    }
+
+    void blank() {
+        line("%s", "");
+    }
+
+    // Diffs against the previous frame and writes the changes in one go.
+    void end_frame() {
+        int prev = 1 - current;
+        bool full = first_frame || frames % RENDER_FULL_REPAINT_FRAMES == 0;
+        size_t len = 0;
+
+        if (first_frame) {
+            len += append(out + len, "\x1b[H\x1b[2J");
+        }
+
+        for (int i = 0; i < line_count[current]; i++) {
+            if (!full && i < line_count[prev] && strcmp(lines[current][i], lines[prev][i]) == 0) {
+                continue;
+            }
+            len += snprintf(out + len, sizeof(out) - len, "\x1b[%d;1H", i + 1);
+            len += append(out + len, lines[current][i]);
+            len += append(out + len, "\x1b[K");
+        }
+
+        // Shorter frame than before: wipe whatever is left below it
+        if (full || line_count[current] < line_count[prev]) {
+            len += snprintf(out + len, sizeof(out) - len, "\x1b[%d;1H\x1b[J", line_count[current] + 1);
+        }
+
+        if (len > 0) {
+            ssize_t written = write(fd, out, len);
+            if (written > 0) bytes_written += written;
+        }
+
+        first_frame = false;
+        frames++;
+        last_frame = std::chrono::steady_clock::now();
+        current = prev;
+    }
+
+private:
+    size_t append(char *dest, const char *text) {
+        size_t room = sizeof(out) - (dest - out);
+        size_t n = strlen(text);
+        if (n >= room) n = room - 1;
+        memcpy(dest, text, n);
+        dest[n] = '\0';
+        return n;
+    }
+};
+
+#endif // TERM_RENDERER_H